@@ -0,0 +1,108 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include <atomic>
+
+#include "ByteRing.h"
+
+/* =========================================================
+   非同期ログ書込み（端末専用）
+   - メインループは write() でリングに積むだけ（待たない）
+   - SD への書込みは別タスクがまとめて行う
+   - カード抜け等で書けない間は捨てる（ループを止めない）
+   - SD を外す（SD.end()）前に pause()：書込み中ならそれが終わるのを待ち、ファイルを閉じて止まる。
+     付け直せたら resume() で次の書込みから開き直す（止まっている間もリングには積む）
+   ========================================================= */
+class AsyncLogBase {
+public:
+  // 書込みタスクが止まったのを確かめてから戻る（begin 前は何もしない）。
+  // 要求ごとに番号を振り、タスクがその番号を返すまで待つ（前の要求への応答では戻らない）
+  void pause() {
+    const uint32_t g = _reqGen.fetch_add(1) + 1;
+    _pauseReq = true;
+    while (_running && _ackGen.load() != g) vTaskDelay(1);
+  }
+  void resume() { _pauseReq = false; }
+
+protected:
+  std::atomic<bool>     _pauseReq{ false };
+  std::atomic<uint32_t> _reqGen{ 0 };
+  std::atomic<uint32_t> _ackGen{ 0 };    // タスクが止まった時に見た要求番号
+  std::atomic<bool>     _running{ false };
+
+  // タスク側：止める要求があればファイルを閉じてから応答して true
+  template <class F>
+  bool pausePoint(F& f) {
+    if (!_pauseReq) return false;
+    if (f) f.close();
+    _ackGen = _reqGen.load();
+    return true;
+  }
+};
+
+template <size_t N>
+class AsyncLog : public AsyncLogBase {
+public:
+  static constexpr size_t   CHUNK      = 512;   // これだけ溜まったら書く
+  static constexpr uint32_t FLUSH_MS   = 1000;  // 溜まらなくてもこの間隔で書く
+
+  bool begin(fs::FS& fs, const char* path, int core = 0) {
+    _fs = &fs;
+    snprintf(_path, sizeof(_path), "%s", path);
+    _running = xTaskCreatePinnedToCore(task, "alog", 4096, this, 1, nullptr, core) == pdPASS;
+    return _running.load();
+  }
+
+  bool write(const void* d, size_t n) {
+    while (_blocking && !_pauseReq && _ring.space() < n) vTaskDelay(1);
+    return _ring.write(d, n);
+  }
+
+  // 起動時の設定ファイル等、落とせない書込みの間だけ空きを待つ
+  void blocking(bool on) { _blocking = on; }
+
+  const char* path()    const { return _path; }
+  uint32_t    dropped() const { return _ring.dropped(); }
+  size_t      pending() const { return _ring.used(); }
+  size_t      space()   const { return _ring.space(); }
+
+private:
+  ByteRing<N> _ring;
+  fs::FS*     _fs = nullptr;
+  char        _path[32] = "";
+  volatile bool _blocking = false;
+
+  static void task(void* arg) { static_cast<AsyncLog*>(arg)->run(); }
+
+  void run() {
+    File f;
+    uint32_t lastWrite = millis();
+    uint32_t lastFlush = lastWrite;
+
+    for (;;) {
+      if (pausePoint(f)) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        continue;
+      }
+
+      const uint8_t* p;
+      size_t n = _ring.peek(p);
+
+      if (n >= CHUNK || (n > 0 && millis() - lastWrite >= FLUSH_MS)) {
+        if (!f) f = _fs->open(_path, FILE_APPEND);
+        if (f && f.write(p, n) != n) f.close(); // 失敗したら次回開き直す
+        _ring.consume(n);
+        lastWrite = millis();
+      } else {
+        vTaskDelay(pdMS_TO_TICKS(10));
+      }
+
+      if (f && millis() - lastFlush >= FLUSH_MS) {
+        f.flush();
+        lastFlush = millis();
+      }
+    }
+  }
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* =========================================================
+   事故時のブラックボックス
+   - 常時：フィックスと IMU を RAM のリングに回し続ける（前 PRE 秒＋後 POST 秒ぶん）
+   - きっかけ：IMU の衝撃 / GPS の G / 1秒間の速度低下 / 手動マーク（BtnB+BtnC）
+   - きっかけから POST 秒は記録を続け、そこで凍結 → pump() で少しずつ書き出す
+     （書き出し先の空きぶんだけ書くのでループを止めない。書き終えたら再開）
+   - 形式（リトルエンディアン）：ヘッダ 32 B、フィックス 20 B × nFix、IMU 16 B × nImu
+   ========================================================= */
+
+#ifndef BB_PRE_S
+#define BB_PRE_S 30
+#endif
+#ifndef BB_POST_S
+#define BB_POST_S 10
+#endif
+#ifndef BB_FIX_HZ
+#define BB_FIX_HZ 10
+#endif
+#ifndef BB_IMU_HZ
+#define BB_IMU_HZ 25
+#endif
+#ifndef BB_IMU_G
+#define BB_IMU_G 4.0f        // |加速度| の 1g からのずれ
+#endif
+#ifndef BB_GPS_G
+#define BB_GPS_G 2.5f        // GPS の前後・横G の合成
+#endif
+#ifndef BB_DROP_KMH
+#define BB_DROP_KMH 50.0f    // 1秒間の速度低下
+#endif
+
+namespace blackbox {
+
+enum Reason : uint8_t { R_NONE = 0, R_IMU = 1, R_GPS_G = 2, R_SPEED_DROP = 3, R_MARK = 4 };
+
+struct Fix {
+  uint32_t ms;
+  int32_t  lat, lon;        // 1e-7 度
+  uint16_t kmph;            // 0.01 km/h
+  uint16_t course;          // 0.01 度
+  int16_t  accLong, accLat; // mg
+};
+static_assert(sizeof(Fix) == 20, "Fix layout");
+
+struct Imu {
+  uint32_t ms;
+  int16_t  acc[3];          // mg
+  int16_t  gyro[3];         // 0.1 dps
+};
+static_assert(sizeof(Imu) == 16, "Imu layout");
+
+struct Header {
+  char     magic[4] = { 'B', 'B', 'O', 'X' };
+  uint16_t version = 1;
+  uint8_t  reason = R_NONE;
+  uint8_t  reserved = 0;
+  uint32_t trigMs = 0;
+  uint32_t preMs = 0, postMs = 0;
+  uint16_t nFix = 0, nImu = 0;
+  uint16_t year = 0;
+  uint8_t  month = 0, day = 0, hour = 0, minute = 0, second = 0, reserved2 = 0;
+};
+static_assert(sizeof(Header) == 32, "Header layout");
+
+inline const char* reasonName(uint8_t r) {
+  static const char* const n[] = { "none", "imu", "gps-g", "speed-drop", "mark" };
+  return r < 5 ? n[r] : "?";
+}
+
+template <size_t FIXES = (BB_PRE_S + BB_POST_S) * BB_FIX_HZ,
+          size_t IMUS  = (BB_PRE_S + BB_POST_S) * BB_IMU_HZ>
+class Recorder {
+public:
+  static constexpr uint32_t PRE_MS = BB_PRE_S * 1000u, POST_MS = BB_POST_S * 1000u;
+  static constexpr size_t   BYTES = FIXES * sizeof(Fix) + IMUS * sizeof(Imu);
+
+  enum State : uint8_t { ARMED, POST, DUMP };
+  State state() const { return _st; }
+  uint8_t reason() const { return _hdr.reason; }
+  uint32_t incidents() const { return _count; }
+
+  // 現在の UTC（ヘッダ用。フィックスごとに渡す）
+  void clock(int y, int mo, int d, int h, int mi, int s) {
+    _y = (uint16_t)y; _mo = (uint8_t)mo; _d = (uint8_t)d; _h = (uint8_t)h; _mi = (uint8_t)mi; _s = (uint8_t)s;
+  }
+
+  void onFix(uint32_t ms, double lat, double lon, float kmph, float courseDeg, float accLongG, float accLatG) {
+    if (_st == DUMP) return;
+    Fix f;
+    f.ms = ms;
+    f.lat = (int32_t)lround(lat * 1e7);
+    f.lon = (int32_t)lround(lon * 1e7);
+    f.kmph = (uint16_t)(kmph * 100.0f + 0.5f);
+    f.course = (uint16_t)(courseDeg * 100.0f + 0.5f);
+    f.accLong = mg(accLongG);
+    f.accLat = mg(accLatG);
+
+    // 1秒前（以上）の速度
+    float before = -1;
+    for (size_t k = 0; k < _nFix; ++k) {
+      const Fix& p = _fix[(_hFix + FIXES - 1 - k) % FIXES];
+      if (ms - p.ms >= 1000) {
+        if (ms - p.ms < 2000) before = p.kmph * 0.01f;
+        break;
+      }
+    }
+
+    put(_fix, _hFix, _nFix, FIXES, f);
+    if (sqrtf(accLongG * accLongG + accLatG * accLatG) > BB_GPS_G) trigger(R_GPS_G, ms);
+    else if (before >= 0 && before - kmph > BB_DROP_KMH) trigger(R_SPEED_DROP, ms);
+    tick(ms);
+  }
+
+  void onImu(uint32_t ms, float ax, float ay, float az, float gx, float gy, float gz) {
+    if (_st == DUMP) return;
+    Imu s;
+    s.ms = ms;
+    s.acc[0] = mg(ax); s.acc[1] = mg(ay); s.acc[2] = mg(az);
+    s.gyro[0] = dps10(gx); s.gyro[1] = dps10(gy); s.gyro[2] = dps10(gz);
+    put(_imu, _hImu, _nImu, IMUS, s);
+    if (fabsf(sqrtf(ax * ax + ay * ay + az * az) - 1.0f) > BB_IMU_G) trigger(R_IMU, ms);
+    tick(ms);
+  }
+
+  // 手動マーク等。記録中（POST）のきっかけは最初のものを残す
+  void trigger(uint8_t reason, uint32_t ms) {
+    if (_st != ARMED) return;
+    _st = POST;
+    _hdr = Header();
+    _hdr.reason = reason;
+    _hdr.trigMs = ms;
+    _hdr.preMs = PRE_MS;
+    _hdr.postMs = POST_MS;
+    _hdr.year = _y; _hdr.month = _mo; _hdr.day = _d; _hdr.hour = _h; _hdr.minute = _mi; _hdr.second = _s;
+  }
+
+  // 後 POST 秒がたったら凍結（フィックスが途切れても IMU・ループ時刻で進む）
+  void tick(uint32_t ms) {
+    if (_st != POST || ms - _hdr.trigMs < POST_MS) return;
+    _st = DUMP;
+    _fFrom = firstAfter(_fix, _hFix, _nFix, FIXES, _hdr.trigMs - PRE_MS);
+    _iFrom = firstAfter(_imu, _hImu, _nImu, IMUS, _hdr.trigMs - PRE_MS);
+    _hdr.nFix = (uint16_t)(_nFix - _fFrom);
+    _hdr.nImu = (uint16_t)(_nImu - _iFrom);
+    _pos = 0;
+  }
+
+  // 凍結中だけ：out の空き（space()）に入るぶんだけ書く。書き終えたら true（再開）
+  template <class Out>
+  bool pump(Out& out) {
+    if (_st != DUMP) return false;
+    const size_t total = sizeof(Header) + _hdr.nFix * sizeof(Fix) + _hdr.nImu * sizeof(Imu);
+    while (_pos < total) {
+      const uint8_t* p;
+      size_t n;
+      if (_pos < sizeof(Header)) {
+        p = (const uint8_t*)&_hdr + _pos;
+        n = sizeof(Header) - _pos;
+      } else if (_pos < sizeof(Header) + _hdr.nFix * sizeof(Fix)) {
+        size_t k = (_pos - sizeof(Header)) / sizeof(Fix);
+        p = (const uint8_t*)&at(_fix, _hFix, _nFix, FIXES, _fFrom + k);
+        n = sizeof(Fix);
+      } else {
+        size_t k = (_pos - sizeof(Header) - _hdr.nFix * sizeof(Fix)) / sizeof(Imu);
+        p = (const uint8_t*)&at(_imu, _hImu, _nImu, IMUS, _iFrom + k);
+        n = sizeof(Imu);
+      }
+      if (out.space() < n) return false;
+      out.write(p, n);
+      _pos += n;
+    }
+    ++_count;
+    _st = ARMED;
+    return true;
+  }
+
+  // 書き出し先が無い時は捨てて再開
+  void discard() {
+    if (_st == DUMP) _st = ARMED;
+  }
+
+private:
+  Fix    _fix[FIXES];
+  Imu    _imu[IMUS];
+  size_t _hFix = 0, _nFix = 0, _hImu = 0, _nImu = 0;
+  size_t _fFrom = 0, _iFrom = 0, _pos = 0;
+  State  _st = ARMED;
+  Header _hdr;
+  uint32_t _count = 0;
+  uint16_t _y = 0;
+  uint8_t  _mo = 0, _d = 0, _h = 0, _mi = 0, _s = 0;
+
+  template <class T>
+  static void put(T* ring, size_t& head, size_t& n, size_t cap, const T& v) {
+    ring[head] = v;
+    head = (head + 1) % cap;
+    if (n < cap) ++n;
+  }
+
+  // 論理番号 i（0 = 最古）
+  template <class T>
+  static const T& at(const T* ring, size_t head, size_t n, size_t cap, size_t i) {
+    return ring[(head + cap - n + i) % cap];
+  }
+
+  template <class T>
+  static size_t firstAfter(const T* ring, size_t head, size_t n, size_t cap, uint32_t ms) {
+    size_t i = 0;
+    while (i < n && (int32_t)(at(ring, head, n, cap, i).ms - ms) < 0) ++i;
+    return i;
+  }
+
+  static int16_t mg(float g) {
+    float v = g * 1000.0f;
+    return (int16_t)(v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v));
+  }
+  static int16_t dps10(float d) { return mg(d / 100.0f); }
+};
+
+}  // namespace blackbox
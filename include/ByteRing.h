@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* =========================================================
+   単一生産者／単一消費者のロックフリー・バイトリング
+   - 生産者（メインループ）は待たない：入らなければ捨てて dropped を数える
+   - 消費者（書込みタスク）は連続領域を peek → consume
+   - N は 2 の冪
+   ========================================================= */
+template <size_t N>
+class ByteRing {
+  static_assert((N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+  size_t capacity() const { return N; }
+  size_t used() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+  size_t space() const { return N - used(); }
+  uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+  // 全部入るときだけ書く（レコードを途中で切らない）
+  bool write(const void* data, size_t n) {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    uint32_t tail = _tail.load(std::memory_order_acquire);
+    if (N - (head - tail) < n) {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    const uint8_t* src = (const uint8_t*)data;
+    size_t off = head & (N - 1);
+    size_t first = (n < N - off) ? n : N - off;
+    memcpy(_buf + off, src, first);
+    memcpy(_buf, src + first, n - first);
+    _head.store(head + (uint32_t)n, std::memory_order_release);
+    return true;
+  }
+
+  // 読める連続領域（折り返し手前まで）
+  size_t peek(const uint8_t*& p) const {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    uint32_t head = _head.load(std::memory_order_acquire);
+    size_t off = tail & (N - 1);
+    size_t n = head - tail;
+    if (n > N - off) n = N - off;
+    p = _buf + off;
+    return n;
+  }
+
+  void consume(size_t n) {
+    _tail.store(_tail.load(std::memory_order_relaxed) + (uint32_t)n, std::memory_order_release);
+  }
+
+private:
+  uint8_t _buf[N];
+  std::atomic<uint32_t> _head{ 0 };
+  std::atomic<uint32_t> _tail{ 0 };
+  std::atomic<uint32_t> _dropped{ 0 };
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stdint.h>
+
+/* =========================================================
+   UTC ⇔ 現地時刻（暦）変換
+   - days_from_civil / civil_from_days（H. Hinnant のアルゴリズム）
+   - UTCオフセットと夏時間規則は表で持つ（mktime・ヒープ不使用）
+   - すべて constexpr（ホストツールからも使う）
+   ========================================================= */
+
+namespace civil {
+
+struct DateTime {
+  int year = 0, month = 0, day = 0;
+  int hour = 0, minute = 0, second = 0;
+};
+
+// 1970-01-01 からの通算日数（負も可）
+constexpr int32_t daysFromCivil(int y, int m, int d) {
+  y -= (m <= 2) ? 1 : 0;
+  const int32_t era = (y >= 0 ? y : y - 399) / 400;
+  const uint32_t yoe = (uint32_t)(y - era * 400);                              // [0, 399]
+  const uint32_t doy = (153u * (uint32_t)(m + (m > 2 ? -3 : 9)) + 2u) / 5u + (uint32_t)d - 1u; // [0, 365]
+  const uint32_t doe = yoe * 365u + yoe / 4u - yoe / 100u + doy;               // [0, 146096]
+  return era * 146097 + (int32_t)doe - 719468;
+}
+
+constexpr void civilFromDays(int32_t z, int& y, int& m, int& d) {
+  z += 719468;
+  const int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+  const uint32_t doe = (uint32_t)(z - era * 146097);                           // [0, 146096]
+  const uint32_t yoe = (doe - doe / 1460u + doe / 36524u - doe / 146096u) / 365u; // [0, 399]
+  const uint32_t doy = doe - (365u * yoe + yoe / 4u - yoe / 100u);             // [0, 365]
+  const uint32_t mp  = (5u * doy + 2u) / 153u;                                 // [0, 11]
+  d = (int)(doy - (153u * mp + 2u) / 5u + 1u);
+  m = (int)(mp < 10 ? mp + 3 : mp - 9);
+  y = (int)yoe + era * 400 + (m <= 2 ? 1 : 0);
+}
+
+// 0=日 … 6=土
+constexpr int weekdayFromDays(int32_t z) {
+  return (int)(z >= -4 ? (z + 4) % 7 : (z + 5) % 7 + 6);
+}
+
+constexpr int64_t toEpoch(const DateTime& t) {
+  return (int64_t)daysFromCivil(t.year, t.month, t.day) * 86400 +
+         t.hour * 3600 + t.minute * 60 + t.second;
+}
+
+constexpr DateTime fromEpoch(int64_t s) {
+  int32_t days = (int32_t)(s >= 0 ? s / 86400 : (s - 86399) / 86400);
+  int32_t sod  = (int32_t)(s - (int64_t)days * 86400);
+  DateTime t;
+  civilFromDays(days, t.year, t.month, t.day);
+  t.hour   = sod / 3600;
+  t.minute = (sod / 60) % 60;
+  t.second = sod % 60;
+  return t;
+}
+
+/* ---------- 夏時間規則 ----------
+   「month 月の第 week 週（5=最終）の weekday 曜日、minute 分」に切替
+   utc=false の時刻は切替直前の現地時刻（開始は標準時、終了は夏時間） */
+struct Transition {
+  int8_t  month;
+  int8_t  week;
+  int8_t  weekday;
+  int16_t minute;
+  bool    utc;
+};
+
+struct DstRule {
+  const char* name;
+  int16_t     shiftMin;   // 夏時間中の追加オフセット（0 なら夏時間なし）
+  Transition  start;
+  Transition  end;
+};
+
+// TZ_DST_RULE で選ぶ（platformio.ini の build_flags で指定）
+enum : int { DST_NONE = 0, DST_EU = 1, DST_US = 2, DST_AU = 3 };
+
+constexpr DstRule kDstRules[] = {
+  { "none", 0, {  0, 0, 0,   0, true  }, {  0, 0, 0,   0, true  } },
+  // EU: 3月最終日曜 01:00 UTC 〜 10月最終日曜 01:00 UTC
+  { "EU",  60, {  3, 5, 0,  60, true  }, { 10, 5, 0,  60, true  } },
+  // US: 3月第2日曜 02:00 〜 11月第1日曜 02:00
+  { "US",  60, {  3, 2, 0, 120, false }, { 11, 1, 0, 120, false } },
+  // AU(南半球): 10月第1日曜 02:00 〜 4月第1日曜 03:00
+  { "AU",  60, { 10, 1, 0, 120, false }, {  4, 1, 0, 180, false } },
+};
+
+// year 年の切替時刻（UTC epoch）。wallOffsetMin は切替直前の現地オフセット
+constexpr int64_t transitionEpoch(int year, const Transition& tr, int wallOffsetMin) {
+  int32_t day = 0;
+  if (tr.week == 5) {
+    // 最終週：翌月1日から遡る
+    int ny = tr.month == 12 ? year + 1 : year;
+    int nm = tr.month == 12 ? 1 : tr.month + 1;
+    int32_t last = daysFromCivil(ny, nm, 1) - 1;
+    day = last - (weekdayFromDays(last) - tr.weekday + 7) % 7;
+  } else {
+    int32_t first = daysFromCivil(year, tr.month, 1);
+    day = first + (tr.weekday - weekdayFromDays(first) + 7) % 7 + (tr.week - 1) * 7;
+  }
+  return (int64_t)day * 86400 + (int64_t)(tr.minute - (tr.utc ? 0 : wallOffsetMin)) * 60;
+}
+
+struct Zone {
+  int16_t offsetMin;   // 標準時の UTC オフセット（分）
+  int     dstRule;     // kDstRules の添字
+
+  // UTC epoch 時点の有効オフセット（分）
+  constexpr int offsetAt(int64_t utc) const {
+    const DstRule& r = kDstRules[dstRule];
+    if (r.shiftMin == 0) return offsetMin;
+
+    int y = fromEpoch(utc).year;
+    int64_t on  = transitionEpoch(y, r.start, offsetMin);
+    int64_t off = transitionEpoch(y, r.end, offsetMin + r.shiftMin);
+    bool dst = (on < off) ? (utc >= on && utc < off)    // 北半球
+                          : (utc >= on || utc < off);   // 南半球（年を跨ぐ）
+    return offsetMin + (dst ? r.shiftMin : 0);
+  }
+
+  constexpr DateTime toLocal(int64_t utc) const {
+    return fromEpoch(utc + (int64_t)offsetAt(utc) * 60);
+  }
+};
+
+static_assert(daysFromCivil(1970, 1, 1) == 0, "epoch");
+static_assert(daysFromCivil(2000, 3, 1) == 11017, "leap century");
+static_assert(weekdayFromDays(daysFromCivil(2026, 10, 18)) == 0, "2026-10-18 is Sunday");
+static_assert(fromEpoch(toEpoch({ 2026, 10, 31, 20, 0, 0 }) + 9 * 3600).month == 11, "month rollover");
+static_assert(fromEpoch(toEpoch({ 2026, 12, 31, 15, 0, 0 }) + 9 * 3600).year == 2027, "year rollover");
+static_assert(Zone{ 60, DST_EU }.toLocal(toEpoch({ 2026, 3, 29, 0, 59, 0 })).hour == 1, "CET before switch");
+static_assert(Zone{ 60, DST_EU }.toLocal(toEpoch({ 2026, 3, 29, 1, 0, 0 })).hour == 3, "CEST after switch");
+static_assert(Zone{ -300, DST_US }.toLocal(toEpoch({ 2026, 11, 1, 6, 0, 0 })).hour == 1, "EST after fall back");
+
+} // namespace civil
@@ -0,0 +1,234 @@
+#pragma once
+
+/* =========================================================
+   コルーチンの実行器（C++20。ヒープを使わない）
+   - コルーチンのフレームは固定長スロットのプールから取る（CO_FRAME_SIZE × CO_FRAME_SLOTS）
+     入りきらない・空きが無い時は spawn が false（new は呼ばない）
+   - Signal : co_await で notify まで待つ（next_fix / sd_ready など段の区切り）
+   - Executor: 実行可能キューを resume するだけ。誰が回すかは呼び出し側
+       端末 = FreeRTOS タスク（wake フックで xTaskNotifyGive）
+       ホスト = スレッドプール（wake フックで条件変数）
+   - コルーチンが使えないコンパイラ（GCC 8 系の ESP32 ツールチェーン等）では
+     何も定義しない（CO_TASK_AVAILABLE が立たない）
+   ========================================================= */
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <stdint.h>
+
+#define CO_TASK_AVAILABLE 1
+
+#ifndef CO_FRAME_SIZE
+#define CO_FRAME_SIZE 256
+#endif
+#ifndef CO_FRAME_SLOTS
+#define CO_FRAME_SLOTS 8
+#endif
+
+namespace co {
+
+// 短い区間だけの排他（ISR からは呼ばない）
+class SpinLock {
+public:
+  void lock() {
+    while (_f.test_and_set(std::memory_order_acquire)) {}
+  }
+  void unlock() { _f.clear(std::memory_order_release); }
+
+private:
+  std::atomic_flag _f = ATOMIC_FLAG_INIT;
+};
+
+/* ---------- フレームプール ---------- */
+template <size_t SLOT, size_t N>
+class FramePool {
+public:
+  static constexpr size_t SLOT_SIZE = SLOT;
+  static constexpr size_t SLOTS = N;
+
+  FramePool() {
+    for (size_t i = 0; i < N; ++i) _free[i] = (uint16_t)(N - 1 - i);
+    _top = N;
+  }
+
+  void* alloc(size_t n) {
+    if (n > SLOT) return nullptr;
+    _lock.lock();
+    void* p = _top > 0 ? _mem[_free[--_top]] : nullptr;
+    _lock.unlock();
+    return p;
+  }
+
+  void free(void* p) {
+    size_t i = ((unsigned char*)p - &_mem[0][0]) / SLOT;
+    _lock.lock();
+    _free[_top++] = (uint16_t)i;
+    _lock.unlock();
+  }
+
+  size_t used() const { return N - _top; }
+
+private:
+  alignas(alignof(std::max_align_t)) unsigned char _mem[N][SLOT];
+  uint16_t _free[N];
+  size_t   _top;
+  SpinLock _lock;
+};
+
+using Pool = FramePool<CO_FRAME_SIZE, CO_FRAME_SLOTS>;
+
+inline Pool& framePool() {
+  static Pool pool;
+  return pool;
+}
+
+/* ---------- タスク（投げっぱなし。終わったらフレームを返す） ---------- */
+class Task {
+public:
+  struct promise_type {
+    static void* operator new(size_t n) noexcept { return framePool().alloc(n); }
+    static void operator delete(void* p) noexcept { framePool().free(p); }
+    static Task get_return_object_on_allocation_failure() noexcept { return Task(); }
+
+    Task get_return_object() noexcept {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct Final {
+      bool await_ready() noexcept { return false; }
+      void await_suspend(std::coroutine_handle<promise_type> h) noexcept { h.destroy(); }
+      void await_resume() noexcept {}
+    };
+    Final final_suspend() noexcept { return {}; }
+
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+
+  Task() = default;
+  Task(Task&& o) noexcept : _h(o._h) { o._h = nullptr; }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+  ~Task() {
+    if (_h) _h.destroy();
+  }
+
+  explicit operator bool() const { return (bool)_h; }
+
+  std::coroutine_handle<> release() {
+    std::coroutine_handle<> h = _h;
+    _h = nullptr;
+    return h;
+  }
+
+private:
+  explicit Task(std::coroutine_handle<promise_type> h) : _h(h) {}
+  std::coroutine_handle<promise_type> _h;
+};
+
+/* ---------- 実行器 ---------- */
+// 1つのコルーチンがキューに入るのは同時に1回だけ → 容量はスロット数で足りる
+class Executor {
+public:
+  static constexpr size_t CAP = CO_FRAME_SLOTS;
+
+  // post されたら呼ばれる（回す側を起こす）
+  void onWake(void (*fn)(void*), void* ctx) {
+    _wake = fn;
+    _wakeCtx = ctx;
+  }
+
+  bool spawn(Task&& t) {
+    std::coroutine_handle<> h = t.release();
+    if (!h) return false;
+    post(h);
+    return true;
+  }
+
+  void post(std::coroutine_handle<> h) {
+    _lock.lock();
+    _q[_tail++ % CAP] = h;
+    _lock.unlock();
+    if (_wake) _wake(_wakeCtx);
+  }
+
+  // 1つ resume（無ければ false）。複数スレッドから同時に呼んでよい
+  bool runOne() {
+    _lock.lock();
+    if (_head == _tail) {
+      _lock.unlock();
+      return false;
+    }
+    std::coroutine_handle<> h = _q[_head++ % CAP];
+    _lock.unlock();
+    h.resume();
+    return true;
+  }
+
+  // 実行可能なものが無くなるまで
+  size_t run() {
+    size_t n = 0;
+    while (runOne()) ++n;
+    return n;
+  }
+
+private:
+  std::coroutine_handle<> _q[CAP];
+  uint32_t _head = 0, _tail = 0;
+  SpinLock _lock;
+  void (*_wake)(void*) = nullptr;
+  void* _wakeCtx = nullptr;
+};
+
+/* ---------- 待ち合わせ ---------- */
+// 自動リセットのイベント：待っている全員を起こす。誰も待っていない時の notify は
+// 1回ぶん覚えておき、次の co_await は止まらずに進む（別スレッドとの取りこぼし防止）
+class Signal {
+public:
+  explicit Signal(Executor& ex) : _ex(ex) {}
+
+  void notify() {
+    _lock.lock();
+    const int n = _n;
+    std::coroutine_handle<> w[CO_FRAME_SLOTS];
+    for (int i = 0; i < n; ++i) w[i] = _w[i];
+    _n = 0;
+    if (n == 0) _pending = true;
+    _lock.unlock();
+    for (int i = 0; i < n; ++i) _ex.post(w[i]);
+  }
+
+  struct Awaiter {
+    Signal& s;
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h) noexcept {
+      s._lock.lock();
+      if (s._pending) {
+        s._pending = false;
+        s._lock.unlock();
+        return false;   // 止まらずに続行
+      }
+      s._w[s._n++] = h;
+      s._lock.unlock();
+      return true;
+    }
+    void await_resume() const noexcept {}
+  };
+  Awaiter operator co_await() noexcept { return Awaiter{ *this }; }
+
+private:
+  Executor& _ex;
+  std::coroutine_handle<> _w[CO_FRAME_SLOTS];
+  int _n = 0;
+  bool _pending = false;
+  SpinLock _lock;
+};
+
+}  // namespace co
+
+#endif
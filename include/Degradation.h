@@ -0,0 +1,156 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+/* =========================================================
+   タイヤのたれ（スティント内のラップタイムの傾き）
+   - 有効なラップだけで「ラップタイム = a + b × スティント内の周回数」を重み付き最小二乗。
+     b がたれ（s/周）、a + b × (今の周 + N) が N 周先の予想
+   - 重みは計時の不確かさ（LapRecord::sigma）から 1 / (σ² + SIGMA0²)。手押しの周は軽くなる
+   - 外れの除外（直線の予想とは比べない：1周の外れで傾きが狂うと以後ずっと捨て続けるため）
+       引っかかり : 直近3周（今の周を含む）の中央値から max(REJECT_PCT, REJECT_K × 残差σ)
+                    以上離れた周。幅は REJECT_MAX_PCT まで。捨てた周は中央値に置き換えて次の判定に使う
+                    （Hampel フィルタ。引っかかりが2周続いても次の周を引きずらない）。
+                    スティントの最初の2周は3周目が来た時に同じ基準で決める
+       条件の変化 : REJECT_RUN 周続けて捨てたら（雨など）、そこから新しいスティント
+       入り周     : 直前2周の速い方の PIT_FACTOR 倍以上遅い周。次の周（出周）も捨て、
+                    そこから新しいスティント
+   - 1周ごとに onLap()。持つのは和が 6 個と直近2周・保留2周だけ（ログは読み直さない）
+   ========================================================= */
+
+#ifndef DEGRADE_AHEAD
+#define DEGRADE_AHEAD 5   // 何周先の予想を出すか
+#endif
+
+class DegradeTrend {
+public:
+  static constexpr int   MIN_LAPS = 3;          // 傾きを出す最少の有効周
+  static constexpr float REJECT_PCT = 0.01f;
+  static constexpr float REJECT_MAX_PCT = 0.03f;
+  static constexpr float REJECT_K = 2.5f;
+  static constexpr float PIT_FACTOR = 1.25f;
+  static constexpr float SIGMA0 = 0.05f;        // 重みの床（s）
+  static constexpr int   REJECT_RUN = 3;
+
+  enum Verdict : uint8_t { USED, PENDING, OUTLIER, IN_LAP, OUT_LAP };
+
+  void reset() { *this = DegradeTrend(); }
+
+  Verdict onLap(float lapS, float sigmaS) {
+    if (lapS <= 0) return OUTLIER;
+    ++_x;
+    if (_outLap) {
+      _outLap = false;
+      return OUT_LAP;
+    }
+    if (_nr > 0 && lapS > PIT_FACTOR * fastest()) return newStint(true);
+
+    const float w = 1.0f / (sigmaS * sigmaS + SIGMA0 * SIGMA0);
+    if (_nr < 2) {                 // 中央値が取れるまで保留
+      _held[_nr] = Sample{ (float)_x, lapS, w };
+      push(lapS);
+      return PENDING;
+    }
+
+    const float m = median3(_r[0], _r[1], lapS);
+    if (_nHeld) {
+      for (int i = 0; i < _nHeld; ++i) {
+        if (accept(_held[i].y, m)) add(_held[i].x, _held[i].y, _held[i].w);
+      }
+      _nHeld = 0;
+    }
+    if (!accept(lapS, m)) {
+      push(m);
+      if (++_run >= REJECT_RUN) newStint(false);
+      return OUTLIER;
+    }
+    push(lapS);
+    _run = 0;
+    add((float)_x, lapS, w);
+    return USED;
+  }
+
+  bool  valid() const { return _n >= MIN_LAPS; }
+  int   stint() const { return _stint; }
+  int   lapInStint() const { return _x; }
+  int   used() const { return _n; }
+  float slope() const { return _n >= 2 ? (float)(cxy() / cxx()) : 0.0f; }           // s/周（+ がたれ）
+  float ahead(int laps = DEGRADE_AHEAD) const { return predict((float)(_x + laps)); } // N 周先の予想
+
+  // 残差の標準偏差（重み付き。有効周 3 以上）
+  float residualSd() const {
+    if (_n < 3) return 0;
+    const double sse = cyy() - cxy() * cxy() / cxx();
+    return sse > 0 ? (float)sqrt(sse / _sw * _n / (_n - 2)) : 0.0f;
+  }
+
+private:
+  struct Sample {
+    float x, y, w;
+  };
+
+  int    _stint = 1, _x = 0, _n = 0, _run = 0;
+  bool   _outLap = false;
+  float  _r[2] = { 0, 0 };      // 直近2周（捨てた周は中央値で）
+  int    _nr = 0;
+  Sample _held[2];              // スティントの最初の2周（判定待ち）
+  int    _nHeld = 2;
+  // Σw, Σwx, Σwy, Σwxx, Σwxy, Σwyy（y は最初の有効周との差）
+  double _sw = 0, _sx = 0, _sy = 0, _sxx = 0, _sxy = 0, _syy = 0;
+  float  _y0 = 0;
+
+  void push(float y) {
+    if (_nr < 2) {
+      _r[_nr++] = y;
+    } else {
+      _r[0] = _r[1];
+      _r[1] = y;
+    }
+  }
+
+  float fastest() const { return (_nr > 1 && _r[1] < _r[0]) ? _r[1] : _r[0]; }
+
+  static float median3(float a, float b, float c) {
+    if (a > b) { const float t = a; a = b; b = t; }
+    if (b > c) b = c;
+    return a > b ? a : b;
+  }
+
+  bool accept(float y, float m) const {
+    float tol = REJECT_K * residualSd();
+    if (tol < m * REJECT_PCT) tol = m * REJECT_PCT;
+    if (tol > m * REJECT_MAX_PCT) tol = m * REJECT_MAX_PCT;
+    return fabsf(y - m) <= tol;
+  }
+
+  void add(float x, float y, float w) {
+    if (_n == 0) _y0 = y;
+    const double d = y - _y0;
+    _sw += w;
+    _sx += w * x;
+    _sy += w * d;
+    _sxx += w * x * x;
+    _sxy += w * x * d;
+    _syy += w * d * d;
+    ++_n;
+  }
+
+  double cxx() const { return _sxx - _sx * _sx / _sw; }
+  double cxy() const { return _sxy - _sx * _sy / _sw; }
+  double cyy() const { return _syy - _sy * _sy / _sw; }
+
+  float predict(float x) const {
+    if (_n == 0) return 0.0f;
+    const double mx = _sx / _sw, my = _sy / _sw;
+    return _y0 + (float)(my + (_n >= 2 ? cxy() / cxx() : 0.0) * (x - mx));
+  }
+
+  Verdict newStint(bool pit) {
+    const int s = _stint + 1;
+    reset();
+    _stint = s;
+    _outLap = pit;
+    return IN_LAP;
+  }
+};
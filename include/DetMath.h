@@ -0,0 +1,78 @@
+#pragma once
+
+/* =========================================================
+   環境非依存の sin / cos
+   - libm の実装差（newlib / glibc）で結果が 1ulp ずれるのを避ける
+   - 四則演算だけで組むので -ffp-contract=off なら端末とホストで同一ビット
+   - 精度は |x| < 1e5 で double の数 ulp 程度（コース規模の用途には十分）
+   ========================================================= */
+
+namespace det {
+
+namespace detail {
+
+// |r| <= π/4 のカーネル（テイラー展開）
+inline double sinKernel(double r) {
+  double r2 = r * r;
+  double p = -1.0 / 1307674368000.0;   // 1/15!
+  p = p * r2 + 1.0 / 6227020800.0;     // 1/13!
+  p = p * r2 - 1.0 / 39916800.0;       // 1/11!
+  p = p * r2 + 1.0 / 362880.0;         // 1/9!
+  p = p * r2 - 1.0 / 5040.0;           // 1/7!
+  p = p * r2 + 1.0 / 120.0;            // 1/5!
+  p = p * r2 - 1.0 / 6.0;              // 1/3!
+  return r + r * r2 * p;
+}
+
+inline double cosKernel(double r) {
+  double r2 = r * r;
+  double p = -1.0 / 20922789888000.0;  // 1/16!
+  p = p * r2 + 1.0 / 87178291200.0;    // 1/14!
+  p = p * r2 - 1.0 / 479001600.0;      // 1/12!
+  p = p * r2 + 1.0 / 3628800.0;        // 1/10!
+  p = p * r2 - 1.0 / 40320.0;          // 1/8!
+  p = p * r2 + 1.0 / 720.0;            // 1/6!
+  p = p * r2 - 1.0 / 24.0;             // 1/4!
+  p = p * r2 + 0.5;                    // 1/2!
+  return 1.0 - r2 * p;
+}
+
+// x = k·π/2 + r に分解（Cody-Waite）
+inline long reduce(double x, double& r) {
+  const double TWO_OVER_PI = 0.63661977236758134308;
+  const double PIO2_HI = 1.57079632673412561417e+00;
+  const double PIO2_LO = 6.07710050650619224932e-11;
+  double fk = x * TWO_OVER_PI;
+  long k = (long)(fk >= 0.0 ? fk + 0.5 : fk - 0.5);
+  r = (x - (double)k * PIO2_HI) - (double)k * PIO2_LO;
+  return k;
+}
+
+} // namespace detail
+
+inline double sin(double x) {
+  double r;
+  long k = detail::reduce(x, r);
+  switch (k & 3) {
+    case 0:  return  detail::sinKernel(r);
+    case 1:  return  detail::cosKernel(r);
+    case 2:  return -detail::sinKernel(r);
+    default: return -detail::cosKernel(r);
+  }
+}
+
+inline double cos(double x) {
+  double r;
+  long k = detail::reduce(x, r);
+  switch (k & 3) {
+    case 0:  return  detail::cosKernel(r);
+    case 1:  return -detail::sinKernel(r);
+    case 2:  return -detail::cosKernel(r);
+    default: return  detail::sinKernel(r);
+  }
+}
+
+inline float sinf(float x) { return (float)sin((double)x); }
+inline float cosf(float x) { return (float)cos((double)x); }
+
+} // namespace det
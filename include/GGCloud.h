@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+
+/* =========================================================
+   G-G 図（摩擦円）の点群：固定長リングで古い点ほど暗く、最後は消える
+   - 点は N 個まで。年齢 = 何サンプル前か（フィックス周期一定なら時間と同じ）
+   - 明るさは LEVELS 段。年齢が N/LEVELS の倍数になった点だけ段が変わる
+   - 1サンプルで描き直すのは「新しい点1・段が変わる点 LEVELS-1・消える点1」
+     ＋消した所に重なっていた点の描き直しだけ。全体の描き直しは無い
+   - 描画は呼び出し側の Draw（dot(x, y, level) / erase(x, y)）。点は 3×3 px
+   ========================================================= */
+template <int N, int LEVELS = 4>
+class GGCloud {
+public:
+  static_assert(N % LEVELS == 0, "N must be a multiple of LEVELS");
+
+  void reset() { _head = _count = 0; }
+  int  count() const { return _count; }
+
+  template <class Draw>
+  void push(int16_t x, int16_t y, Draw& d) {
+    // 最古の点を消し、重なっていた点を描き直す
+    if (_count == N) {
+      const Dot old = _dot[_head];
+      --_count;
+      d.erase(old.x, old.y);
+      for (int age = 0; age < _count; ++age) {
+        const Dot& p = at(age);   // push 後は age + 1 になる
+        if (p.x - old.x < 3 && old.x - p.x < 3 && p.y - old.y < 3 && old.y - p.y < 3)
+          d.dot(p.x, p.y, level(age + 1));
+      }
+    }
+
+    _dot[_head] = Dot{ x, y };
+    _head = (_head + 1) % N;
+    ++_count;
+
+    // 段の境目に来た点を暗くする
+    for (int l = 1; l < LEVELS; ++l) {
+      const int age = l * (N / LEVELS);
+      if (age < _count) {
+        const Dot& p = at(age);
+        d.dot(p.x, p.y, l);
+      }
+    }
+    d.dot(x, y, 0);
+  }
+
+private:
+  struct Dot {
+    int16_t x, y;
+  };
+
+  Dot _dot[N];
+  int _head = 0;    // 次に書く位置
+  int _count = 0;
+
+  // 年齢 age（0 = 最新）の点
+  const Dot& at(int age) const { return _dot[(_head - 1 - age + 2 * N) % N]; }
+  static int level(int age) { return age * LEVELS / N; }
+};
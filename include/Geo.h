@@ -0,0 +1,62 @@
+#pragma once
+
+#include <math.h>
+
+#include "DetMath.h"
+
+/* =========================================================
+   平面近似の座標ヘルパ（コース規模なら正距円筒で十分）
+   - LocalFrame : 原点まわりの東(x)/北(y) メートル座標
+   - segmentCross : 移動区間と判定線の交差（区間内の位置 t を返す）
+   ========================================================= */
+
+namespace geo {
+
+struct Vec2 {
+  float x = 0.0f, y = 0.0f;
+};
+
+inline Vec2  operator-(Vec2 a, Vec2 b) { return { a.x - b.x, a.y - b.y }; }
+inline Vec2  operator+(Vec2 a, Vec2 b) { return { a.x + b.x, a.y + b.y }; }
+inline Vec2  operator*(Vec2 a, float k) { return { a.x * k, a.y * k }; }
+inline float dot(Vec2 a, Vec2 b)   { return a.x * b.x + a.y * b.y; }
+inline float cross(Vec2 a, Vec2 b) { return a.x * b.y - a.y * b.x; }
+inline float length(Vec2 a)        { return sqrtf(dot(a, a)); }
+
+struct LocalFrame {
+  double lat0 = 0.0, lon0 = 0.0;
+  double mPerDegLat = 111320.0, mPerDegLon = 111320.0;
+
+  void setOrigin(double lat, double lon) {
+    lat0 = lat;
+    lon0 = lon;
+    // 端末とホストで同一ビットになるよう det::cos を使う
+    mPerDegLat = 111132.954 - 559.822 * det::cos(2.0 * lat * 0.017453292519943295);
+    mPerDegLon = 111319.488 * det::cos(lat * 0.017453292519943295);
+  }
+
+  Vec2 toXY(double lat, double lon) const {
+    return { (float)((lon - lon0) * mPerDegLon), (float)((lat - lat0) * mPerDegLat) };
+  }
+
+  void toLatLon(Vec2 p, double& lat, double& lon) const {
+    lat = lat0 + p.y / mPerDegLat;
+    lon = lon0 + p.x / mPerDegLon;
+  }
+};
+
+// 区間 p0→p1 が 線分 q0-q1 を横切るか。横切るなら t∈[0,1]（p0からの割合）
+inline bool segmentCross(Vec2 p0, Vec2 p1, Vec2 q0, Vec2 q1, float& t) {
+  Vec2 r = p1 - p0;
+  Vec2 s = q1 - q0;
+  float den = cross(r, s);
+  if (den == 0.0f) return false; // 平行
+  Vec2 qp = q0 - p0;
+  float tp = cross(qp, s) / den;
+  float tq = cross(qp, r) / den;
+  if (tp < 0.0f || tp > 1.0f || tq < 0.0f || tq > 1.0f) return false;
+  t = tp;
+  return true;
+}
+
+} // namespace geo
@@ -0,0 +1,357 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* =========================================================
+   GNSS ウォームスタート補助（起動直後に前回の位置・時刻を受信機へ渡す）
+   - 保存するもの : 最後の位置・高度・UTC（State, aid.bin）
+                    u-blox なら航法データ（MGA-DBD の吐き出し, aid_dbd.bin）
+   - 起動時に送るもの
+       UBX  : MGA-INI-POS_LLH ＋ MGA-INI-TIME_UTC（時刻は RTC がある時だけ）＋ MGA-DBD
+       PMTK : PMTK741（位置＋時刻。時刻が無いと受け付けないので RTC がある時だけ）
+   - TTFF（起動から最初の有効フィックスまで）は Ttff で測る
+   - 起動・保存・吐き出しの手順（Assist）ごと端末と tools/fake_gnss で同じものを使う
+   ========================================================= */
+
+#ifndef GNSS_AID
+#define GNSS_AID 1   // 0 = 補助しない, 1 = UBX (u-blox M8/M9/M10), 2 = PMTK (MediaTek)
+#endif
+
+// 停車中に位置・時刻（と航法データ）を保存する間隔
+#ifndef AID_SAVE_MS
+#define AID_SAVE_MS (10UL * 60 * 1000)
+#endif
+
+namespace gnssaid {
+
+enum Proto : uint8_t { PROTO_NONE = 0, PROTO_UBX = 1, PROTO_PMTK = 2 };
+
+struct DateTime {
+  uint16_t year;
+  uint8_t  month, day, hour, minute, second;
+};
+
+/* ---------- 保存する状態（aid.bin） ---------- */
+struct State {
+  static constexpr uint32_t MAGIC = 0x31444941;  // "AID1"
+
+  uint32_t magic = MAGIC;
+  double   lat = 0, lon = 0;
+  float    altM = 0;
+  DateTime utc = {};
+  uint32_t check = 0;   // ここより前の FNV-1a
+
+  void seal() { check = fnv(this, offsetof(State, check)); }
+  bool valid() const {
+    return magic == MAGIC && check == fnv(this, offsetof(State, check)) && utc.year >= 2000;
+  }
+
+  static uint32_t fnv(const void* p, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i) h = (h ^ ((const uint8_t*)p)[i]) * 16777619u;
+    return h;
+  }
+};
+
+/* ---------- UBX ---------- */
+static constexpr uint8_t UBX_MGA = 0x13;
+static constexpr uint8_t UBX_MGA_INI = 0x40;
+static constexpr uint8_t UBX_MGA_DBD = 0x80;
+static constexpr size_t  UBX_MAX_PAYLOAD = 256;   // MGA-DBD は 1件 164 B まで
+
+inline void put16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+inline void put32(uint8_t* p, uint32_t v) { put16(p, (uint16_t)v); put16(p + 2, (uint16_t)(v >> 16)); }
+
+// 同期文字・クラス・ID・長さ・ペイロード・Fletcher チェックサム
+inline size_t ubxFrame(uint8_t* out, uint8_t cls, uint8_t id, const uint8_t* payload, uint16_t len) {
+  out[0] = 0xB5;
+  out[1] = 0x62;
+  out[2] = cls;
+  out[3] = id;
+  put16(out + 4, len);
+  if (len) memcpy(out + 6, payload, len);
+  uint8_t a = 0, b = 0;
+  for (size_t i = 2; i < 6u + len; ++i) {
+    a += out[i];
+    b += a;
+  }
+  out[6 + len] = a;
+  out[7 + len] = b;
+  return 8u + len;
+}
+
+// MGA-INI-POS_LLH（posAcc は cm）
+inline size_t ubxIniPos(uint8_t* out, double lat, double lon, float altM, uint32_t accCm) {
+  uint8_t p[20] = { 0x01, 0x00 };
+  put32(p + 4, (uint32_t)(int32_t)(lat * 1e7 + (lat >= 0 ? 0.5 : -0.5)));
+  put32(p + 8, (uint32_t)(int32_t)(lon * 1e7 + (lon >= 0 ? 0.5 : -0.5)));
+  put32(p + 12, (uint32_t)(int32_t)(altM * 100.0f));
+  put32(p + 16, accCm);
+  return ubxFrame(out, UBX_MGA, UBX_MGA_INI, p, sizeof(p));
+}
+
+// MGA-INI-TIME_UTC（受信時点の時刻。閏秒は不明扱い）
+inline size_t ubxIniTime(uint8_t* out, const DateTime& t, uint16_t accS) {
+  uint8_t p[24] = { 0x10, 0x00, 0x00, 0x80 };
+  put16(p + 4, t.year);
+  p[6] = t.month;
+  p[7] = t.day;
+  p[8] = t.hour;
+  p[9] = t.minute;
+  p[10] = t.second;
+  put16(p + 16, accS);
+  return ubxFrame(out, UBX_MGA, UBX_MGA_INI, p, sizeof(p));
+}
+
+// MGA-DBD の吐き出し要求（受信機は MGA-DBD を何件も返す）
+inline size_t ubxDbdPoll(uint8_t* out) { return ubxFrame(out, UBX_MGA, UBX_MGA_DBD, nullptr, 0); }
+
+// UART のバイト列から UBX フレームを拾う（NMEA と混ざっていてよい）
+class UbxScanner {
+public:
+  // フレームが1つ揃ったら true（frame() / size() で取り出す）
+  bool feed(uint8_t c) {
+    switch (_st) {
+      case 0: if (c == 0xB5) { _buf[0] = c; _st = 1; } return false;
+      case 1: if (c == 0x62) { _buf[1] = c; _n = 2; _st = 2; } else _st = (c == 0xB5); return false;
+    }
+    _buf[_n++] = c;
+    if (_n == 6) {
+      _len = (uint16_t)(_buf[4] | (_buf[5] << 8));
+      if (_len > UBX_MAX_PAYLOAD) _st = 0;
+      return false;
+    }
+    if (_n < 6 || _n < 8u + _len) return false;
+
+    _st = 0;
+    uint8_t a = 0, b = 0;
+    for (size_t i = 2; i < 6u + _len; ++i) {
+      a += _buf[i];
+      b += a;
+    }
+    return a == _buf[6 + _len] && b == _buf[7 + _len];
+  }
+
+  const uint8_t* frame() const { return _buf; }
+  size_t size() const { return 8u + _len; }
+  uint8_t cls() const { return _buf[2]; }
+  uint8_t id() const { return _buf[3]; }
+  const uint8_t* payload() const { return _buf + 6; }
+  uint16_t payloadLen() const { return _len; }
+
+private:
+  uint8_t  _buf[8 + UBX_MAX_PAYLOAD];
+  size_t   _n = 0;
+  uint16_t _len = 0;
+  uint8_t  _st = 0;
+};
+
+/* ---------- PMTK ---------- */
+// $PMTK741,lat,lon,alt,YYYY,MM,DD,hh,mm,ss*CS
+inline size_t pmtkAid(char* out, size_t n, const State& s, const DateTime& t) {
+  char body[96];
+  snprintf(body, sizeof(body), "PMTK741,%.6f,%.6f,%d,%04u,%02u,%02u,%02u,%02u,%02u",
+           s.lat, s.lon, (int)s.altM, t.year, t.month, t.day, t.hour, t.minute, t.second);
+  uint8_t cs = 0;
+  for (const char* p = body; *p; ++p) cs ^= (uint8_t)*p;
+  int w = snprintf(out, n, "$%s*%02X\r\n", body, cs);
+  return (w > 0 && (size_t)w < n) ? (size_t)w : 0;
+}
+
+/* ---------- 起動時に送るもの（DBD は別途ファイルからそのまま送る） ---------- */
+// now = RTC の現在 UTC（無ければ nullptr）。戻り値 = out に書いたバイト数
+//   補助の種類は what に ("pos" / "pos+time" / "")
+inline size_t bootMessages(Proto proto, const State& s, const DateTime* now,
+                           uint8_t* out, size_t cap, const char** what) {
+  *what = "";
+  if (!s.valid() || cap < 96) return 0;
+  size_t n = 0;
+  if (proto == PROTO_UBX) {
+    n += ubxIniPos(out, s.lat, s.lon, s.altM, 10000);   // 停車位置 ±100 m
+    *what = "pos";
+    if (now) {
+      n += ubxIniTime(out + n, *now, 2);
+      *what = "pos+time";
+    }
+  } else if (proto == PROTO_PMTK && now) {
+    n = pmtkAid((char*)out, cap, s, *now);
+    if (n) *what = "pos+time";
+  }
+  return n;
+}
+
+/* ---------- TTFF ---------- */
+class Ttff {
+public:
+  void start(uint32_t ms) {
+    _t0 = ms;
+    _done = false;
+  }
+  // 有効フィックスを見たら呼ぶ。最初の1回だけ true
+  bool onFix(uint32_t ms) {
+    if (_done) return false;
+    _done = true;
+    _ms = ms - _t0;
+    return true;
+  }
+  bool done() const { return _done; }
+  uint32_t ms() const { return _ms; }
+
+private:
+  uint32_t _t0 = 0, _ms = 0;
+  bool _done = false;
+};
+
+/* ---------- 端末の手順 ----------
+   - boot() : 起動時。aid.bin の位置（＋RTC があれば時刻）と、u-blox なら aid_dbd.bin の航法データを送る
+   - onRx() : UART から読んだバイト。吐き出し中は MGA-DBD を拾ってそのまま一時ファイルへ
+   - poll() : ループごと。最初のフィックスで true（TTFF が決まった）。
+              停車中は AID_SAVE_MS ごとに位置・時刻を保存し、RTC を合わせ、u-blox なら航法データを
+              DBD_CAPTURE_MS だけ吐き出させて保存（一時ファイル → 置換え）
+   部品（端末は HardwareSerial / Storage / M5 の RTC、fake_gnss は偽物）
+     Serial : write(const uint8_t*, size_t)
+     Store  : openCache(path) / createCache(path) → Store::File、replaceCache(tmp, path)
+              （File は read / write / close / bool、既定構築で「開いていない」）
+     Clock  : millis() / delayMs(ms) / rtcGet(DateTime&)（無ければ false） / rtcSet(const DateTime&)
+*/
+template <class Serial, class Store, class Clock>
+class Assist {
+public:
+  using File = typename Store::File;
+  static constexpr uint32_t DBD_CAPTURE_MS = 3000;
+  static constexpr uint32_t DBD_PACE_MS = 2;   // 航法データ1件ごとの間（受信機の取込みが追いつくように）
+
+  Assist(Proto proto, Serial& serial, Store& store, Clock& clock, const char* aidPath, const char* dbdPath)
+    : _proto(proto), _serial(serial), _store(store), _clock(clock), _aidPath(aidPath), _dbdPath(dbdPath) {}
+
+  void boot() {
+    _ttff.start(0);   // 受信機と同時に電源が入るので起動時刻から数える
+    if (_proto == PROTO_NONE) return;
+
+    State s;
+    File f = _store.openCache(_aidPath);
+    if (!f) return;
+    const bool ok = f.read((uint8_t*)&s, sizeof(s)) == sizeof(s);
+    f.close();
+    if (!ok) return;
+
+    DateTime now;
+    const bool haveNow = _clock.rtcGet(now);
+    uint8_t buf[128];
+    const char* what;
+    const size_t n = bootMessages(_proto, s, haveNow ? &now : nullptr, buf, sizeof(buf), &what);
+    if (n == 0) return;
+    _serial.write(buf, n);
+    snprintf(_what, sizeof(_what), "%s", what);
+    if (_proto == PROTO_UBX && sendDbd() > 0) snprintf(_what, sizeof(_what), "%s+dbd", what);
+  }
+
+  void onRx(const uint8_t* buf, size_t n) {
+    if (!_dbd) return;
+    for (size_t i = 0; i < n; ++i) {
+      if (_scan.feed(buf[i]) && _scan.cls() == UBX_MGA && _scan.id() == UBX_MGA_DBD) {
+        _dbd.write(_scan.frame(), _scan.size());
+        ++_dbdCount;
+      }
+    }
+  }
+
+  // g: location / altitude / date / time / fixCount を持つもの（GpsData）
+  template <class Gps>
+  bool poll(const Gps& g, bool idle) {
+    const uint32_t now = _clock.millis();
+    bool first = false;
+    if (!_ttff.done()) {
+      if (g.fixCount() == 0) return false;
+      _ttff.onFix(now);
+      first = true;
+    }
+
+    if (_dbd && now - _dbdStartMs >= DBD_CAPTURE_MS) {
+      _dbd.close();
+      _dbd = File();
+      if (_dbdCount > 0) _store.replaceCache(DBD_TMP, _dbdPath);
+    }
+
+    // 停車中だけ（フラッシュへの書込みで走行中のループを止めない）
+    if (idle && (!_saved || now - _savedMs >= AID_SAVE_MS)) {
+      _saved = true;
+      _savedMs = now;
+      save(g, now);
+    }
+    return first;
+  }
+
+  const Ttff& ttff() const { return _ttff; }
+  const char* what() const { return _what; }        // 起動時に送った補助（"none" / "pos" / "pos+time" / …+dbd）
+  bool        capturing() const { return (bool)_dbd; }
+  int         dbdFrames() const { return _dbdCount; }
+
+private:
+  static constexpr const char* AID_TMP = "/aid.tmp";
+  static constexpr const char* DBD_TMP = "/aid_dbd.tmp";
+
+  Proto       _proto;
+  Serial&     _serial;
+  Store&      _store;
+  Clock&      _clock;
+  const char* _aidPath;
+  const char* _dbdPath;
+
+  Ttff       _ttff;
+  char       _what[16] = "none";
+  bool       _saved = false;
+  uint32_t   _savedMs = 0;
+  File       _dbd;
+  UbxScanner _scan;
+  uint32_t   _dbdStartMs = 0;
+  int        _dbdCount = 0;
+
+  // 保存してある MGA-DBD を1件ずつ送る。送った件数
+  int sendDbd() {
+    File f = _store.openCache(_dbdPath);
+    if (!f) return 0;
+    uint8_t msg[8 + UBX_MAX_PAYLOAD];
+    int sent = 0;
+    while (f.read(msg, 6) == 6) {
+      const size_t len = msg[4] | (msg[5] << 8);
+      if (len > UBX_MAX_PAYLOAD || f.read(msg + 6, len + 2) != len + 2) break;
+      _serial.write(msg, len + 8);
+      ++sent;
+      _clock.delayMs(DBD_PACE_MS);
+    }
+    f.close();
+    return sent;
+  }
+
+  template <class Gps>
+  void save(const Gps& g, uint32_t now) {
+    State s;
+    s.lat = g.location.lat();
+    s.lon = g.location.lng();
+    s.altM = (float)g.altitude.meters();
+    s.utc = { (uint16_t)g.date.year(), (uint8_t)g.date.month(), (uint8_t)g.date.day(),
+              (uint8_t)g.time.hour(), (uint8_t)g.time.minute(), (uint8_t)g.time.second() };
+    s.seal();
+
+    File f = _store.createCache(AID_TMP);
+    if (!f) return;
+    const bool ok = f.write((const uint8_t*)&s, sizeof(s)) == sizeof(s);
+    f.close();
+    if (ok) _store.replaceCache(AID_TMP, _aidPath);
+    _clock.rtcSet(s.utc);
+
+    if (_proto != PROTO_UBX || _dbd) return;
+    _dbd = _store.createCache(DBD_TMP);
+    if (!_dbd) return;
+    uint8_t poll[8];
+    _serial.write(poll, ubxDbdPoll(poll));
+    _dbdStartMs = now;
+    _dbdCount = 0;
+  }
+};
+
+}  // namespace gnssaid
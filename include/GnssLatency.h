@@ -0,0 +1,259 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* =========================================================
+   GNSS の遅延とフィックス間隔のゆらぎ
+   - 1エポック（同じ UTC を持つセンテンス群）ごとに端末の時刻(μs)を4点取る
+       先頭 : 新しい UTC を持つ最初のセンテンス（RMC/GGA/GNS/ZDA）の '$' を読んだ時
+       末尾 : 次のエポックが始まる前の最後の '\n' を読んだ時
+       確定 : フィックスが確定した時（fixCount が増えた時）
+       消費 : その後 LapEngine::step に渡った時
+   - エポックの UTC は PPS（あれば）で端末の時刻に直す。PPS が無ければ UTC 起点の段は出さない
+     （端末とGNSSの時計のずれが分からないため。間隔のゆらぎは UTC の差だけで出せる）
+   - 時刻は「ループが読んだ時」。UART の FIFO で待った分は UTC→先頭 に入る
+   - 段ごとに分布を持つ（固定幅ヒストグラム＋平均・標準偏差・最小・最大。固定メモリ）
+   ========================================================= */
+
+namespace gnsslat {
+
+// 分布：lo から bin 刻みで BINS 個（範囲外は両端のビンに入れる）
+class Dist {
+public:
+  static constexpr int BINS = 200;
+
+  void setRange(int32_t loUs, int32_t binUs) {
+    _lo = loUs;
+    _bin = binUs;
+    clear();
+  }
+  void clear() {
+    memset(_h, 0, sizeof(_h));
+    _n = 0;
+    _sum = _sq = 0;
+    _min = INT32_MAX;
+    _max = INT32_MIN;
+  }
+
+  void add(int32_t us) {
+    int32_t v = us - _lo;
+    int b = v < 0 ? 0 : (int)(v / _bin);
+    if (b >= BINS) b = BINS - 1;
+    ++_h[b];
+    ++_n;
+    _sum += us;
+    _sq += (int64_t)us * us;
+    if (us < _min) _min = us;
+    if (us > _max) _max = us;
+  }
+
+  uint32_t count() const { return _n; }
+  float meanMs() const { return _n ? (float)((double)_sum / _n / 1000.0) : 0; }
+  float sdMs() const {
+    if (_n < 2) return 0;
+    double m = (double)_sum / _n;
+    double v = (double)_sq / _n - m * m;
+    return v > 0 ? (float)(sqrt(v) / 1000.0) : 0;
+  }
+  float minMs() const { return _n ? _min / 1000.0f : 0; }
+  float maxMs() const { return _n ? _max / 1000.0f : 0; }
+
+  // p（0〜1）分位点。ビンの上端で返す（最小・最大を越えない）
+  float pctMs(float p) const {
+    if (_n == 0) return 0;
+    uint32_t want = (uint32_t)ceilf(p * _n), acc = 0;
+    if (want < 1) want = 1;
+    for (int b = 0; b < BINS; ++b) {
+      acc += _h[b];
+      if (acc >= want) {
+        int32_t edge = _lo + (b + 1) * _bin;
+        if (edge > _max) edge = _max;
+        if (edge < _min) edge = _min;
+        return edge / 1000.0f;
+      }
+    }
+    return maxMs();
+  }
+
+private:
+  uint32_t _h[BINS];
+  uint32_t _n = 0;
+  int64_t  _sum = 0, _sq = 0;
+  int32_t  _min = INT32_MAX, _max = INT32_MIN;
+  int32_t  _lo = 0, _bin = 1000;
+};
+
+class Meter {
+public:
+  enum Stage { OUT, PARSE, LOOP, TOTAL, BURST, INTERVAL, STAGES };
+
+  static const char* name(int s) {
+    static const char* const n[] = { "utc>first", "first>fix", "fix>step", "utc>step", "first>last", "interval" };
+    return s >= 0 && s < STAGES ? n[s] : "?";
+  }
+
+  Meter() {
+    for (int s = 0; s < STAGES; ++s) _d[s].setRange(0, 2000);   // 0〜400 ms, 2 ms 刻み
+    _d[INTERVAL].setRange(-100000, 1000);                        // ±100 ms, 1 ms 刻み
+  }
+
+  void clear() {
+    for (int s = 0; s < STAGES; ++s) _d[s].clear();
+    _epochs = 0;
+  }
+
+  const Dist& dist(int s) const { return _d[s]; }
+  uint32_t epochs() const { return _epochs; }
+  bool pps() const { return _d[OUT].count() > 0; }
+
+  // 補正に使う平均遅延（UTC → 消費。PPS が無ければ -1）
+  float meanLatencyMs() const { return _d[TOTAL].count() ? _d[TOTAL].meanMs() : -1.0f; }
+
+  void onPps(uint64_t us) { _ppsUs = us; }
+
+  // UART から読んだバイト列（us = 読んだ時刻）
+  void onBytes(uint64_t us, const uint8_t* d, size_t n) {
+    for (size_t i = 0; i < n; ++i) scan(us, (char)d[i]);
+  }
+
+  void onCommit(uint64_t us) {
+    if (_cur.first == 0 || _cur.commit != 0) return;
+    _cur.commit = us;
+    _d[PARSE].add((int32_t)(us - _cur.first));
+  }
+
+  void onConsume(uint64_t us) {
+    if (_cur.commit == 0 || _cur.consume != 0) return;
+    _cur.consume = us;
+    _d[LOOP].add((int32_t)(us - _cur.commit));
+    if (_cur.utc != 0) _d[TOTAL].add((int32_t)(us - _cur.utc));
+
+    // 消費の間隔 − UTC の間隔（2秒以上あいたら数えない）
+    if (_prevConsume != 0) {
+      int32_t dCs = _cur.cs - _prevCs;
+      if (dCs < 0) dCs += DAY_CS;
+      if (dCs > 0 && dCs <= 200) _d[INTERVAL].add((int32_t)(us - _prevConsume) - dCs * 10000);
+    }
+    _prevConsume = us;
+    _prevCs = _cur.cs;
+  }
+
+  template <class Out>
+  void report(Out& out) const {
+    out.printf("[lat] %lu epochs, PPS %s\n", (unsigned long)_epochs, pps() ? "yes" : "no");
+    for (int s = 0; s < STAGES; ++s) {
+      const Dist& d = _d[s];
+      if (d.count() == 0) continue;
+      out.printf("[lat] %-10s n=%lu mean %.1f sd %.1f p50 %.1f p95 %.1f p99 %.1f min %.1f max %.1f ms\n",
+                 name(s), (unsigned long)d.count(), d.meanMs(), d.sdMs(),
+                 d.pctMs(0.50f), d.pctMs(0.95f), d.pctMs(0.99f), d.minMs(), d.maxMs());
+    }
+    if (meanLatencyMs() >= 0) out.printf("[lat] compensation: -DGNSS_LATENCY_MS=%d\n", (int)lroundf(meanLatencyMs()));
+  }
+
+private:
+  static constexpr int32_t DAY_CS = 8640000;
+
+  struct Epoch {
+    int32_t  cs = -1;        // UTC（日内のセンチ秒）
+    uint64_t utc = 0;        // UTC を端末の時刻に直したもの（PPS 無しなら 0）
+    uint64_t first = 0, last = 0, commit = 0, consume = 0;
+  };
+
+  Dist     _d[STAGES];
+  Epoch    _cur;
+  uint32_t _epochs = 0;
+  uint64_t _ppsUs = 0, _prevConsume = 0;
+  int32_t  _prevCs = 0;
+
+  // NMEA の走査（種別と先頭の時刻欄だけ見る）
+  enum : uint8_t { IDLE, HEAD, TIME, SKIP };
+  uint8_t  _st = IDLE;
+  char     _head[6];
+  uint8_t  _hn = 0;
+  int32_t  _tv = 0;
+  int8_t   _ti = 0, _tf = -1;   // 整数部の桁数 / 小数部の桁数（-1 = 小数点まだ）
+  uint64_t _sentUs = 0;
+
+  void scan(uint64_t us, char c) {
+    if (c == '$') {
+      _st = HEAD;
+      _hn = 0;
+      _sentUs = us;
+      return;
+    }
+    if (c == '\n') {
+      if (_cur.first != 0) _cur.last = us;
+      _st = IDLE;
+      return;
+    }
+    switch (_st) {
+      case HEAD:
+        if (c != ',') {
+          if (_hn < sizeof(_head)) _head[_hn++] = c;
+        } else if (_hn == 5 && timed()) {
+          _st = TIME;
+          _tv = 0;
+          _ti = 0;
+          _tf = -1;
+        } else {
+          _st = SKIP;
+        }
+        break;
+      case TIME:
+        if (c >= '0' && c <= '9') {
+          if (_tf < 0) {
+            ++_ti;
+            _tv = _tv * 10 + (c - '0');
+          } else if (_tf < 2) {
+            ++_tf;
+            _tv = _tv * 10 + (c - '0');
+          }
+        } else if (c == '.') {
+          _tf = 0;
+        } else {
+          if (c == ',' && _ti == 6) onTime();
+          _st = SKIP;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  bool timed() const {
+    const char* t = _head + 2;
+    return !memcmp(t, "RMC", 3) || !memcmp(t, "GGA", 3) || !memcmp(t, "GNS", 3) || !memcmp(t, "ZDA", 3);
+  }
+
+  void onTime() {
+    int32_t v = _tv, f = 0;
+    int8_t nf = _tf < 0 ? 0 : _tf;
+    for (int8_t k = nf; k < 2; ++k) v *= 10;   // 小数2桁にそろえる
+    f = v % 100;
+    v /= 100;
+    const int32_t cs = ((v / 10000) * 3600 + (v / 100 % 100) * 60 + v % 100) * 100 + f;
+    if (cs == _cur.cs) return;
+
+    // 新しいエポック
+    if (_cur.first != 0 && _cur.last > _cur.first) _d[BURST].add((int32_t)(_cur.last - _cur.first));
+    _cur = Epoch();
+    _cur.cs = cs;
+    _cur.first = _sentUs;
+    ++_epochs;
+
+    // PPS（その秒の頭）からの経過で UTC を端末の時刻に直す（遅延は1秒未満とみなす）
+    if (_ppsUs != 0 && _sentUs - _ppsUs < 2000000) {
+      int64_t age = (int64_t)(_sentUs - _ppsUs) - (int64_t)(cs % 100) * 10000;
+      age %= 1000000;
+      if (age < 0) age += 1000000;
+      _cur.utc = _sentUs - (uint64_t)age;
+      _d[OUT].add((int32_t)age);
+    }
+  }
+};
+
+}  // namespace gnsslat
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* =========================================================
+   入力イベントジャーナル（フィールド走行の完全再現用）
+   - 端末に入ってくる外部入力だけを時刻(μs)つきで記録
+       LOOP   : ループ1回（この時点の入力で LapEngine::step が走る）
+       UART   : GPS から読んだバイト列
+       BUTTON : ボタンの押下/解放エッジ
+       PPS    : PPS 立上り
+       STATE  : その時点の LapEngine 状態ハッシュ（再生側の照合用）
+       FILE   : 起動時に読んだ設定ファイル（track.bin / route.csv）の中身
+   - 形式: ファイル先頭 "JRNL"+ver(2)+予約(2)
+           レコード = tag(上位4bit=種別, 下位4bit=引数) + Δμs(varint) + 本体
+   - 1レコードは1回の write で出す（非同期リングで途中切れしない）
+   ========================================================= */
+
+namespace journal {
+
+enum Type : uint8_t { LOOP = 0, UART = 1, BUTTON = 2, PPS = 3, STATE = 4, FILE = 5 };
+enum FileId : uint8_t { FILE_TRACK = 1, FILE_ROUTE = 2 };
+
+constexpr uint16_t VERSION    = 1;
+constexpr size_t   HEADER_LEN = 8;
+constexpr size_t   MAX_CHUNK  = 256;   // UART/FILE 本体の1レコード上限
+constexpr size_t   MAX_RECORD = 1 + 10 + 5 + MAX_CHUNK;  // 1レコードの最大長
+
+struct Event {
+  Type           type;
+  uint8_t        arg;
+  uint64_t       us;
+  const uint8_t* data;
+  uint32_t       len;
+  uint32_t       hash;
+};
+
+inline size_t putVarint(uint8_t* p, uint64_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+inline bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+  v = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7) {
+    uint8_t b = *p++;
+    v |= (uint64_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+/* ---------- 書き出し（Out は write(const void*, size_t) を持つ） ---------- */
+template <class Out>
+class Writer {
+public:
+  explicit Writer(Out& out) : _out(out) {}
+
+  void header() {
+    uint8_t h[HEADER_LEN] = { 'J', 'R', 'N', 'L', (uint8_t)VERSION, (uint8_t)(VERSION >> 8), 0, 0 };
+    _out.write(h, sizeof(h));
+  }
+
+  void loop(uint64_t us)                          { record(LOOP, 0, us, nullptr, 0, false); }
+  void pps(uint64_t us)                           { record(PPS, 0, us, nullptr, 0, false); }
+  void button(uint64_t us, int id, bool pressed)  { record(BUTTON, (uint8_t)(id * 2 + (pressed ? 1 : 0)), us, nullptr, 0, false); }
+
+  void uart(uint64_t us, const uint8_t* d, size_t n) { chunked(UART, 0, us, d, n); }
+  void file(uint64_t us, FileId id, const void* d, size_t n) { chunked(FILE, id, us, (const uint8_t*)d, n); }
+
+  void state(uint64_t us, uint32_t hash) {
+    uint8_t h[4] = { (uint8_t)hash, (uint8_t)(hash >> 8), (uint8_t)(hash >> 16), (uint8_t)(hash >> 24) };
+    record(STATE, 0, us, h, 4, false);
+  }
+
+private:
+  Out&     _out;
+  uint64_t _lastUs = 0;
+
+  void chunked(Type t, uint8_t arg, uint64_t us, const uint8_t* d, size_t n) {
+    while (n > 0) {
+      size_t k = (n < MAX_CHUNK) ? n : MAX_CHUNK;
+      record(t, arg, us, d, k, true);
+      d += k;
+      n -= k;
+    }
+  }
+
+  void record(Type t, uint8_t arg, uint64_t us, const uint8_t* d, size_t n, bool withLen) {
+    uint8_t rec[1 + 10 + 5 + MAX_CHUNK];
+    size_t k = 0;
+    rec[k++] = (uint8_t)((t << 4) | (arg & 0x0F));
+    k += putVarint(rec + k, (us >= _lastUs) ? us - _lastUs : 0);
+    if (withLen) k += putVarint(rec + k, n);
+    memcpy(rec + k, d, n);
+    k += n;
+    if (_out.write(rec, k)) _lastUs = us;  // 捨てられたら次の Δ に繰り越す
+  }
+};
+
+/* ---------- 読み込み（メモリ上のジャーナル） ---------- */
+class Reader {
+public:
+  Reader(const uint8_t* data, size_t n) : _p(data), _end(data + n) {
+    _ok = n >= HEADER_LEN && memcmp(data, "JRNL", 4) == 0 &&
+          (uint16_t)(data[4] | (data[5] << 8)) == VERSION;
+    if (_ok) _p += HEADER_LEN;
+  }
+
+  bool ok() const { return _ok; }
+  size_t offset(const uint8_t* base) const { return (size_t)(_p - base); }
+  size_t remaining() const { return (size_t)(_end - _p); }
+
+  // 分割読み：remaining() が MAX_RECORD 未満になったら、残りを先頭に寄せて
+  // 続きを読み足したバッファで読み直す（時刻の累積はそのまま）
+  void rebase(const uint8_t* data, size_t n) {
+    _p = data;
+    _end = data + n;
+  }
+
+  bool next(Event& e) {
+    if (!_ok || _p >= _end) return false;
+    uint8_t tag = *_p++;
+    e.type = (Type)(tag >> 4);
+    e.arg = tag & 0x0F;
+    e.data = nullptr;
+    e.len = 0;
+    e.hash = 0;
+
+    uint64_t dt;
+    if (!getVarint(_p, _end, dt)) return fail();
+    _us += dt;
+    e.us = _us;
+
+    switch (e.type) {
+      case LOOP:
+      case PPS:
+      case BUTTON:
+        return true;
+      case STATE:
+        if (_end - _p < 4) return fail();
+        e.hash = (uint32_t)_p[0] | ((uint32_t)_p[1] << 8) | ((uint32_t)_p[2] << 16) | ((uint32_t)_p[3] << 24);
+        _p += 4;
+        return true;
+      case UART:
+      case FILE: {
+        uint64_t n;
+        if (!getVarint(_p, _end, n) || (uint64_t)(_end - _p) < n) return fail();
+        e.data = _p;
+        e.len = (uint32_t)n;
+        _p += n;
+        return true;
+      }
+    }
+    return fail();
+  }
+
+private:
+  const uint8_t* _p;
+  const uint8_t* _end;
+  uint64_t       _us = 0;
+  bool           _ok = false;
+
+  bool fail() { _ok = false; return false; }
+};
+
+} // namespace journal
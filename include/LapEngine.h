@@ -0,0 +1,484 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CivilTime.h"
+#include "Geo.h"
+#include "LapUncertainty.h"
+#include "Rally.h"
+#include "RollingLap.h"
+#include "TinyGPSPlus.h"
+#include "TrackModel.h"
+
+/* =========================================================
+   ラップ計測エンジン（端末とホスト再生で共有）
+   - 入力は UART バイト列（feed）と ループ1回ぶんの入力（step）だけ
+       時刻・ボタン状態は LoopInput で渡す（millis() や M5.BtnX を直接見ない）
+   - 同じ入力列なら端末とホストで状態が同一ビットになる
+       超越関数は det::sin/cos のみ、ビルドは -ffp-contract=off
+   - SD や画面は触らない。ログ・保存が必要なときは step() の戻り値で知らせる
+   ========================================================= */
+
+// 表示・ログの現地時刻（build_flags で上書き可。既定は JST）
+#ifndef TZ_OFFSET_MIN
+#define TZ_OFFSET_MIN 540
+#endif
+#ifndef TZ_DST_RULE
+#define TZ_DST_RULE civil::DST_NONE
+#endif
+
+// GNSS の平均遅延（エポックの UTC → step に渡るまで。[lat] の計測値を入れる）
+// 位置から決まる時刻（GPS の通過・区間・ラリー CP）だけこの分さかのぼる。手動通過はそのまま
+#ifndef GNSS_LATENCY_MS
+#define GNSS_LATENCY_MS 0
+#endif
+
+// 受理する文セット（ファームごとに必要な文だけ並べる）
+using GpsParser = TinyGPSPlusT<GpsData, nmea::RMC, nmea::GGA, nmea::GST>;
+
+struct LoopInput {
+  uint32_t nowMs;
+  bool     btnA, btnB, btnC;
+};
+
+// step() の戻り値（ビットOR）
+enum : uint32_t {
+  EV_LAP   = 1u << 0,   // ラップ確定 → lastLap をログへ
+  EV_TRACK = 1u << 1,   // 中心線更新 → track を保存
+  EV_RALLY = 1u << 2,   // CP 通過 → RallyLast をログへ
+  EV_MARK  = 1u << 3,   // BtnB を押したまま BtnC → 手動マーク（ブラックボックス）
+};
+
+// ログ1行ぶん（確定時点の値）
+struct LapRecord {
+  int   num;
+  float time;
+  float topSpeed;
+  float sigma;
+  int   sectors;                       // 区間タイムの数（0 = 区間なし／取りこぼし）
+  float sector[TRACK_MAX_SECTORS];
+  float sectorSigma[TRACK_MAX_SECTORS];  // 区間ごとの不確かさ（始点＋終点の通過）
+};
+
+class LapEngine {
+public:
+  static constexpr uint32_t LONG_PRESS_MS = 1000;  // BtnB 長押し（画面切替）の判定
+
+  // ループ時刻 → その位置が測られた時刻
+  static uint32_t fixTime(uint32_t nowMs) { return nowMs > GNSS_LATENCY_MS ? nowMs - GNSS_LATENCY_MS : 0; }
+
+  GpsParser gps;
+
+  // 元コードのグローバル（ゼロ初期化に頼らず明示）
+  int YEAR = 0, MONTH = 0, DAY = 0, HOUR = 0, MINUTE = 0, SECOND = 0;
+  int LapCount = 0, SatVal = 0, BestLapNum = 0;
+
+  float LAT0 = 35.3698692322f, LONG0 = 138.9336547852f;
+  float LAT = 0, LONG = 0, KMPH = 0, TopSpeed = 0, ALTITUDE = 0, distanceToMeter0 = 0, BeforeTime = 0;
+  float LAP = 0, LAP1 = 0, LAP2 = 0, LAP3 = 0, LAP4 = 0, LAP5 = 0, BestLap = 99999.0f, AverageLap = 0, Sprit = 0;
+
+  bool LAPCOUNTNOW = false, LAPRADchange = false;
+  float LAPRAD = 5.0f;  // ラップ計測トリガー半径(m)
+
+  // 計測の不確かさ（1σ, 秒）
+  float CrossSigma = 0;         // 直近の通過
+  float LapSigma = 0;           // 直近ラップ（始点＋終点）
+  float fixIntervalS = 0.1f;    // フィックス間隔（平滑化）
+  uint32_t lastFixCount = 0;
+  uint32_t lastFixMs = 0;
+
+  // レギュラリティ・ラリー（ルートを読んだらこのモード）
+  Rally rally;
+  geo::LocalFrame rallyFrame;
+  RallyCrossing RallyLast = { -1, 0, 0 };
+
+  // コース中心線（周回ごとに精緻化）
+  TrackModel track;
+  float TrackDist = 0;          // コース上の距離(m)
+
+  // 任意スタートのベストラップ（2周にまたがる最速1周）
+  RollingLap rolling;
+
+  // 前後G・横G（GPS 速度と方位の差分, g）。フィックスごとに GgCount が増える
+  float AccLong = 0, AccLat = 0;
+  uint32_t GgCount = 0;
+
+  // 区間タイム（track.bin v2 に区間があるとき。区間境界はコース上の距離）
+  float SectorTime[TRACK_MAX_SECTORS] = {};  // 現在ラップの確定済み区間(s)
+  float SectorSigma[TRACK_MAX_SECTORS] = {}; // その不確かさ(s)
+  int   SectorIdx = 0;                       // 走行中の区間
+  uint32_t sectorStartMs = 0;
+  float sectorStartSigma = 0;                // 走行中の区間の始点の通過
+
+  LapRecord lastLap = {};
+
+  LapEngine() { begin(); }
+
+  void begin() {
+    originFrame.setOrigin(LAT0, LONG0);
+    track.reset(LAT0, LONG0);
+  }
+
+  /* ---------- 起動時の設定読込み（SD でもジャーナルでも同じ手順） ---------- */
+
+  // track.bin のヘッダ。成功したら続けて track.bin[] を埋めること
+  bool applyTrackHeader(const TrackFileHeader& h) {
+    if (!track.load(h)) return false;
+    LAT0 = (float)h.lat0;
+    LONG0 = (float)h.lon0;
+    originFrame.setOrigin(LAT0, LONG0);
+    return true;
+  }
+
+  // route.csv の1行「lat1,lon1,lat2,lon2,ルート距離m,目標秒」（'#' 行は無視）
+  void addRouteLine(const char* line) {
+    if (!line[0] || line[0] == '#') return;
+
+    const char* p = line;
+    double v[6];
+    int k = 0;
+    for (; k < 6; ++k) {
+      char* end;
+      v[k] = strtod(p, &end);
+      if (end == p) break;
+      p = (*end == ',') ? end + 1 : end;
+    }
+    if (k != 6) return;
+
+    if (rally.count == 0) rallyFrame.setOrigin(v[0], v[1]);
+    RallyCheckpoint cp;
+    cp.a = rallyFrame.toXY(v[0], v[1]);
+    cp.b = rallyFrame.toXY(v[2], v[3]);
+    cp.distM = (float)v[4];
+    cp.targetMs = (int32_t)(v[5] * 1000.0);
+    rally.add(cp);
+  }
+
+  bool finishRoute() {
+    if (!rally.active()) rally.count = 0;
+    return rally.active();
+  }
+
+  /* ---------- 実行 ---------- */
+
+  void feed(const uint8_t* d, size_t n) {
+    for (size_t i = 0; i < n; ++i) gps.encode((char)d[i]);
+  }
+
+  // ループ1回（元の ReadGPS + CountLAP）
+  uint32_t step(const LoopInput& in) {
+    uint32_t ev = readGps(in);
+    if (!rally.active()) ev |= countLap(in);
+    return ev;
+  }
+
+  // 照合用の状態ハッシュ（FNV-1a）
+  uint32_t stateHash() const {
+    uint32_t h = 2166136261u;
+    auto mix = [&h](const void* p, size_t n) {
+      const uint8_t* b = (const uint8_t*)p;
+      for (size_t i = 0; i < n; ++i) { h ^= b[i]; h *= 16777619u; }
+    };
+    const int ints[] = { YEAR, MONTH, DAY, HOUR, MINUTE, SECOND, LapCount, SatVal, BestLapNum,
+                         LAPCOUNTNOW, LAPRADchange, markCombo, prevBtnC, rally.next(), track.bins(), track.laps(), track.state() };
+    const float floats[] = { LAT0, LONG0, LAT, LONG, KMPH, TopSpeed, distanceToMeter0, BeforeTime,
+                             LAP, LAP1, LAP2, LAP3, LAP4, LAP5, BestLap, AverageLap, Sprit, LAPRAD,
+                             CrossSigma, LapSigma, fixIntervalS, TrackDist, AccLong, AccLat };
+    mix(ints, sizeof(ints));
+    mix(floats, sizeof(floats));
+    mix(&lastFixCount, sizeof(lastFixCount));
+    mix(&lastFixMs, sizeof(lastFixMs));
+    mix(track.bin, sizeof(TrackBin) * track.bins());
+    const float roll[] = { rolling.valid() ? rolling.bestS() : 0.0f, rolling.recentBestS() };
+    mix(roll, sizeof(roll));
+    mix(SectorTime, sizeof(SectorTime));
+    mix(SectorSigma, sizeof(SectorSigma));
+    mix(&SectorIdx, sizeof(SectorIdx));
+    return h;
+  }
+
+private:
+  geo::LocalFrame originFrame;  // 計測原点（distanceToMeter0 用）
+  static constexpr civil::Zone localZone{ TZ_OFFSET_MIN, TZ_DST_RULE };
+  long lastUtcStamp = -1;       // 前回変換した UTC（日時を1つの整数に詰めたもの）
+  uint32_t btnBDownMs = 0;
+  bool     markCombo = false;   // BtnB の押下中に BtnC が押された
+  bool     prevBtnC = false;
+  float    prevTrackDist = -1;  // 区間境界の補間用（直前フィックスの距離と時刻）
+  uint32_t prevFixMs = 0;
+  int32_t  accPrevMs = -1;      // 前後G・横G用の直前フィックス
+  float    accPrevV = 0, accPrevCourse = 0;
+
+  // 原点からの距離（正距円筒。ラップ判定半径の規模では haversine と差なし）
+  float originDistance() const {
+    return geo::length(originFrame.toXY(gps.location.lat(), gps.location.lng()));
+  }
+
+  // UTC → 現地時刻（月末・年末の繰り上げ込み）
+  void updateLocalTime() {
+    civil::DateTime utc;
+    utc.year   = gps.date.year();
+    utc.month  = gps.date.month();
+    utc.day    = gps.date.day();
+    utc.hour   = gps.time.hour();
+    utc.minute = gps.time.minute();
+    utc.second = gps.time.second();
+
+    // RMC 受信前（日付なし）は時刻だけ換算する
+    bool hasDate = utc.year != 0;
+    if (!hasDate) {
+      utc.year = 1970; utc.month = 1; utc.day = 1;
+    }
+
+    civil::DateTime t = localZone.toLocal(civil::toEpoch(utc));
+    YEAR   = hasDate ? t.year  : 0;
+    MONTH  = hasDate ? t.month : 0;
+    DAY    = hasDate ? t.day   : 0;
+    HOUR   = t.hour;
+    MINUTE = t.minute;
+    SECOND = t.second;
+  }
+
+  // GPS状態更新＋ボタン（元の ReadGPS）
+  uint32_t readGps(const LoopInput& in) {
+    uint32_t ev = 0;
+    const uint32_t fixMs = fixTime(in.nowMs);
+
+    // GPSデータ展開
+    LAT = (float)gps.location.lat();
+    LONG = (float)gps.location.lng();
+    KMPH = (float)gps.speed.kmph();
+    ALTITUDE = (float)gps.altitude.meters();
+    distanceToMeter0 = originDistance();
+    SatVal = gps.satellites.value();
+
+    // フィックス間隔（RMC確定ごとに1回）
+    if (gps.fixCount() != lastFixCount) {
+      lastFixCount = gps.fixCount();
+      uint32_t dt = in.nowMs - lastFixMs;
+      if (lastFixMs != 0 && dt < 2000) fixIntervalS = fixIntervalS * 0.8f + (dt / 1000.0f) * 0.2f;
+      lastFixMs = in.nowMs;
+      updateAccel();
+
+      // コース中心線：マップマッチ＋集約
+      track.onFix(track.frame.toXY(gps.location.lat(), gps.location.lng()));
+      if (track.matched()) {
+        TrackDist = track.distanceM();
+        sectorSplit(fixMs);
+      }
+
+      // ローリングラップ（中心線ができてから）
+      if (track.state() == TrackModel::READY) {
+        if (rolling.bins() != track.bins()) rolling.reset(track.bins(), track.binM());
+        if (track.matched()) rolling.onFix(TrackDist, fixMs);
+      }
+
+      // ラリー：次の CP だけ判定
+      if (rally.active()) {
+        RallyCrossing c;
+        if (rally.onFix(rallyFrame.toXY(gps.location.lat(), gps.location.lng()), fixMs, KMPH, c)) {
+          RallyLast = c;
+          ev |= EV_RALLY;
+        }
+      }
+    }
+
+    // ラップ計測中の最高速度
+    if (TopSpeed < KMPH) {
+      TopSpeed = KMPH;
+    }
+
+    // 現地時刻変換（GPS時刻が変わった時＝1秒に1回だけ）
+    long stamp = ((((long)gps.date.month() * 32 + gps.date.day()) * 24 + gps.time.hour()) * 60
+                  + gps.time.minute()) * 60 + gps.time.second();
+    if (stamp != lastUtcStamp) {
+      lastUtcStamp = stamp;
+      updateLocalTime();
+    }
+
+    // 相対距離原点設定（BtnA）
+    if (in.btnA) {
+      LAT0 = LAT;
+      LONG0 = LONG;
+      originFrame.setOrigin(LAT0, LONG0);
+      track.reset(gps.location.lat(), gps.location.lng()); // 新しいコースとして学習し直す
+      rolling.reset(0, track.binM());
+      distanceToMeter0 = originDistance();
+    }
+
+    // LAPRAD変更（BtnB 短押しを離した時。長押しは画面切替に使う）
+    if (in.btnB && LAPRADchange == false) {
+      LAPRADchange = true;
+      btnBDownMs = in.nowMs;
+    }
+
+    // BtnB を押したまま BtnC：手動マーク（この押下ではラップも LAPRAD も変えない）
+    if (in.btnB && in.btnC && !prevBtnC) {
+      markCombo = true;
+      ev |= EV_MARK;
+    }
+    prevBtnC = in.btnC;
+
+    if (!in.btnB && LAPRADchange == true) {
+      LAPRADchange = false;
+      const bool combo = markCombo;
+      markCombo = false;
+      if (!combo && in.nowMs - btnBDownMs < LONG_PRESS_MS) {
+        if (LAPRAD == 50) {
+          LAPRAD = 0;
+        }
+        LAPRAD += 5;
+      }
+    }
+    return ev;
+  }
+
+  // 前後G・横G：GNSS 時刻（1/100 秒）でフィックス間隔を取る（UART 到着の揺らぎを避ける）
+  //   横G = 速度 × 方位変化率。低速では方位が当てにならないので 0
+  void updateAccel() {
+    int32_t ms = ((gps.time.hour() * 60 + gps.time.minute()) * 60 + gps.time.second()) * 1000
+                 + gps.time.centisecond() * 10;
+    float v = (float)gps.speed.kmph() / 3.6f;
+    float crs = (float)gps.course.deg();
+
+    int32_t dt = ms - accPrevMs;
+    if (dt < 0) dt += 86400000;   // 日付またぎ
+    if (accPrevMs >= 0 && dt > 0 && dt < 2000) {
+      float s = dt / 1000.0f;
+      float dpsi = crs - accPrevCourse;
+      if (dpsi > 180.0f) dpsi -= 360.0f;
+      if (dpsi < -180.0f) dpsi += 360.0f;
+      float lon = (v - accPrevV) / s / 9.80665f;
+      float lat = (v > 3.0f) ? v * (dpsi * 0.017453292f) / s / 9.80665f : 0.0f;
+      AccLong = AccLong * 0.5f + lon * 0.5f;   // フィックス差分のノイズを軽くならす
+      AccLat  = AccLat  * 0.5f + lat * 0.5f;
+      ++GgCount;
+    }
+    accPrevMs = ms;
+    accPrevV = v;
+    accPrevCourse = crs;
+  }
+
+  // 区間境界の通過（境界距離をまたいだ前後のフィックス間で時刻を補間）
+  void sectorSplit(uint32_t nowMs) {
+    const float d0 = prevTrackDist, d1 = TrackDist;
+    const uint32_t t0 = prevFixMs;
+    prevTrackDist = d1;
+    prevFixMs = nowMs;
+
+    const int n = track.meta.sectors;
+    if (n < 2 || SectorIdx >= n - 1 || d0 < 0.0f) return;
+    float b = track.meta.sectorEndM[SectorIdx];
+    if (d0 < b && b <= d1 && d1 - d0 < 100.0f) {
+      uint32_t t = t0 + (uint32_t)((nowMs - t0) * ((b - d0) / (d1 - d0)));
+      const float cs = sectorCrossingSigma();
+      SectorTime[SectorIdx] = (t - sectorStartMs) / 1000.0f;
+      SectorSigma[SectorIdx] = lapsigma::combine(sectorStartSigma, cs);
+      sectorStartMs = t;
+      sectorStartSigma = cs;
+      ++SectorIdx;
+    }
+  }
+
+  // 区間境界の通過1回の不確かさ。前後のフィックスで補間するので量子化の項は無く、
+  // 境界は中心線に直交（進入角 1）。残るのは位置誤差の進行方向成分 ÷ 速度
+  float sectorCrossingSigma() const {
+    float pos = lapsigma::positionSigma((float)gps.accuracy.meters(), (float)gps.hdop.hdop());
+    return lapsigma::crossingSigma(pos, 0.0f, KMPH / 3.6f, 1.0f);
+  }
+
+  // ラップ確定・計測開始時：最終区間を閉じて次のラップへ（endSigma はこの通過の不確かさ）
+  int closeSectors(uint32_t nowMs, float endSigma, float* out, float* outSigma) {
+    const int n = track.meta.sectors;
+    int done = 0;
+    if (n >= 2 && SectorIdx == n - 1) {
+      SectorTime[n - 1] = (nowMs - sectorStartMs) / 1000.0f;
+      SectorSigma[n - 1] = lapsigma::combine(sectorStartSigma, endSigma);
+      for (int i = 0; i < n; ++i) {
+        out[i] = SectorTime[i];
+        outSigma[i] = SectorSigma[i];
+      }
+      done = n;
+    }
+    SectorIdx = 0;
+    sectorStartMs = nowMs;
+    sectorStartSigma = endSigma;
+    for (int i = 0; i < TRACK_MAX_SECTORS; ++i) SectorTime[i] = SectorSigma[i] = 0.0f;
+    return done;
+  }
+
+  // 通過1回の不確かさ（通過時だけ計算）
+  float crossingSigma(bool manual) const {
+    if (manual) return lapsigma::MANUAL_SIGMA_S;
+
+    float pos = lapsigma::positionSigma((float)gps.accuracy.meters(), (float)gps.hdop.hdop());
+    float c = lapsigma::approachCos(LAT, LONG, LAT0, LONG0, (float)gps.course.deg());
+    return lapsigma::crossingSigma(pos, fixIntervalS, KMPH / 3.6f, c);
+  }
+
+  // ラップ計測（元の CountLAP）
+  uint32_t countLap(const LoopInput& in) {
+    uint32_t ev = 0;
+    const bool manual = in.btnC && !in.btnB;   // BtnB との同時押しはマーク
+    const uint32_t nowMs = manual ? in.nowMs : fixTime(in.nowMs);
+    const float now = (float)nowMs;
+
+    if (distanceToMeter0 >= LAPRAD && !manual && LAPCOUNTNOW == true) {
+      LAPCOUNTNOW = false;
+    }
+
+    // 4ラップ計測（元コードそのまま）
+    if (((distanceToMeter0 != 0 && distanceToMeter0 <= LAPRAD) || manual)
+        && LAPCOUNTNOW == false
+        && ((now - BeforeTime) / 1000) > 10)
+    {
+      // この通過の不確かさ（始点・終点の両方に使う）
+      float startSigma = CrossSigma;
+      CrossSigma = crossingSigma(manual);
+
+      if (LapCount > 0) {
+        LAP5 = LAP4;
+        LAP4 = LAP3;
+        LAP3 = LAP2;
+        LAP2 = LAP1;
+        LAP1 = LAP;
+
+        LAP = (now - BeforeTime) / 1000;
+        LapSigma = lapsigma::combine(startSigma, CrossSigma);
+        BeforeTime = now;
+
+        if (LAP < BestLap) {
+          BestLap = LAP;
+          BestLapNum = LapCount;
+        }
+
+        lastLap = {};
+        lastLap.num = LapCount;
+        lastLap.time = LAP;
+        lastLap.topSpeed = TopSpeed;
+        lastLap.sigma = LapSigma;
+        lastLap.sectors = closeSectors(nowMs, CrossSigma, lastLap.sector, lastLap.sectorSigma);
+        TopSpeed = 0; // 最高速度をリセット
+        ev |= EV_LAP;
+
+        Sprit += LAP;
+        if (LapCount > 1) {
+          AverageLap = Sprit / LapCount;
+        }
+      } else {
+        BeforeTime = now;
+        float unused[TRACK_MAX_SECTORS], unusedSigma[TRACK_MAX_SECTORS];
+        closeSectors(nowMs, CrossSigma, unused, unusedSigma);
+      }
+
+      track.onLap();
+      if (track.state() == TrackModel::READY) ev |= EV_TRACK;
+
+      LapCount++;
+      LAPCOUNTNOW = true;
+    }
+    return ev;
+  }
+};
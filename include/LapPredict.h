@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "RefLap.h"
+
+/* =========================================================
+   走行中ラップの予想タイム
+   - 予想 = 経過 + 基準ラップの「今の距離からの残り」（RefLap の表を添字で引くだけ）
+   - 差の傾向（基準ラップとの差が距離あたりどれだけ増えているか）を trendW の割合で
+     残り距離ぶん先へ延ばせる（0 = 使わない）
+   - フィックスごとに onFix()。探索・確保なし
+   ========================================================= */
+
+#ifndef PREDICT_TREND
+#define PREDICT_TREND 0.0f   // 差の傾向を混ぜる割合（0〜1）
+#endif
+
+class LapPredictor {
+public:
+  static constexpr float TREND_STEP_M = 25.0f;   // 傾きを取る距離の間隔
+  static constexpr float TREND_ALPHA = 0.3f;
+  static constexpr float TREND_CAP = 0.1f;       // 延ばす量は残り時間の ±10% まで
+
+  // ラップの頭で
+  void reset() { *this = LapPredictor(); }
+
+  // elapsedMs = このラップの経過, distM = コース上の距離
+  void onFix(uint32_t elapsedMs, float distM, const RefLap& ref, float trendW = PREDICT_TREND) {
+    if (!ref.valid()) {
+      _valid = false;
+      return;
+    }
+    const float L = ref.header().bins * ref.header().binM;
+    if (!_started) {                      // 計測線の手前（距離がコース長の後半）は待つ
+      if (distM > L * 0.5f) return;
+      _started = true;
+    }
+
+    const uint32_t refE = ref.elapsedAt(distM);
+    const uint32_t remain = ref.lapMs() - refE;
+    _delta = (int32_t)(elapsedMs - refE);
+
+    // 差の傾き（ms / m）
+    if (!_hasTrend) {
+      _td = distM;
+      _tDelta = _delta;
+      _hasTrend = true;
+    } else if (distM - _td >= TREND_STEP_M) {
+      const float s = (_delta - _tDelta) / (distM - _td);
+      _slope = _slopeOk ? _slope + (s - _slope) * TREND_ALPHA : s;
+      _slopeOk = true;
+      _td = distM;
+      _tDelta = _delta;
+    } else if (distM < _td) {             // 後退したら取り直し
+      _td = distM;
+      _tDelta = _delta;
+    }
+
+    float extra = 0;
+    if (trendW > 0 && _slopeOk) {
+      extra = trendW * _slope * (L - distM);
+      const float cap = remain * TREND_CAP;
+      if (extra > cap) extra = cap;
+      if (extra < -cap) extra = -cap;
+    }
+    const float p = (float)elapsedMs + remain + extra;
+    _pred = p > 0 ? (uint32_t)p : 0;
+    _valid = true;
+  }
+
+  bool     valid() const { return _valid; }
+  uint32_t predictedMs() const { return _pred; }
+  int32_t  deltaMs() const { return _delta; }   // 今の距離での基準ラップとの差
+
+private:
+  bool     _valid = false, _started = false, _hasTrend = false, _slopeOk = false;
+  uint32_t _pred = 0;
+  int32_t  _delta = 0, _tDelta = 0;
+  float    _td = 0, _slope = 0;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <math.h>
+
+#include "DetMath.h"
+
+/* =========================================================
+   ラップ計測の不確かさ（1σ, 秒）
+   - 通過1回ごとに、位置精度・フィックス間隔・速度・進入角から見積もる
+   - ラップ / セクタは 始点と終点の通過を二乗和で合成
+   - 計算は通過時のみ（フィックスごとの処理は増やさない）
+   ========================================================= */
+
+namespace lapsigma {
+
+// GST が無い受信機は HDOP × UERE で位置精度を近似
+constexpr float UERE_M          = 2.0f;
+// 手動計測（BtnC）の反応時間ばらつき
+constexpr float MANUAL_SIGMA_S  = 0.15f;
+// 円に接するように通過した時の発散を抑える下限（cos）
+constexpr float MIN_APPROACH    = 0.1f;
+
+// 水平位置精度 1σ（m）：hAcc があれば優先
+inline float positionSigma(float haccM, float hdop) {
+  if (haccM > 0.0f) return haccM;
+  if (hdop  > 0.0f) return hdop * UERE_M;
+  return 5.0f * UERE_M; // 精度情報なし
+}
+
+// 原点方向と進行方向のなす角の cos（進入角）
+//   lat/lon: 通過時の位置, lat0/lon0: 原点, courseDeg: 進行方位（真北0, 時計回り）
+//   cos(方位差) = 進行方向単位ベクトル・原点方向単位ベクトル（atan2 を使わない）
+inline float approachCos(float lat, float lon, float lat0, float lon0, float courseDeg) {
+  const float d2r = 0.017453292f;
+  float dn = (lat0 - lat);
+  float de = (lon0 - lon) * det::cosf(lat * d2r);
+  float len = sqrtf(dn * dn + de * de);
+  if (len == 0.0f) return 1.0f;
+  float c = courseDeg * d2r;
+  return (det::sinf(c) * de + det::cosf(c) * dn) / len;
+}
+
+// 1回の通過の不確かさ（秒）
+//   フィックス到着で判定するので時刻は区間内一様 → dt/√12
+//   位置誤差の半径方向成分 ÷ 接近速度 → 時刻誤差
+inline float crossingSigma(float posSigmaM, float fixIntervalS, float speedMps, float cosApproach) {
+  float q = fixIntervalS * 0.28867513f; // 1/√12
+  float c = fabsf(cosApproach);
+  if (c < MIN_APPROACH) c = MIN_APPROACH;
+  float v = speedMps * c;
+  if (v < 0.5f) v = 0.5f;                 // ほぼ停止中
+  float p = (posSigmaM * 0.70710678f) / v; // 2D σ → 1軸成分
+  return sqrtf(q * q + p * p);
+}
+
+// 区間（ラップ・セクタ）の不確かさ：始点と終点の合成
+inline float combine(float startSigma, float endSigma) {
+  return sqrtf(startSigma * startSigma + endSigma * endSigma);
+}
+
+} // namespace lapsigma
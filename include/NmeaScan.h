@@ -0,0 +1,234 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/* =========================================================
+   NMEA 文の一括スキャン（ホスト専用：大きな生ログの取込み用）
+   - バッファ全体から「チェックサムの合った文」の本体（'$' の次〜'*' の前）を順に渡す
+   - 受理する文は TinyGPSPlusT::encode() と完全に同じ：
+       '$' で行頭に戻る / '\r' は捨てる / '\n' で1文 / 1文は 159 文字まで /
+       '*' は '$' の後の最初の1個 / "*hh" の後ろ2文字は 16進でなければ 0 とみなす
+   - scanScalar : 1文字ずつ（encode と同じ手順。比較の基準）
+     scanSimd   : SSE2（16 B）/ AVX2（32 B）で '$' '*' '\r' '\n' NUL の位置をまとめて探し、
+                  チェックサムも 16/32 B ずつ XOR する。
+                  行の途中の '\r'・NUL・長すぎる行だけは 1文字ずつの手順に回す
+   - f(const char* body, size_t len) に渡す body はその呼び出しの間だけ有効
+   ========================================================= */
+
+namespace nmeascan {
+
+constexpr size_t LINE_MAX = 159;   // TinyGPSPlusT の行バッファ（160）に入る文字数
+
+inline uint8_t hexNibble(char ch) {
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  return 0;
+}
+
+/* ---------- 1文字ずつ（encode + parseLine のチェックサム部と同じ） ---------- */
+class Scalar {
+public:
+  template <class F>
+  size_t feed(const char* p, size_t n, F&& f) {
+    size_t ok = 0;
+    for (size_t i = 0; i < n; ++i) {
+      const char c = p[i];
+      if (c == '\r') continue;
+      if (c == '$') {
+        _idx = 0;
+        _buf[_idx++] = c;
+        _buf[_idx] = '\0';
+        continue;
+      }
+      if (_idx < (int)sizeof(_buf) - 1) {
+        _buf[_idx++] = c;
+        _buf[_idx] = '\0';
+      }
+      if (c == '\n') {
+        ok += line(f);
+        _idx = 0;
+      }
+    }
+    return ok;
+  }
+
+private:
+  char _buf[LINE_MAX + 1];
+  int  _idx = 0;
+
+  template <class F>
+  size_t line(F& f) {
+    if (_buf[0] != '$') return 0;
+    const char* body = _buf + 1;
+    const char* ast = strchr(body, '*');
+    if (!ast || ast - body <= 0) return 0;
+    uint8_t cs = 0;
+    for (const char* q = body; q < ast; ++q) cs ^= (uint8_t)*q;
+    if (strlen(ast) < 3) return 0;
+    if (cs != (uint8_t)((hexNibble(ast[1]) << 4) | hexNibble(ast[2]))) return 0;
+    f(body, (size_t)(ast - body));
+    return 1;
+  }
+};
+
+template <class F>
+inline size_t scanScalar(const char* p, size_t n, F&& f) {
+  Scalar s;
+  return s.feed(p, n, f);
+}
+
+/* ---------- 範囲の XOR（16/32 B ずつ） ---------- */
+inline uint8_t xorRange(const char* p, size_t n) {
+  uint64_t x = 0;
+  size_t i = 0;
+#if defined(__AVX2__)
+  __m256i a = _mm256_setzero_si256();
+  for (; i + 32 <= n; i += 32) a = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i*)(p + i)));
+  __m128i b = _mm_xor_si128(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+#elif defined(__SSE2__)
+  __m128i b = _mm_setzero_si128();
+#endif
+#if defined(__SSE2__)
+  for (; i + 16 <= n; i += 16) b = _mm_xor_si128(b, _mm_loadu_si128((const __m128i*)(p + i)));
+  x = (uint64_t)_mm_cvtsi128_si64(b) ^ (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(b, b));
+#endif
+  for (; i + 8 <= n; i += 8) {
+    uint64_t w;
+    memcpy(&w, p + i, 8);
+    x ^= w;
+  }
+  x ^= x >> 32;
+  x ^= x >> 16;
+  x ^= x >> 8;
+  uint8_t cs = (uint8_t)x;
+  for (; i < n; ++i) cs ^= (uint8_t)p[i];
+  return cs;
+}
+
+/* ---------- SIMD ---------- */
+namespace detail {
+
+// 特殊文字（'$' '*' '\r' '\n' NUL）の位置のビット列
+#if defined(__AVX2__)
+constexpr size_t W = 32;
+inline uint32_t specials(const char* p) {
+  const __m256i v = _mm256_loadu_si256((const __m256i*)p);
+  __m256i m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('$'));
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')));
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+  return (uint32_t)_mm256_movemask_epi8(m);
+}
+#elif defined(__SSE2__)
+constexpr size_t W = 16;
+inline uint32_t specials(const char* p) {
+  const __m128i v = _mm_loadu_si128((const __m128i*)p);
+  __m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8('$'));
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('*')));
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+  return (uint32_t)_mm_movemask_epi8(m);
+}
+#else
+constexpr size_t W = 8;
+inline uint32_t specials(const char* p) {
+  uint32_t m = 0;
+  for (size_t i = 0; i < W; ++i) {
+    const char c = p[i];
+    if (c == '$' || c == '*' || c == '\n' || c == '\r' || c == '\0') m |= 1u << i;
+  }
+  return m;
+}
+#endif
+
+inline int ctz(uint32_t m) { return __builtin_ctz(m); }
+
+}  // namespace detail
+
+constexpr const char* simdName() {
+#if defined(__AVX2__)
+  return "avx2";
+#elif defined(__SSE2__)
+  return "sse2";
+#else
+  return "none";
+#endif
+}
+
+template <class F>
+inline size_t scanSimd(const char* p, size_t n, F&& f) {
+  size_t ok = 0;
+  long dollar = -1, star = -1;   // 今の行の最後の '$' と、その後の最初の '*'
+  bool odd = false;              // '$' の後に行中の '\r' か NUL があった
+
+  // 行末（'\n' の位置 nl）
+  auto endLine = [&](long nl) {
+    if (dollar < 0) return;
+    const bool cr = nl > 0 && p[nl - 1] == '\r' && nl - 1 > dollar;
+    const size_t len = (size_t)(nl - dollar + 1) - (cr ? 1 : 0);   // 行バッファに入る文字数
+    if (odd || len > LINE_MAX) {
+      Scalar s;                 // 珍しい行は 1文字ずつの手順で（'$' で状態は初期化される）
+      ok += s.feed(p + dollar, (size_t)(nl - dollar + 1), f);
+      return;
+    }
+    if (star < 0 || star - dollar - 1 <= 0) return;
+    // '*' から行末までの文字数（"*hh" の 3 以上）と 16進2桁（'\r' は飛ばす）
+    const long tail = (nl - star + 1) - (cr ? 1 : 0);
+    if (tail < 3) return;
+    auto at = [&](long k) { long r = star + k; return (cr && r >= nl - 1) ? p[r + 1] : p[r]; };
+    const uint8_t sent = (uint8_t)((hexNibble(at(1)) << 4) | hexNibble(at(2)));
+    const char* body = p + dollar + 1;
+    const size_t bn = (size_t)(star - dollar - 1);
+    if (xorRange(body, bn) != sent) return;
+    f(body, bn);
+    ++ok;
+  };
+
+  auto onSpecial = [&](long i) {
+    switch (p[i]) {
+      case '$':
+        dollar = i;
+        star = -1;
+        odd = false;
+        break;
+      case '*':
+        if (dollar >= 0 && star < 0) star = i;
+        break;
+      case '\r':
+        if (dollar >= 0 && !((size_t)i + 1 < n && p[i + 1] == '\n')) odd = true;
+        break;
+      case '\n':
+        endLine(i);
+        dollar = -1;
+        break;
+      default:   // NUL
+        if (dollar >= 0) odd = true;
+        break;
+    }
+  };
+
+  size_t i = 0;
+  for (; i + detail::W <= n; i += detail::W) {
+    uint32_t m = detail::specials(p + i);
+    while (m) {
+      onSpecial((long)i + detail::ctz(m));
+      m &= m - 1;
+    }
+  }
+  for (; i < n; ++i) {
+    const char c = p[i];
+    if (c == '$' || c == '*' || c == '\n' || c == '\r' || c == '\0') onSpecial((long)i);
+  }
+  return ok;
+}
+
+}  // namespace nmeascan
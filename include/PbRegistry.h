@@ -0,0 +1,162 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "TrackModel.h"
+
+/* =========================================================
+   コースごとの自己ベスト（起動をまたいで持つ）
+   - 1件 = コース（計測原点）＋ドライバー/車の番号 → 歴代ベストラップ・その区間・
+           区間ごとの歴代最速・基準ラップのファイル名
+   - コースは計測原点の近さ（MATCH_M 以内）で引く。ID は最初に登録した原点から作る
+   - ファイル = PbFileHeader + PbEntry × count（小さいので丸ごと読み、丸ごと書く）
+   - 書込みは呼び出し側で一時ファイル → 置換え（書きかけで電源が落ちても前のが残る）
+   ========================================================= */
+
+#ifndef PB_PROFILE
+#define PB_PROFILE 0   // ドライバー/車の番号（同じコースを別々に記録する時）
+#endif
+
+struct PbEntry {
+  uint32_t trackId;
+  float    lat0, lon0;            // 計測原点
+  uint16_t profile;
+  uint8_t  sectors;
+  uint8_t  reserved;
+  float    bestLap;               // s
+  float    lapSector[TRACK_MAX_SECTORS];   // ベストラップの区間
+  float    bestSector[TRACK_MAX_SECTORS];  // 区間ごとの歴代最速（理論ベスト用）
+  uint16_t year;
+  uint8_t  month, day;
+  char     ref[20];               // 基準ラップのファイル（無ければ空）
+};
+
+struct PbFileHeader {
+  char     magic[4] = { 'P', 'B', 'R', '1' };
+  uint16_t count = 0;
+  uint16_t reserved = 0;
+};
+
+class PbRegistry {
+public:
+  static constexpr int   MAX = 32;
+  static constexpr float MATCH_M = 300.0f;
+
+  enum : uint8_t { NEW_LAP = 1, NEW_SECTOR = 2 };
+
+  void clear() { _hdr = PbFileHeader(); }
+
+  // 読込み：ヘッダを確かめてから entries() に count 件読ませる
+  bool beginLoad(const PbFileHeader& h) {
+    if (memcmp(h.magic, "PBR1", 4) != 0 || h.count > MAX) {
+      clear();
+      return false;
+    }
+    _hdr = h;
+    return true;
+  }
+
+  const PbFileHeader& header() const { return _hdr; }
+  PbEntry* entries() { return _e; }
+  const PbEntry* entries() const { return _e; }
+  int count() const { return _hdr.count; }
+  const PbEntry& at(int i) const { return _e[i]; }
+
+  // コースの検出時に1回：原点が近い同じ番号の記録（無ければ -1）
+  int find(double lat0, double lon0, uint16_t profile) const {
+    int best = -1;
+    float bestD = MATCH_M;
+    for (int i = 0; i < _hdr.count; ++i) {
+      if (_e[i].profile != profile) continue;
+      float d = distM(lat0, lon0, _e[i].lat0, _e[i].lon0);
+      if (d < bestD) {
+        bestD = d;
+        best = i;
+      }
+    }
+    return best;
+  }
+
+  // ラップ確定時。idx が -1 なら新しく登録（満杯なら一番古い記録を置き換え）
+  //   戻り値 = NEW_LAP / NEW_SECTOR の OR（0 なら保存不要）
+  uint8_t onLap(int& idx, double lat0, double lon0, uint16_t profile,
+                float lap, int sectors, const float* sector, int y, int mo, int d) {
+    uint8_t r = 0;
+    if (idx < 0) {
+      idx = _hdr.count < MAX ? _hdr.count++ : oldest();
+      PbEntry& e = _e[idx];
+      memset(&e, 0, sizeof(e));
+      e.trackId = trackId(lat0, lon0);
+      e.lat0 = (float)lat0;
+      e.lon0 = (float)lon0;
+      e.profile = profile;
+    }
+    PbEntry& e = _e[idx];
+
+    if (e.bestLap <= 0 || lap < e.bestLap) {
+      e.bestLap = lap;
+      e.sectors = (uint8_t)sectors;
+      for (int i = 0; i < TRACK_MAX_SECTORS; ++i) e.lapSector[i] = i < sectors ? sector[i] : 0;
+      e.year = (uint16_t)y;
+      e.month = (uint8_t)mo;
+      e.day = (uint8_t)d;
+      r |= NEW_LAP;
+    }
+    if (sectors > 0 && sectors == e.sectors) {
+      for (int i = 0; i < sectors; ++i) {
+        if (sector[i] > 0 && (e.bestSector[i] <= 0 || sector[i] < e.bestSector[i])) {
+          e.bestSector[i] = sector[i];
+          r |= NEW_SECTOR;
+        }
+      }
+    }
+    return r;
+  }
+
+  void setRef(int idx, const char* path) { snprintf(_e[idx].ref, sizeof(_e[idx].ref), "%s", path); }
+
+  // 区間ごとの歴代最速の和（区間が無ければ 0）
+  float theoreticalBest(int idx) const {
+    const PbEntry& e = _e[idx];
+    float s = 0;
+    for (int i = 0; i < e.sectors; ++i) {
+      if (e.bestSector[i] <= 0) return 0;
+      s += e.bestSector[i];
+    }
+    return s;
+  }
+
+  size_t bytes() const { return sizeof(PbEntry) * _hdr.count; }
+
+  static uint32_t trackId(double lat0, double lon0) {
+    int32_t q[2] = { (int32_t)lround(lat0 * 1e4), (int32_t)lround(lon0 * 1e4) };
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(q); ++i) h = (h ^ ((const uint8_t*)q)[i]) * 16777619u;
+    return h;
+  }
+
+private:
+  PbFileHeader _hdr;
+  PbEntry      _e[MAX];
+
+  int oldest() const {
+    int o = 0;
+    for (int i = 1; i < _hdr.count; ++i) {
+      uint32_t a = (_e[i].year * 13u + _e[i].month) * 32u + _e[i].day;
+      uint32_t b = (_e[o].year * 13u + _e[o].month) * 32u + _e[o].day;
+      if (a < b) o = i;
+    }
+    return o;
+  }
+
+  static float distM(double la1, double lo1, double la2, double lo2) {
+    const double k = 0.017453292519943295;
+    double x = (lo2 - lo1) * k * cos((la1 + la2) * 0.5 * k);
+    double y = (la2 - la1) * k;
+    return (float)(sqrt(x * x + y * y) * 6371000.0);
+  }
+};
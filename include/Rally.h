@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Geo.h"
+
+/* =========================================================
+   レギュラリティ（指定平均速度）ラリー
+   - ルート = チェックポイント線の列（ルート距離・目標時刻つき）
+   - 理想スケジュール：距離→目標時刻を CP 間で線形補間
+   - フィックスごとの判定は「次の CP 1本」だけ（O(1)）
+   - CP0 がスタート線。通過した瞬間から区間時計を回す
+   - CP はルートの向き（次の CP の方へ。最後の CP は前の CP から）に横切った時だけ通過
+   - オドメータは STOP_KMH 未満（停車中の位置のふらつき）と MAX_STEP_M 以上の飛びは足さない
+   ========================================================= */
+
+struct RallyCheckpoint {
+  geo::Vec2 a, b;      // 判定線の両端（LocalFrame 座標, m）
+  float     distM;     // スタートからのルート距離
+  int32_t   targetMs;  // スタートからの目標時刻
+};
+
+struct RallyCrossing {
+  int     index;       // 通過した CP 番号
+  int32_t actualMs;    // スタートからの実時刻（補間済み）
+  int32_t targetMs;
+  int32_t diffMs() const { return actualMs - targetMs; } // +:遅れ / -:早着
+};
+
+class Rally {
+public:
+  static constexpr int   MAX_CP = 64;
+  static constexpr float STOP_KMH = 3.0f;
+  static constexpr float MAX_STEP_M = 200.0f;
+
+  RallyCheckpoint cp[MAX_CP];
+  int count = 0;
+
+  bool active()   const { return count >= 2; }
+  bool started()  const { return _next > 0; }
+  bool finished() const { return _next >= count; }
+  int  next()     const { return _next; }
+  float odometerM() const { return _odoM; }
+
+  bool add(const RallyCheckpoint& c) {
+    if (count >= MAX_CP) return false;
+    cp[count++] = c;
+    return true;
+  }
+
+  void reset() {
+    _next = 0;
+    _hasPrev = false;
+    _odoM = 0.0f;
+    _startMs = 0;
+  }
+
+  // フィックス1回ぶんの処理。CP を通過したら out に入れて true
+  bool onFix(geo::Vec2 p, uint32_t nowMs, float kmph, RallyCrossing& out) {
+    bool crossed = false;
+
+    if (_hasPrev && !finished()) {
+      float seg = geo::length(p - _prev);
+      if (started() && kmph >= STOP_KMH && seg < MAX_STEP_M) _odoM += seg;
+
+      const RallyCheckpoint& c = cp[_next];
+      const geo::Vec2 line = c.b - c.a;
+      float t;
+      if (geo::cross(line, p - _prev) * geo::cross(line, routeDir(_next)) > 0.0f &&
+          geo::segmentCross(_prev, p, c.a, c.b, t)) {
+        // フィックス間で線形補間した通過時刻
+        uint32_t at = _prevMs + (uint32_t)(t * (float)(nowMs - _prevMs) + 0.5f);
+        if (_next == 0) _startMs = at;
+
+        out.index    = _next;
+        out.actualMs = (int32_t)(at - _startMs);
+        out.targetMs = c.targetMs;
+
+        // CP でルート距離に同期（オドメータの誤差を消す）
+        _odoM = c.distM + seg * (1.0f - t);
+        ++_next;
+        crossed = true;
+      }
+    }
+
+    _prev = p;
+    _prevMs = nowMs;
+    _hasPrev = true;
+    return crossed;
+  }
+
+  // 現在距離での理想時刻（直前 CP と次 CP の間で補間）
+  int32_t idealMs() const {
+    if (!started() || finished()) return 0;
+    const RallyCheckpoint& a = cp[_next - 1];
+    const RallyCheckpoint& b = cp[_next];
+    float span = b.distM - a.distM;
+    float r = (span > 0.0f) ? (_odoM - a.distM) / span : 0.0f;
+    if (r < 0.0f) r = 0.0f;
+    if (r > 1.0f) r = 1.0f;
+    return a.targetMs + (int32_t)(r * (float)(b.targetMs - a.targetMs));
+  }
+
+  // 理想スケジュールとの差（+:遅れ / -:先行）
+  int32_t aheadBehindMs(uint32_t nowMs) const {
+    if (!started() || finished()) return 0;
+    return (int32_t)(nowMs - _startMs) - idealMs();
+  }
+
+  uint32_t elapsedMs(uint32_t nowMs) const {
+    return started() ? nowMs - _startMs : 0;
+  }
+
+private:
+  static geo::Vec2 mid(const RallyCheckpoint& c) { return (c.a + c.b) * 0.5f; }
+
+  // CP i でのルートの向き（次の CP へ。最後の CP は前の CP から）
+  geo::Vec2 routeDir(int i) const {
+    return i + 1 < count ? mid(cp[i + 1]) - mid(cp[i]) : mid(cp[i]) - mid(cp[i - 1]);
+  }
+
+  int       _next = 0;
+  bool      _hasPrev = false;
+  geo::Vec2 _prev;
+  uint32_t  _prevMs = 0;
+  uint32_t  _startMs = 0;
+  float     _odoM = 0.0f;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "TrackModel.h"
+
+/* =========================================================
+   基準ラップ（PB の周をコース上の距離 → 経過時間の表にしたもの）
+   - 中心線の距離ビン境界ごとの経過 ms（境界 0 = 計測原点 = 0 ms, 境界 bins = ラップタイム）
+   - 境界の間は線形補間。引くのは添字計算だけ（探索なし）
+   - ファイル = RefLapHeader + uint32_t[bins + 1]
+   ========================================================= */
+struct RefLapHeader {
+  char     magic[4] = { 'R', 'E', 'F', '1' };
+  uint16_t version = 1;
+  uint16_t bins = 0;
+  float    binM = TRACK_BIN_M;
+  uint32_t lapMs = 0;
+  uint32_t trackId = 0;
+};
+static_assert(sizeof(RefLapHeader) == 20, "RefLapHeader layout");
+
+class RefLap {
+public:
+  static constexpr int MAX_BINS = TrackModel::MAX_BINS;
+
+  bool valid() const { return _h.bins > 0; }
+  void clear() { _h = RefLapHeader(); }
+
+  const RefLapHeader& header() const { return _h; }
+  const uint32_t* table() const { return _t; }
+  size_t tableBytes() const { return sizeof(uint32_t) * (_h.bins + 1); }
+  uint32_t lapMs() const { return _h.lapMs; }
+
+  // 読込み：ヘッダを確かめてから table に直接読ませる
+  uint32_t* beginLoad(const RefLapHeader& h) {
+    if (memcmp(h.magic, "REF1", 4) != 0 || h.bins < 1 || h.bins > MAX_BINS) {
+      clear();
+      return nullptr;
+    }
+    _h = h;
+    return _t;
+  }
+
+  // 距離 d(m) までの経過 ms
+  uint32_t elapsedAt(float d) const {
+    if (!valid() || d <= 0) return 0;
+    float f = d / _h.binM;
+    int k = (int)f;
+    if (k >= _h.bins) return _h.lapMs;
+    return _t[k] + (uint32_t)((_t[k + 1] - _t[k]) * (f - k));
+  }
+  uint32_t remainingAt(float d) const { return _h.lapMs - elapsedAt(d); }
+
+  // 1周ぶんのサンプル（Ring は TelemetryRing）から作る
+  //   startMs = 計測線を通過した時刻, lapMs = ラップタイム
+  //   計測線の手前（距離がコース長の後半）で始まるサンプルは読み飛ばす
+  template <class Ring>
+  bool build(const Ring& r, size_t from, size_t to, uint32_t startMs, uint32_t lapMs,
+             int bins, float binM, uint32_t trackId) {
+    clear();
+    if (bins < 1 || bins > MAX_BINS || lapMs == 0) return false;
+    const float L = bins * binM;
+
+    float pd = 0, pe = 0;   // 直前の距離と経過（始点は計測線）
+    int k = 1;              // 次に埋める境界
+    int filled = 0;
+    bool started = false;
+    _t[0] = 0;
+    for (size_t i = from; i < to && k < bins; ++i) {
+      if (!r.onTrack(i)) continue;
+      const float d = r.distM(i);
+      const float e = (float)(r.ms(i) - startMs);
+      if (!started) {
+        if (d > L * 0.5f) continue;
+        started = true;
+      }
+      if (d <= pd || e <= pe) continue;   // 後退・停止は使わない
+      for (; k < bins && k * binM <= d; ++k, ++filled) {
+        _t[k] = (uint32_t)(pe + (e - pe) * ((k * binM - pd) / (d - pd)));
+      }
+      pd = d;
+      pe = e;
+    }
+    // 最後のサンプルから計測線まで
+    for (; k < bins; ++k) _t[k] = (uint32_t)(pe + (lapMs - pe) * ((k * binM - pd) / (L - pd)));
+    _t[bins] = lapMs;
+
+    if (filled < bins * 9 / 10) return false;   // サンプルが足りない周は使わない
+    _h.bins = (uint16_t)bins;
+    _h.binM = binM;
+    _h.lapMs = lapMs;
+    _h.trackId = trackId;
+    return true;
+  }
+
+private:
+  RefLapHeader _h;
+  uint32_t _t[MAX_BINS + 1];
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "TrackModel.h"
+
+/* =========================================================
+   任意スタートのベストラップ（ローリングラップ）
+   - 中心線の距離ビン境界を通過した時刻を、周回をまたいだ通し番号 k で記録
+       T[k] = セッション開始から k 番目の境界を通過した時刻（累積＝前置和）
+   - 境界 k で終わる1周 = T[k] - T[k - bins]
+     → 新しい境界1つにつき O(1)、1周で O(bins)
+   - セッション最速と、直近 WINDOW_LAPS 周の中の最速（単調デックで窓内最小）
+   - メモリは T が1周ぶん、窓が WINDOW_LAPS 周ぶん（固定長）
+   ========================================================= */
+
+#ifndef ROLL_WINDOW_LAPS
+#define ROLL_WINDOW_LAPS 2
+#endif
+
+class RollingLap {
+public:
+  static constexpr int WINDOW_LAPS = ROLL_WINDOW_LAPS;
+  static constexpr int MAX_BINS    = TrackModel::MAX_BINS;
+  static constexpr int WIN_CAP     = WINDOW_LAPS * MAX_BINS;
+
+  void reset(int bins, float binM) {
+    _bins = bins;
+    _binM = binM;
+    _started = false;
+    _k = 0;
+    _best = 0;
+    _bestStart = -1;
+    _qHead = _qTail = 0;
+  }
+
+  // 前置和だけ取り直す（見失いからの復帰など）。セッション最速は残す
+  void restart() {
+    _started = false;
+    _qHead = _qTail;
+  }
+
+  int   bins()       const { return _bins; }
+  bool  valid()      const { return _bestStart >= 0; }
+  float bestS()      const { return _best / 1000.0f; }
+  float bestStartM() const { return _bestStart * _binM; }   // 最速周の起点（コース上の距離）
+
+  // 直近 WINDOW_LAPS 周の中での最速（無ければ 0）
+  float recentBestS() const {
+    return (_qHead != _qTail) ? _cand[_q[_qHead % WIN_CAP] % WIN_CAP] / 1000.0f : 0.0f;
+  }
+
+  // マッチしたフィックスごと（distM: コース上の距離 0〜コース長）
+  void onFix(float distM, uint32_t ms) {
+    if (_bins <= 0) return;
+    const float L = _bins * _binM;
+
+    if (!_started) {
+      _started = true;
+      _wraps = 0;
+      _pos = distM;
+      _ms = ms;
+      _k = (uint32_t)(distM / _binM) + 1;   // 次に通る境界
+      _k0 = _k;
+      return;
+    }
+
+    // 通しの位置（周回をまたいで連続）
+    float d = distM + _wraps * L;
+    if (d - _pos < -L * 0.5f) { ++_wraps; d += L; }
+    else if (d - _pos > L * 0.5f) { --_wraps; d -= L; }
+
+    // 後退・ジャンプ（見失いからの復帰など）
+    if (d <= _pos) return;
+    if (d - _pos > L * 0.25f) {
+      restart();
+      return;
+    }
+
+    // 今回までに越えた境界の通過時刻を線形補間で埋める
+    for (float b = _k * _binM; b <= d; b = _k * _binM) {
+      push(_ms + (uint32_t)((ms - _ms) * ((b - _pos) / (d - _pos))));
+    }
+    _pos = d;
+    _ms = ms;
+  }
+
+private:
+  int      _bins = 0;
+  float    _binM = TRACK_BIN_M;
+  bool     _started = false;
+
+  int      _wraps = 0;      // 通しの位置を作るための周回補正
+  float    _pos = 0;        // 直前の通しの位置(m)
+  uint32_t _ms = 0;         // 直前の時刻
+  uint32_t _k0 = 0;         // 最初の境界番号
+  uint32_t _k = 0;          // 次の境界番号（通しの位置 = k × binM）
+
+  uint32_t _t[MAX_BINS + 1];   // 境界通過時刻（k % (bins+1)）
+  uint32_t _cand[WIN_CAP];     // k で終わる1周の時間（k % WIN_CAP）
+  uint32_t _q[WIN_CAP];        // 窓内最小の単調デック（k を保持）
+  uint32_t _qHead = 0, _qTail = 0;
+
+  uint32_t _best = 0;
+  int      _bestStart = -1;
+
+  void push(uint32_t t) {
+    const uint32_t k = _k++;
+    const uint32_t n = (uint32_t)_bins + 1;
+    _t[k % n] = t;
+    if (k - _k0 < (uint32_t)_bins) return;   // まだ1周ぶん無い
+
+    uint32_t lap = t - _t[(k - _bins) % n];
+
+    // セッション最速
+    if (_bestStart < 0 || lap < _best) {
+      _best = lap;
+      _bestStart = (int)((k - _bins) % _bins);
+    }
+
+    // 窓内最小：自分以上の値は二度と最小にならないので捨てる
+    _cand[k % WIN_CAP] = lap;
+    while (_qTail != _qHead && _cand[_q[(_qTail - 1) % WIN_CAP] % WIN_CAP] >= lap) --_qTail;
+    _q[_qTail++ % WIN_CAP] = k;
+    const uint32_t w = (uint32_t)(WINDOW_LAPS * _bins);
+    while (k - _q[_qHead % WIN_CAP] >= w) ++_qHead;
+  }
+};
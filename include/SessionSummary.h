@@ -0,0 +1,123 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+#include "TrackModel.h"
+
+/* =========================================================
+   セッションのまとめ（ラップ確定・フィックスごとに足し込むだけ。ログは読み直さない）
+   - 周回数・ベスト・理論ベスト（区間ごとの最速の和）・平均・ばらつき（標準偏差）・
+     最高速（セッション / ベストラップ）・走行距離・走行時間
+   - 表示・記録は今の値を読むだけ（O(1)）
+   - 始まり：MOVE_KMH 以上で動き出した時。終わり：停車が SESSION_IDLE_S 秒続いた時
+     （終わったまとめは次のセッションが始まるまで残す）
+   ========================================================= */
+
+#ifndef SESSION_IDLE_S
+#define SESSION_IDLE_S 120
+#endif
+
+class SessionSummary {
+public:
+  static constexpr float    MOVE_KMH = 10.0f, STOP_KMH = 3.0f;
+  static constexpr float    MAX_STEP_M = 200.0f;   // これ以上の飛びは距離に入れない（原点の付け替え等）
+  static constexpr uint32_t IDLE_MS = SESSION_IDLE_S * 1000UL;
+
+  void reset() { *this = SessionSummary(); }
+
+  // フィックスごと（平面座標 m）。このフィックスでセッションが終わったら true
+  bool onFix(uint32_t ms, float xM, float yM, float kmph) {
+    if (!_active) {
+      if (kmph < MOVE_KMH) return false;
+      reset();
+      _active = true;
+      _startMs = ms;
+    } else if (_hasPos) {
+      const float dx = xM - _px, dy = yM - _py;
+      const float d = sqrtf(dx * dx + dy * dy);
+      if (d < MAX_STEP_M) _distM += d;
+    }
+    _px = xM;
+    _py = yM;
+    _hasPos = true;
+    _lastMs = ms;
+    if (kmph > _top) _top = kmph;
+
+    if (kmph >= STOP_KMH) {
+      _stopMs = 0;
+    } else if (_stopMs == 0) {
+      _stopMs = ms ? ms : 1;
+    } else if (ms - _stopMs >= IDLE_MS) {
+      _active = false;
+      _closed = true;
+      _lastMs = _stopMs;
+      return true;
+    }
+    return false;
+  }
+
+  void onLap(int num, float lapS, float topKmph, int sectors, const float* sector) {
+    if (!_active) {   // 止まったまま手動で計測を始めた等
+      const uint32_t t = _lastMs;
+      reset();
+      _active = true;
+      _startMs = _lastMs = t;
+    }
+    ++_laps;
+    const double d = lapS - _mean;
+    _mean += d / _laps;
+    _m2 += d * (lapS - _mean);
+
+    if (_best <= 0 || lapS < _best) {
+      _best = lapS;
+      _bestNum = num;
+      _bestTop = topKmph;
+    }
+
+    // 区間数が変わったら理論ベストは出さない（区間なしの周＝取れなかった周は数えない）
+    if (sectors <= 0 || _sectors < 0) return;
+    if (_sectors == 0) _sectors = sectors;
+    if (sectors != _sectors) {
+      _sectors = -1;
+    } else {
+      for (int i = 0; i < sectors; ++i) {
+        if (sector[i] > 0 && (_secBest[i] <= 0 || sector[i] < _secBest[i])) _secBest[i] = sector[i];
+      }
+    }
+  }
+
+  bool     active() const { return _active; }
+  bool     closed() const { return _closed; }
+  int      laps() const { return _laps; }
+  float    best() const { return _best; }
+  int      bestNum() const { return _bestNum; }
+  float    average() const { return _laps ? (float)_mean : 0; }
+  float    sd() const { return _laps > 1 ? (float)sqrt(_m2 / (_laps - 1)) : 0; }
+  float    cvPct() const { return _mean > 0 ? sd() / (float)_mean * 100.0f : 0; }
+  float    topKmph() const { return _top; }
+  float    bestLapTopKmph() const { return _bestTop; }
+  float    distanceM() const { return _distM; }
+  uint32_t durationS() const { return (_active || _closed) ? (_lastMs - _startMs) / 1000 : 0; }
+
+  // 区間ごとの最速の和（区間が無い・そろっていなければ 0）
+  float theoreticalBest() const {
+    if (_sectors <= 0) return 0;
+    float s = 0;
+    for (int i = 0; i < _sectors; ++i) {
+      if (_secBest[i] <= 0) return 0;
+      s += _secBest[i];
+    }
+    return s;
+  }
+
+private:
+  bool     _active = false, _closed = false, _hasPos = false;
+  uint32_t _startMs = 0, _lastMs = 0, _stopMs = 0;
+  float    _px = 0, _py = 0, _distM = 0, _top = 0;
+
+  int      _laps = 0, _bestNum = 0, _sectors = 0;
+  float    _best = 0, _bestTop = 0;
+  double   _mean = 0, _m2 = 0;   // 平均と偏差平方和（Welford）
+  float    _secBest[TRACK_MAX_SECTORS] = {};
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+/* =========================================================
+   単一生産者／単一消費者のロックフリー・キュー（ByteRing の要素版）
+   - 要素はポインタ等の小さな値。まとまったデータはバッチにしてポインタで渡す
+   - tryPush / tryPop は待たない（待ち方は呼び出し側で決める）
+   - N は 2 の冪
+   ========================================================= */
+template <class T, size_t N>
+class SpscQueue {
+  static_assert((N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+  static constexpr size_t capacity() { return N; }
+  size_t size() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+
+  bool tryPush(const T& v) {
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) == N) return false;
+    _buf[head & (N - 1)] = v;
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop(T& v) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    if (_head.load(std::memory_order_acquire) == tail) return false;
+    v = _buf[tail & (N - 1)];
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  T _buf[N];
+  alignas(64) std::atomic<size_t> _head{ 0 };   // 生産者と消費者で別のキャッシュラインに置く
+  alignas(64) std::atomic<size_t> _tail{ 0 };
+};
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include <LittleFS.h>
+#include <SD.h>
+
+#include "AsyncLog.h"
+
+/* =========================================================
+   保存先の切替え（端末専用）
+   - ログ  : 通常は SD。SD が無い／抜けた間は内蔵フラッシュ(LittleFS)へ
+             SD が戻ったらフラッシュに溜めた分を SD へ追記して消す（移行）
+   - 設定  : route.csv は SD が正。読めたらフラッシュへ写し、SD が無い時はその写しを使う
+   - キャッシュ: track.bin は常にフラッシュ（起動時に SD を待たない）。SD があれば複製も置く
+   - SD の再検出は停車中だけ（SD.begin() が数百 ms 止まるので走行中はやらない）
+   - SD に書く非同期ログ（addWriter）は SD.end() の前に止め、SD.begin() が通ったら再開する
+     （別コアの書込みタスクが外したカードのファイルを触らないように）
+   ========================================================= */
+class Storage {
+public:
+  using File = fs::File;
+
+  static constexpr uint32_t RETRY_MS = 3000;   // SD 再検出の間隔
+  static constexpr int      MAX_LOGS = 8;
+  static constexpr int      MAX_WRITERS = 2;
+
+  void begin() {
+    _flash = LittleFS.begin(true);   // 初回はフォーマット
+    _sd = SD.begin();
+    if (_sd) migrate();
+  }
+
+  // 追記ログとして扱うファイル（移行対象）。いっぱいなら false（そのログはフラッシュに残ったまま）
+  bool addLog(const char* path) {
+    if (_logs >= MAX_LOGS) return false;
+    _log[_logs++] = path;
+    return true;
+  }
+
+  // SD に書く非同期ログ（begin 済みのもの）。いっぱいなら false
+  bool addWriter(AsyncLogBase& w) {
+    if (_writers >= MAX_WRITERS) return false;
+    _writer[_writers++] = &w;
+    if (!_sd) w.pause();
+    return true;
+  }
+
+  bool sd()    const { return _sd; }
+  bool flash() const { return _flash; }
+
+  // 画面表示用（"SD" / "FL" / "--"）
+  const char* label() const { return _sd ? "SD" : (_flash ? "FL" : "--"); }
+
+  /* ---------- ログ ---------- */
+
+  // 追記で開く。SD が開けなければ抜けたとみなしてフラッシュへ
+  File openLog(const char* path) {
+    if (_sd) {
+      File f = SD.open(path, FILE_APPEND);
+      if (f) return f;
+      lostSd();
+    }
+    if (_flash) return LittleFS.open(path, FILE_APPEND);
+    return File();
+  }
+
+  // ループから呼ぶ。SD が無い間、停車中に再検出して戻ったら移行
+  void poll(uint32_t nowMs, bool idle) {
+    if (_sd || !idle || nowMs - _lastTry < RETRY_MS) return;
+    _lastTry = nowMs;
+    pauseWriters();   // lostSd() で止めてあるが、念のため
+    SD.end();
+    _sd = SD.begin();
+    if (_sd) migrate();
+    if (_sd) {
+      for (int i = 0; i < _writers; ++i) _writer[i]->resume();
+    }
+  }
+
+  /* ---------- 設定（SD が正） ---------- */
+
+  File openConfig(const char* path) {
+    if (_sd) {
+      if (!SD.exists(path)) {
+        if (_flash && LittleFS.exists(path)) LittleFS.remove(path); // SD から消したら写しも消す
+        return File();
+      }
+      if (_flash) copy(SD, LittleFS, path, FILE_WRITE);
+      return SD.open(path, FILE_READ);
+    }
+    if (_flash && LittleFS.exists(path)) return LittleFS.open(path, FILE_READ);
+    return File();
+  }
+
+  /* ---------- キャッシュ（フラッシュが正） ---------- */
+
+  File openCache(const char* path) {
+    if (_flash) {
+      // 旧版で SD にだけあるものは初回に取り込む
+      if (!LittleFS.exists(path) && _sd && SD.exists(path)) copy(SD, LittleFS, path, FILE_WRITE);
+      if (LittleFS.exists(path)) return LittleFS.open(path, FILE_READ);
+      return File();
+    }
+    return _sd ? SD.open(path, FILE_READ) : File();
+  }
+
+  File createCache(const char* path) {
+    if (_flash) return LittleFS.open(path, FILE_WRITE);
+    return _sd ? SD.open(path, FILE_WRITE) : File();
+  }
+
+  // createCache で一時ファイルに書き終えてから本物へ置き換える
+  // （書きかけで電源が落ちても前のものが残る。上書き rename が通らない FS では消してから）
+  bool replaceCache(const char* tmp, const char* path) {
+    if (!_flash && !_sd) return false;
+    fs::FS& fs = _flash ? (fs::FS&)LittleFS : (fs::FS&)SD;
+    if (fs.rename(tmp, path)) return true;
+    fs.remove(path);
+    return fs.rename(tmp, path);
+  }
+
+  // createCache で書いた後に呼ぶ：SD にも複製（PC で取り出せるように）
+  void mirror(const char* path) {
+    if (_flash && _sd && !copy(LittleFS, SD, path, FILE_WRITE)) lostSd();
+  }
+
+  /* ---------- ベンチマーク（同じ fs::FS 経由で SD とフラッシュを比べる） ---------- */
+
+  void bench(Print& out) {
+    if (_sd)    benchFs(SD, "SD", out);
+    if (_flash) benchFs(LittleFS, "LittleFS", out);
+  }
+
+private:
+  bool        _sd = false;
+  bool        _flash = false;
+  uint32_t    _lastTry = 0;
+  const char* _log[MAX_LOGS];
+  int         _logs = 0;
+  AsyncLogBase* _writer[MAX_WRITERS];
+  int         _writers = 0;
+
+  void pauseWriters() {
+    for (int i = 0; i < _writers; ++i) _writer[i]->pause();
+  }
+
+  void lostSd() {
+    pauseWriters();
+    _sd = false;
+    SD.end();
+  }
+
+  // フラッシュに溜まったログを SD へ追記。全部書けたものだけ消す
+  void migrate() {
+    if (!_flash) return;
+    for (int i = 0; i < _logs; ++i) {
+      if (!LittleFS.exists(_log[i])) continue;
+      if (!copy(LittleFS, SD, _log[i], FILE_APPEND)) {
+        lostSd();
+        return;
+      }
+      LittleFS.remove(_log[i]);
+    }
+  }
+
+  static bool copy(fs::FS& from, fs::FS& to, const char* path, const char* mode) {
+    File src = from.open(path, FILE_READ);
+    if (!src) return false;
+    File dst = to.open(path, mode);
+    if (!dst) return false;
+
+    uint8_t buf[512];
+    bool ok = true;
+    for (;;) {
+      size_t n = src.read(buf, sizeof(buf));
+      if (n == 0) break;
+      if (dst.write(buf, n) != n) {
+        ok = false;
+        break;
+      }
+    }
+    dst.close();
+    src.close();
+    return ok;
+  }
+
+  // 連続書込み（ジャーナル相当）・読出し・1行追記（ラップログ相当）の速度と最悪遅延
+  static void benchFs(fs::FS& fs, const char* name, Print& out) {
+    const char* path = "/bench.tmp";
+    const size_t CHUNK = 512, TOTAL = 64 * 1024;
+    uint8_t buf[CHUNK];
+    memset(buf, 0x5A, sizeof(buf));
+
+    uint32_t worst = 0;
+    uint32_t t0 = micros();
+    File f = fs.open(path, FILE_WRITE);
+    for (size_t done = 0; f && done < TOTAL; done += CHUNK) {
+      uint32_t t = micros();
+      f.write(buf, CHUNK);
+      uint32_t d = micros() - t;
+      if (d > worst) worst = d;
+    }
+    if (f) f.close();
+    uint32_t wUs = micros() - t0;
+
+    t0 = micros();
+    f = fs.open(path, FILE_READ);
+    while (f && f.read(buf, CHUNK) > 0) {}
+    if (f) f.close();
+    uint32_t rUs = micros() - t0;
+
+    // open → 1行追記 → close を 20 回
+    uint32_t lineWorst = 0, lineSum = 0;
+    for (int i = 0; i < 20; ++i) {
+      uint32_t t = micros();
+      f = fs.open(path, FILE_APPEND);
+      if (f) {
+        f.println("12,61.234,112.5,2026/10/18-12:34:56,0.071");
+        f.close();
+      }
+      uint32_t d = micros() - t;
+      lineSum += d;
+      if (d > lineWorst) lineWorst = d;
+    }
+    fs.remove(path);
+
+    out.printf("[%s] write %.0f KB/s (worst %lu us/512B), read %.0f KB/s, lap line avg %lu us / worst %lu us\n",
+               name,
+               TOTAL / 1024.0 / (wUs / 1e6), (unsigned long)worst,
+               TOTAL / 1024.0 / (rUs / 1e6),
+               (unsigned long)(lineSum / 20), (unsigned long)lineWorst);
+  }
+};
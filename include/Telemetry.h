@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* =========================================================
+   直近 N 分のフィックスを RAM に持つリング（構造体の配列ではなく配列の構造体）
+   - チャンネルごとに別配列：1チャンネルだけ走査する時はその配列だけ読む
+   - 固定小数点で詰める（1サンプル 14 B）
+       時刻 ms(u32) / x,y 0.25 m(i16, ±8 km) / 速度 0.01 km/h(u16) / コース距離 0.5 m(u16) / 周回(u16)
+   - 時刻と周回は単調増加なので二分探索で範囲が引ける（SD を読まない）
+   - 論理番号 0 = 最古。リングをまたぐ範囲は spans() で連続な2区間に分けて渡す
+   ========================================================= */
+template <size_t CAP>
+class TelemetryRing {
+public:
+  static constexpr size_t   BYTES_PER_SAMPLE = 4 + 2 + 2 + 2 + 2 + 2;
+  static constexpr size_t   BYTES = CAP * BYTES_PER_SAMPLE;
+  static constexpr uint16_t NO_DIST = 0xFFFF;   // コースに乗っていない
+
+  void clear() { _head = _n = 0; }
+  size_t size() const { return _n; }
+  static constexpr size_t capacity() { return CAP; }
+
+  void push(uint32_t ms, float xM, float yM, float kmph, float distM, bool onTrack, uint16_t lap) {
+    const size_t i = _head;
+    _t[i]    = ms;
+    _x[i]    = q16(xM * 4.0f);
+    _y[i]    = q16(yM * 4.0f);
+    _v[i]    = (uint16_t)clampf(kmph * 100.0f + 0.5f, 0.0f, 65535.0f);
+    _d[i]    = onTrack ? (uint16_t)clampf(distM * 2.0f + 0.5f, 0.0f, 65534.0f) : NO_DIST;
+    _lap[i]  = lap;
+    _head = (_head + 1) % CAP;
+    if (_n < CAP) ++_n;
+  }
+
+  /* ---------- 1サンプル（論理番号） ---------- */
+  uint32_t ms(size_t i)    const { return _t[phys(i)]; }
+  float    xM(size_t i)    const { return _x[phys(i)] * 0.25f; }
+  float    yM(size_t i)    const { return _y[phys(i)] * 0.25f; }
+  float    kmph(size_t i)  const { return _v[phys(i)] * 0.01f; }
+  bool     onTrack(size_t i) const { return _d[phys(i)] != NO_DIST; }
+  float    distM(size_t i) const { return _d[phys(i)] * 0.5f; }
+  uint16_t lap(size_t i)   const { return _lap[phys(i)]; }
+
+  /* ---------- 範囲 ---------- */
+  // ms 以降の最初のサンプル（無ければ size()）
+  size_t lowerBoundMs(uint32_t ms) const {
+    if (_n == 0) return 0;
+    const uint32_t base = _t[phys(0)];
+    if ((int32_t)(ms - base) <= 0) return 0;   // 窓より前
+    return lowerBound([&](size_t i) { return _t[phys(i)] - base < ms - base; });
+  }
+
+  // 周回 lap のサンプル [from, to)。窓に無ければ false
+  bool lapRange(uint16_t lap, size_t& from, size_t& to) const {
+    from = lowerBound([&](size_t i) { return _lap[phys(i)] < lap; });
+    to   = lowerBound([&](size_t i) { return _lap[phys(i)] <= lap; });
+    return from < to;
+  }
+
+  // [from, to) を物理配列上の連続区間（最大2つ）で f(start, count) に渡す
+  template <class F>
+  void spans(size_t from, size_t to, F f) const {
+    if (to > _n) to = _n;
+    if (from >= to) return;
+    const size_t p = phys(from), n = to - from;
+    const size_t first = (p + n <= CAP) ? n : CAP - p;
+    f(p, first);
+    if (first < n) f((size_t)0, n - first);
+  }
+
+  // チャンネル配列（spans と組み合わせて直接走査する）
+  const uint32_t* msData()    const { return _t; }
+  const int16_t*  xData()     const { return _x; }
+  const int16_t*  yData()     const { return _y; }
+  const uint16_t* speedData() const { return _v; }
+  const uint16_t* distData()  const { return _d; }
+  const uint16_t* lapData()   const { return _lap; }
+
+  // 例：範囲内の最高速（速度の配列だけを読む）
+  float maxKmph(size_t from, size_t to) const {
+    uint16_t m = 0;
+    spans(from, to, [&](size_t p, size_t n) {
+      for (const uint16_t* v = _v + p; v != _v + p + n; ++v)
+        if (*v > m) m = *v;
+    });
+    return m * 0.01f;
+  }
+
+private:
+  uint32_t _t[CAP];
+  int16_t  _x[CAP], _y[CAP];
+  uint16_t _v[CAP], _d[CAP], _lap[CAP];
+  size_t   _head = 0, _n = 0;
+
+  size_t phys(size_t i) const { return (_head + CAP - _n + i) % CAP; }
+
+  // less(i) が true の間の個数（less は単調）
+  template <class Less>
+  size_t lowerBound(Less less) const {
+    size_t lo = 0, hi = _n;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (less(mid)) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo;
+  }
+
+  static float clampf(float v, float lo, float hi) { return v < lo ? lo : (v > hi ? hi : v); }
+  static int16_t q16(float v) {
+    return (int16_t)clampf(v + (v >= 0 ? 0.5f : -0.5f), -32768.0f, 32767.0f);
+  }
+};
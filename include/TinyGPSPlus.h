@@ -0,0 +1,385 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* =========================================================
+   TinyGPS++ 互換っぽい “最小” 自力実装
+   - TinyGPSPlusT<Sink, Sentences...>
+       Sink      : 解析結果の出力先（onTime/onLocation 等を持つ型）
+       Sentences : 受理する文ハンドラ（コンパイル時リスト）
+   - 文タイプ（末尾3文字）→ハンドラはコンパイル時に作る完全ハッシュ表で分岐
+     リストに無い文のパーサはインスタンス化されない
+   - Arduino 非依存（ホストツールからもそのまま使う）
+   ========================================================= */
+
+namespace nmea {
+
+// "RMC" → 0x524D43（文タイプ末尾3文字を24bitに詰める）
+constexpr uint32_t tag3(const char* s) {
+  return ((uint32_t)(uint8_t)s[0] << 16) | ((uint32_t)(uint8_t)s[1] << 8) | (uint32_t)(uint8_t)s[2];
+}
+
+inline uint8_t hexNibble(char ch) {
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  return 0;
+}
+
+inline uint8_t hex2byte(const char* p) {
+  return (uint8_t)((hexNibble(p[0]) << 4) | hexNibble(p[1]));
+}
+
+// ddmm.mmmm or dddmm.mmmm → deg
+inline double toDeg(const char* s) {
+  if (!s || !*s) return 0.0;
+  double v = atof(s);
+  int deg = (int)(v / 100.0);
+  double minutes = v - (deg * 100.0);
+  return (double)deg + minutes / 60.0;
+}
+
+// hhmmss[.ss]（小数部は 1/100 秒まで）
+inline bool parseTime(const char* s, int& h, int& m, int& sec, int& cs) {
+  if (!s || strlen(s) < 6) return false;
+  h   = (s[0] - '0') * 10 + (s[1] - '0');
+  m   = (s[2] - '0') * 10 + (s[3] - '0');
+  sec = (s[4] - '0') * 10 + (s[5] - '0');
+  cs  = 0;
+  if (s[6] == '.' && s[7] >= '0' && s[7] <= '9') {
+    cs = (s[7] - '0') * 10;
+    if (s[8] >= '0' && s[8] <= '9') cs += s[8] - '0';
+  }
+  return true;
+}
+
+// ddmmyy（80-99 は 1900台、それ以外は 2000台に寄せる）
+inline bool parseDate(const char* s, int& y, int& mo, int& d) {
+  if (!s || strlen(s) < 6) return false;
+  d  = (s[0] - '0') * 10 + (s[1] - '0');
+  mo = (s[2] - '0') * 10 + (s[3] - '0');
+  int yy = (s[4] - '0') * 10 + (s[5] - '0');
+  y = (yy >= 80) ? (1900 + yy) : (2000 + yy);
+  return true;
+}
+
+inline bool parseLatLon(const char* lat, const char* ns, const char* lon, const char* ew,
+                        double& la, double& lo) {
+  if (!lat || !*lat || !lon || !*lon) return false;
+  la = toDeg(lat);
+  lo = toDeg(lon);
+  if (ns && *ns == 'S') la = -la;
+  if (ew && *ew == 'W') lo = -lo;
+  return true;
+}
+
+/* ---------- 文ハンドラ ----------
+   tag と parse(Sink&, fields, n) を持つ型なら何でも良い */
+
+struct RMC {
+  static constexpr uint32_t tag = tag3("RMC");
+
+  // $..RMC, time, status, lat, N/S, lon, E/W, speed(knots), course, date, ...
+  template <class Sink>
+  static void parse(Sink& s, char** f, int n) {
+    if (n < 10) return;
+    if (f[2][0] != 'A') return; // A=valid
+
+    int h, m, sec, cs;
+    if (parseTime(f[1], h, m, sec, cs)) s.onTime(h, m, sec, cs);
+
+    double la, lo;
+    if (parseLatLon(f[3], f[4], f[5], f[6], la, lo)) s.onLocation(la, lo);
+
+    s.onSpeedKnots(*f[7] ? atof(f[7]) : 0.0);
+    if (*f[8]) s.onCourse(atof(f[8]));
+
+    int y, mo, d;
+    if (parseDate(f[9], y, mo, d)) s.onDate(y, mo, d);
+
+    s.onFix(); // RMC をエポックの確定とみなす
+  }
+};
+
+struct GGA {
+  static constexpr uint32_t tag = tag3("GGA");
+
+  // $..GGA, time, lat, N/S, lon, E/W, fixq, sats, hdop, alt(m), ...
+  template <class Sink>
+  static void parse(Sink& s, char** f, int n) {
+    if (n < 10) return;
+
+    int h, m, sec, cs;
+    if (parseTime(f[1], h, m, sec, cs)) s.onTime(h, m, sec, cs);
+
+    double la, lo;
+    if (parseLatLon(f[2], f[3], f[4], f[5], la, lo)) s.onLocation(la, lo);
+
+    if (*f[7]) s.onSatellites(atoi(f[7]));
+    if (*f[8]) s.onHdop(atof(f[8]));
+    if (*f[9]) s.onAltitude(atof(f[9]));
+  }
+};
+
+struct GST {
+  static constexpr uint32_t tag = tag3("GST");
+
+  // $..GST, time, rms, smaj, smin, orient, lat err(m), lon err(m), alt err(m)
+  template <class Sink>
+  static void parse(Sink& s, char** f, int n) {
+    if (n < 8 || !*f[6] || !*f[7]) return;
+    double la = atof(f[6]);
+    double lo = atof(f[7]);
+    s.onAccuracy(sqrt(la * la + lo * lo));
+  }
+};
+
+} // namespace nmea
+
+/* =========================================================
+   既定の出力先：TinyGPS++ と同じ gps.location.lat() 形式で保持
+   ========================================================= */
+struct GpsData {
+  struct Location {
+    double _lat = 0.0, _lng = 0.0;
+    double lat() const { return _lat; }
+    double lng() const { return _lng; }
+  } location;
+
+  struct Date {
+    int _year = 0, _month = 0, _day = 0;
+    int year()  const { return _year;  }
+    int month() const { return _month; }
+    int day()   const { return _day;   }
+  } date;
+
+  struct Time {
+    int _hour = 0, _minute = 0, _second = 0, _centisecond = 0;
+    int hour()        const { return _hour;        }
+    int minute()      const { return _minute;      }
+    int second()      const { return _second;      }
+    int centisecond() const { return _centisecond; }
+  } time;
+
+  struct Speed {
+    double _kmph = 0.0;
+    double kmph() const { return _kmph; }
+  } speed;
+
+  struct Altitude {
+    double _meters = 0.0;
+    double meters() const { return _meters; }
+  } altitude;
+
+  struct Satellites {
+    int _value = 0;
+    int value() const { return _value; }
+  } satellites;
+
+  struct Course {
+    double _deg = 0.0;
+    double deg() const { return _deg; }
+  } course;
+
+  struct Hdop {
+    double _value = 0.0;
+    double hdop() const { return _value; }
+  } hdop;
+
+  // 水平位置精度 1σ（GST がある受信機のみ。0 は不明）
+  struct Accuracy {
+    double _meters = 0.0;
+    double meters() const { return _meters; }
+  } accuracy;
+
+  uint32_t _fixCount = 0;
+  uint32_t fixCount() const { return _fixCount; }
+
+  void onTime(int h, int m, int s, int cs)  { time._hour = h; time._minute = m; time._second = s; time._centisecond = cs; }
+  void onDate(int y, int m, int d)          { date._year = y; date._month = m; date._day = d; }
+  void onLocation(double la, double lo)     { location._lat = la; location._lng = lo; }
+  void onSpeedKnots(double kn)              { speed._kmph = kn * 1.852; }
+  void onAltitude(double m)                 { altitude._meters = m; }
+  void onSatellites(int n)                  { satellites._value = n; }
+  void onCourse(double deg)                 { course._deg = deg; }
+  void onHdop(double v)                     { hdop._value = v; }
+  void onAccuracy(double m)                 { accuracy._meters = m; }
+  void onFix()                              { ++_fixCount; }
+};
+
+/* =========================================================
+   パーサ本体
+   - encode(c) で1文字ずつ投入
+   - 受理した文を Sentences の該当ハンドラへ渡す
+   - distanceBetween() はハバースイン
+   ========================================================= */
+template <class Sink, class... Sentences>
+class TinyGPSPlusT : public Sink {
+  static_assert(sizeof...(Sentences) > 0, "at least one sentence handler is required");
+
+public:
+  bool encode(char c) {
+    if (c == '\r') return false;
+
+    if (c == '$') {
+      _idx = 0;
+      _buf[_idx++] = c;
+      _buf[_idx] = '\0';
+      return false;
+    }
+
+    if (_idx < (int)sizeof(_buf) - 1) {
+      _buf[_idx++] = c;
+      _buf[_idx] = '\0';
+    }
+
+    if (c == '\n') {
+      parseLine(_buf);
+      _idx = 0;
+      return true;
+    }
+    return false;
+  }
+
+  Sink&       sink()       { return *this; }
+  const Sink& sink() const { return *this; }
+
+  // チェックサム検証済みの文（'$' の次から '*' の前まで）をそのまま解釈する
+  // （ホストの一括取込み用：検証は呼び出し側が済ませている）
+  void decodeBody(const char* body, size_t n) {
+    char line[sizeof(_buf)];
+    if (n >= sizeof(line)) return;
+    memcpy(line, body, n);
+    line[n] = '\0';
+    dispatch(line);
+  }
+
+  static double distanceBetween(double lat1, double lon1, double lat2, double lon2) {
+    // ハバースイン（m）
+    const double R = 6371000.0;
+    const double d2r = 0.017453292519943295; // pi/180
+
+    double p1 = lat1 * d2r;
+    double p2 = lat2 * d2r;
+    double dp = (lat2 - lat1) * d2r;
+    double dl = (lon2 - lon1) * d2r;
+
+    double a = sin(dp * 0.5) * sin(dp * 0.5) +
+               cos(p1) * cos(p2) * sin(dl * 0.5) * sin(dl * 0.5);
+    double c = 2.0 * atan2(sqrt(a), sqrt(1.0 - a));
+    return R * c;
+  }
+
+private:
+  /* ---------- コンパイル時完全ハッシュ ----------
+     slot = (tag * MUL) >> (32 - BITS)
+     BITS は要素数の 2 倍以上の 2 の冪、MUL は衝突しない奇数を探索して決める */
+  using Handler = void (*)(Sink&, char**, int);
+
+  static constexpr int      kCount = (int)sizeof...(Sentences);
+  static constexpr uint32_t kTags[kCount] = { Sentences::tag... };
+
+  static constexpr unsigned bitsFor(int n) {
+    unsigned b = 1;
+    while ((1 << b) < 2 * n) ++b;
+    return b;
+  }
+  static constexpr unsigned kBits = bitsFor(kCount);
+  static constexpr unsigned kSize = 1u << kBits;
+
+  static constexpr unsigned slotWith(uint32_t tag, uint32_t mul) {
+    return (uint32_t)(tag * mul) >> (32 - kBits);
+  }
+
+  static constexpr bool collisionFree(uint32_t mul) {
+    for (int i = 0; i < kCount; ++i)
+      for (int j = i + 1; j < kCount; ++j)
+        if (slotWith(kTags[i], mul) == slotWith(kTags[j], mul)) return false;
+    return true;
+  }
+
+  static constexpr uint32_t findMul() {
+    uint32_t mul = 0x9E3779B1u;
+    for (int tries = 0; tries < 4096; ++tries, mul += 2) {
+      if (collisionFree(mul)) return mul;
+    }
+    return 0;
+  }
+  static constexpr uint32_t kMul = findMul();
+  static_assert(kMul != 0, "duplicate sentence tags or no perfect hash found");
+
+  template <class S>
+  static void call(Sink& s, char** f, int n) { S::parse(s, f, n); }
+
+  struct Table {
+    uint32_t tag[kSize];
+    Handler  fn[kSize];
+  };
+
+  static constexpr Table buildTable() {
+    Table t{};
+    const Handler fns[kCount] = { &call<Sentences>... };
+    for (int i = 0; i < kCount; ++i) {
+      unsigned k = slotWith(kTags[i], kMul);
+      t.tag[k] = kTags[i];
+      t.fn[k]  = fns[i];
+    }
+    return t;
+  }
+  static constexpr Table kTable = buildTable();
+
+  static constexpr int kMaxFields = 24;
+
+  char _buf[160];
+  int  _idx = 0;
+
+  void parseLine(char* line) {
+    if (!line || line[0] != '$') return;
+
+    // チェックサム検証
+    char* body = line + 1;                 // '$'の次
+    char* ast  = strchr(body, '*');
+    if (!ast || (ast - body) <= 0) return;
+
+    uint8_t cs = 0;
+    for (char* p = body; p < ast; ++p) cs ^= (uint8_t)(*p);
+
+    if (strlen(ast) < 3) return;           // "*hh"
+    uint8_t sent = nmea::hex2byte(ast + 1);
+    if (cs != sent) return;
+
+    *ast = '\0'; // ここで文末を切る（チェックサム以降無視）
+    dispatch(body);
+  }
+
+  // '$' と '*' の間（NUL 終端）をフィールドに分けてハンドラへ
+  void dispatch(char* body) {
+    // CSV分割（空フィールドも1個として数える：strtok は ",," を潰すので使わない）
+    char* fields[kMaxFields];
+    int nf = 0;
+    char* p = body;
+    fields[nf++] = p;
+    while (*p && nf < kMaxFields) {
+      if (*p == ',') {
+        *p = '\0';
+        fields[nf++] = p + 1;
+      }
+      ++p;
+    }
+
+    // type末尾3文字で判定（GPRMC/GNRMC/GLRMC等をまとめて拾う）
+    const char* type = fields[0];
+    size_t len = strlen(type);
+    if (len < 3) return;
+
+    const uint32_t tag = nmea::tag3(type + (len - 3));
+    const unsigned k = slotWith(tag, kMul);
+    if (kTable.tag[k] == tag) kTable.fn[k](*this, fields, nf);
+  }
+};
+
+// 従来どおりの RMC/GGA 構成
+using TinyGPSPlus = TinyGPSPlusT<GpsData, nmea::RMC, nmea::GGA>;
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+
+/* =========================================================
+   長い時系列（セッション全体の速度など）を画面の幅に縮めて持つ
+   - 列は W 本まで。1列 = spanMs の時間で、その間の最小・最大（と印）だけ持つ
+   - 右端まで埋まったら隣り合う2列を1列にまとめて spanMs を倍にする
+     → 何時間走ってもメモリは W 列のまま。幅の半分〜全部を使う
+   - 最小・最大はまとめても正しい（ピークや落ち込みが消えない）ので、
+     間引きの「代表点を選ぶ」方式（LTTB 等）と違って縮め直しても形が崩れない
+   - サンプルの追加は O(1)（まとめ直しは倍になる時だけ O(W)）。描くのは列を読むだけ O(W)
+   - generation() はまとめ直しの回数。変わったら全体を描き直す
+   ========================================================= */
+template <int W, class T = float>
+class TraceSummary {
+public:
+  static_assert(W >= 2 && W % 2 == 0, "W must be even");
+
+  struct Col {
+    T       lo, hi;
+    uint8_t n;      // 0 = サンプル無し（それ以外は 1 で頭打ち。有無だけ見る）
+    uint8_t mark;   // 印（ラップの区切り等）
+  };
+
+  void reset(uint32_t t0Ms, uint32_t baseSpanMs = 100) {
+    _t0 = t0Ms;
+    _span = baseSpanMs ? baseSpanMs : 1;
+    _used = 0;
+    _gen = 0;
+    _hasMax = false;
+    for (int i = 0; i < W; ++i) _col[i] = Col{ T(), T(), 0, 0 };
+  }
+
+  void push(uint32_t tMs, T v) {
+    Col& c = _col[slot(tMs)];
+    if (!c.n) {
+      c.lo = c.hi = v;
+      c.n = 1;
+    } else {
+      if (v < c.lo) c.lo = v;
+      if (v > c.hi) c.hi = v;
+    }
+    if (!_hasMax || v > _max) _max = v;
+    _hasMax = true;
+  }
+
+  void mark(uint32_t tMs) { _col[slot(tMs)].mark = 1; }
+
+  int        used() const { return _used; }   // 使っている列数（最後の列の次）
+  const Col& col(int i) const { return _col[i]; }
+  uint32_t   spanMs() const { return _span; }
+  uint32_t   generation() const { return _gen; }
+  bool       hasMax() const { return _hasMax; }
+  T          maxValue() const { return _max; }
+
+  // 列 i を縦線で描く時の範囲。前の列とつなげるため、その範囲まで伸ばす
+  bool range(int i, T& lo, T& hi) const {
+    const Col& c = _col[i];
+    if (!c.n) return false;
+    lo = c.lo;
+    hi = c.hi;
+    if (i > 0 && _col[i - 1].n) {
+      const Col& p = _col[i - 1];
+      if (p.hi < lo) lo = p.hi;
+      if (p.lo > hi) hi = p.lo;
+    }
+    return true;
+  }
+
+private:
+  Col      _col[W];
+  uint32_t _t0 = 0, _span = 100, _gen = 0;
+  int      _used = 0;
+  T        _max = T();
+  bool     _hasMax = false;
+
+  // 時刻の列。右端を越えたら縮める
+  int slot(uint32_t tMs) {
+    uint32_t k = tMs > _t0 ? (tMs - _t0) / _span : 0;
+    while (k >= (uint32_t)W) {
+      halve();
+      k = (tMs - _t0) / _span;
+    }
+    if ((int)k >= _used) _used = (int)k + 1;
+    return (int)k;
+  }
+
+  void halve() {
+    for (int i = 0; i < W / 2; ++i) {
+      const Col& a = _col[2 * i];
+      const Col& b = _col[2 * i + 1];
+      Col m = a.n ? a : b;
+      if (a.n && b.n) {
+        if (b.lo < m.lo) m.lo = b.lo;
+        if (b.hi > m.hi) m.hi = b.hi;
+      }
+      m.mark = a.mark | b.mark;
+      _col[i] = m;
+    }
+    for (int i = W / 2; i < W; ++i) _col[i] = Col{ T(), T(), 0, 0 };
+    _used = (_used + 1) / 2;
+    _span *= 2;
+    ++_gen;
+  }
+};
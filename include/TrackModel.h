@@ -0,0 +1,313 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Geo.h"
+
+/* =========================================================
+   コース中心線モデル（距離ビンへのストリーミング集約）
+   - 1周目（ラップトリガ間）の軌跡を binM ごとに区切って種にする
+   - 以降は各フィックスを中心線へマップマッチし、該当ビンの
+     横位置の平均と分散を逐次更新 → 周回ごとに中心線が締まる
+   - マッチングは直前ビン近傍の固定幅窓だけ探索（O(1)/フィックス）。
+     見失い中も1フィックスに LOST_SCAN ビンずつ全周を順に調べる（手間は一定）
+   - 横ずれの分散はビンごとに track.bin に残る（widthM：走行ラインの幅の目安。
+     tools/trackbuild はログの全周から埋める）
+   - メモリは MAX_BINS 固定（コース長 / ビン幅）
+   ========================================================= */
+
+#ifndef TRACK_MAX_BINS
+#define TRACK_MAX_BINS 1000
+#endif
+#ifndef TRACK_BIN_M
+#define TRACK_BIN_M 5.0f
+#endif
+#ifndef TRACK_MAX_SECTORS
+#define TRACK_MAX_SECTORS 8
+#endif
+
+struct TrackBin {
+  float    x, y;        // 中心線の平均位置（LocalFrame, m）
+  float    latMean;     // 横ずれ平均（左+）
+  float    latM2;       // 横ずれ二乗偏差和（Welford）
+  uint16_t n;           // 集約サンプル数
+  uint16_t reserved;
+};
+
+// /track.bin のヘッダ（この後に TrackBin × bins、version 2 以降は TrackFileMeta が続く）
+struct TrackFileHeader {
+  char     magic[4];    // "TRK1"
+  uint16_t version;
+  uint16_t bins;
+  float    binM;
+  uint32_t laps;
+  double   lat0, lon0;  // LocalFrame の原点
+};
+
+// version 2：区間と外接矩形（tools/trackbuild が作る。端末は区間をそのまま引き継ぐ）
+struct TrackFileMeta {
+  uint16_t sectors;                       // 区間数（0 = 区間なし）
+  uint16_t reserved;
+  float    sectorEndM[TRACK_MAX_SECTORS]; // 各区間の終端距離（最後の区間はコース長）
+  double   minLat, minLon, maxLat, maxLon;
+};
+
+static_assert(sizeof(TrackBin) == 20, "track file layout");
+static_assert(sizeof(TrackFileHeader) == 32, "track file layout");
+static_assert(sizeof(TrackFileMeta) == 8 + 4 * TRACK_MAX_SECTORS + 32, "track file layout");
+
+class TrackModel {
+public:
+  static constexpr int   MAX_BINS = TRACK_MAX_BINS;
+  static constexpr int   WINDOW   = 8;       // 探索窓（±ビン）
+  static constexpr float LOST_M   = 25.0f;   // これ以上離れたら見失い扱い
+  static constexpr int   LOST_SCAN = 50;     // 見失い中に1フィックスで調べるビン数
+
+  enum State : uint8_t { IDLE, SEEDING, READY };
+
+  geo::LocalFrame frame;
+  TrackBin bin[MAX_BINS];
+  TrackFileMeta meta = {};
+
+  void reset(double lat0, double lon0) {
+    frame.setOrigin(lat0, lon0);
+    meta = {};
+    _bins = 0;
+    _laps = 0;
+    _state = IDLE;
+    _matched = false;
+    _hasPrev = false;
+  }
+
+  State state()     const { return _state; }
+  int   bins()      const { return _bins; }
+  float binM()      const { return _binM; }
+  float lengthM()   const { return _bins * _binM; }
+  int   laps()      const { return _laps; }
+  bool  matched()   const { return _matched; }
+  float distanceM() const { return _dist; }   // コース上の距離（0 = 計測原点）
+  float lateralM()  const { return _lat; }
+  int   index()     const { return _idx; }    // マッチしているビン
+
+  // 横ずれ 1σ と 幅の目安（±2σ）
+  float lateralSigma(int i) const {
+    return (bin[i].n > 1) ? sqrtf(bin[i].latM2 / (bin[i].n - 1)) : 0.0f;
+  }
+  float widthM(int i) const { return 4.0f * lateralSigma(i); }
+
+  // ラップトリガ：種取りの開始/終了、以降は周回数のみ
+  void onLap() {
+    if (_state == IDLE) {
+      _state = SEEDING;
+      _odo = 0.0f;
+      _hasPrev = false;
+    } else if (_state == SEEDING) {
+      int n = (int)(_odo / _binM + 0.5f);
+      if (n >= 20 && n <= MAX_BINS) {
+        _bins = n;
+        _laps = 1;
+        _state = READY;
+        _idx = 0;
+        _matched = true;
+        _scan = 0;
+      } else {
+        _odo = 0.0f; // 短すぎ/長すぎ → 取り直し
+      }
+      _hasPrev = false;
+    } else {
+      ++_laps;
+    }
+  }
+
+  // フィックス1回ぶん
+  void onFix(geo::Vec2 p) {
+    if (_state == SEEDING) seed(p);
+    else if (_state == READY) refine(p);
+  }
+
+  // ファイル入出力用
+  void header(TrackFileHeader& h) const {
+    memcpy(h.magic, "TRK1", 4);
+    h.version = 2;
+    h.bins = (uint16_t)_bins;
+    h.binM = _binM;
+    h.laps = (uint32_t)_laps;
+    h.lat0 = frame.lat0;
+    h.lon0 = frame.lon0;
+  }
+
+  bool load(const TrackFileHeader& h) {
+    if (memcmp(h.magic, "TRK1", 4) != 0 || h.bins < 20 || h.bins > MAX_BINS) return false;
+    frame.setOrigin(h.lat0, h.lon0);
+    meta = {};   // version 2 なら続けて読み込む
+    _binM = h.binM;
+    _bins = h.bins;
+    _laps = (int)h.laps;
+    _state = READY;
+    _idx = 0;
+    _matched = false;
+    _scan = 0;
+    return true;
+  }
+
+  // 読み込んだ meta の検査。区間数が配列に収まり、終端距離が増えていってコース長以内か
+  // （壊れた・別物の track.bin で区間の配列を越えて書かないように）。だめなら区間なしにする
+  bool validateMeta() {
+    bool ok = meta.sectors <= TRACK_MAX_SECTORS;
+    const float L = _bins * _binM;
+    float prev = 0.0f;
+    for (int i = 0; ok && i < meta.sectors; ++i) {
+      const float e = meta.sectorEndM[i];
+      ok = e > prev && e <= L + _binM * 0.5f;   // NaN もここで落ちる
+      prev = e;
+    }
+    if (!ok) meta = {};
+    return ok;
+  }
+
+  // 保存前に外接矩形を中心線から取り直す
+  void updateBounds() {
+    for (int i = 0; i < _bins; ++i) {
+      double la, lo;
+      frame.toLatLon({ bin[i].x, bin[i].y }, la, lo);
+      if (i == 0 || la < meta.minLat) meta.minLat = la;
+      if (i == 0 || la > meta.maxLat) meta.maxLat = la;
+      if (i == 0 || lo < meta.minLon) meta.minLon = lo;
+      if (i == 0 || lo > meta.maxLon) meta.maxLon = lo;
+    }
+  }
+
+private:
+  State     _state = IDLE;
+  float     _binM = TRACK_BIN_M;
+  int       _bins = 0;
+  int       _laps = 0;
+
+  // 種取り
+  float     _odo = 0.0f;
+  bool      _hasPrev = false;
+  geo::Vec2 _prev;
+
+  // マッチング
+  int       _idx = 0;
+  bool      _matched = false;
+  int       _scan = 0;       // 見失い中の次の探索位置
+  float     _dist = 0.0f;
+  float     _lat = 0.0f;
+
+  int wrap(int i) const { return ((i % _bins) + _bins) % _bins; }
+
+  void seed(geo::Vec2 p) {
+    if (!_hasPrev) {
+      _prev = p;
+      _hasPrev = true;
+      put(0, p);
+      return;
+    }
+
+    // ビン幅未満の移動は捨てる（ノイズで距離が水増しされるのを防ぐ）
+    float seg = geo::length(p - _prev);
+    if (seg < _binM) return;
+    float odo1 = _odo + seg;
+    if (odo1 >= MAX_BINS * _binM) {
+      // コースが長すぎる：種取りをやめて次のラップで取り直す
+      _state = IDLE;
+      return;
+    }
+
+    // 区間内に入るビン境界をすべて線形補間で埋める（低レートでも穴を空けない）
+    for (int j = (int)(_odo / _binM) + 1; j * _binM <= odo1; ++j) {
+      float t = (j * _binM - _odo) / seg;
+      put(j, _prev + (p - _prev) * t);
+    }
+    _odo = odo1;
+    _prev = p;
+  }
+
+  void put(int j, geo::Vec2 p) {
+    TrackBin& b = bin[j];
+    b.x = p.x;
+    b.y = p.y;
+    b.latMean = 0.0f;
+    b.latM2 = 0.0f;
+    b.n = 1;
+    b.reserved = 0;
+  }
+
+  // i〜i+1 の線分へ射影して距離²を返す
+  float project(int i, geo::Vec2 p, float& t, float& lat) const {
+    const TrackBin& a = bin[i];
+    const TrackBin& b = bin[wrap(i + 1)];
+    geo::Vec2 A = { a.x, a.y };
+    geo::Vec2 d = geo::Vec2{ b.x, b.y } - A;
+    float len2 = geo::dot(d, d);
+    if (len2 <= 0.0f) { t = 0.0f; lat = 0.0f; return geo::dot(p - A, p - A); }
+    t = geo::dot(p - A, d) / len2;
+    if (t < 0.0f) t = 0.0f;
+    if (t > 1.0f) t = 1.0f;
+    geo::Vec2 q = A + d * t;
+    lat = geo::cross(d, p - A) / sqrtf(len2);
+    return geo::dot(p - q, p - q);
+  }
+
+  // from〜to（ビン番号、周回で折り返す）で一番近い線分
+  void nearest(geo::Vec2 p, int from, int to, int& best, float& bestD2, float& bestT, float& bestLat) const {
+    best = -1;
+    for (int k = from; k <= to; ++k) {
+      int i = wrap(k);
+      float t, lat;
+      float d2 = project(i, p, t, lat);
+      if (best < 0 || d2 < bestD2) {
+        best = i; bestD2 = d2; bestT = t; bestLat = lat;
+      }
+    }
+  }
+
+  void refine(geo::Vec2 p) {
+    int best = -1;
+    float bestD2 = 0.0f, bestT = 0.0f, bestLat = 0.0f;
+    if (_matched) {
+      nearest(p, _idx - WINDOW, _idx + WINDOW, best, bestD2, bestT, bestLat);
+    } else {
+      // 見失い中：全周を LOST_SCAN ビンずつ順に。近くに来たらその前後の窓で取り直す
+      const int n = LOST_SCAN < _bins ? LOST_SCAN : _bins;
+      nearest(p, _scan, _scan + n - 1, best, bestD2, bestT, bestLat);
+      _scan = wrap(_scan + n);
+      if (bestD2 <= LOST_M * LOST_M) nearest(p, best - WINDOW, best + WINDOW, best, bestD2, bestT, bestLat);
+    }
+
+    if (bestD2 > LOST_M * LOST_M) {
+      _matched = false;
+      return;
+    }
+    _matched = true;
+    _idx = best;
+    _dist = (best + bestT) * _binM;
+    _lat = bestLat;
+
+    // 最寄りビンへ集約：動かすのは法線方向だけ（進行方向の並びは種のまま）
+    //   全方向に平均すると、ずれたビンがずれた点を引き寄せて広がっていく
+    //   法線は前後ビンの中心差分から取る（種のジグザグに引きずられない）
+    int j = (bestT < 0.5f) ? best : wrap(best + 1);
+    const TrackBin& a = bin[wrap(j - 1)];
+    const TrackBin& b = bin[wrap(j + 1)];
+    geo::Vec2 d = geo::Vec2{ b.x, b.y } - geo::Vec2{ a.x, a.y };
+    float len = geo::length(d);
+    if (len <= 0.0f) return;
+    geo::Vec2 nrm = { -d.y / len, d.x / len }; // 左法線
+
+    TrackBin& u = bin[j];
+    float lat = geo::dot(p - geo::Vec2{ u.x, u.y }, nrm);
+    if (u.n < 0xFFFF) ++u.n;
+    float inv = 1.0f / u.n;
+    u.x += nrm.x * lat * inv;
+    u.y += nrm.y * lat * inv;
+
+    // 横ずれの分散（中心線からの散らばり＝走行ライン幅の目安）
+    float delta = lat - u.latMean;
+    u.latMean += delta * inv;
+    u.latM2 += delta * (lat - u.latMean);
+  }
+};
@@ -6,231 +6,188 @@
 #include <string.h>
 #include <stdlib.h>
 
-/* =========================================================
-   TinyGPS++ 互換っぽい “最小” 自力実装（RMC/GGAのみ）
-   - encode(c) で1文字ずつ投入
-   - 受理した文から location/date/time/speed/altitude/satellites を更新
-   - distanceBetween() はハバースイン
-   ========================================================= */
-class TinyGPSPlus {
-public:
-  struct Location {
-    double _lat = 0.0, _lng = 0.0;
-    double lat() const { return _lat; }
-    double lng() const { return _lng; }
-  } location;
-
-  struct Date {
-    int _year = 0, _month = 0, _day = 0;
-    int year()  const { return _year;  }
-    int month() const { return _month; }
-    int day()   const { return _day;   }
-  } date;
-
-  struct Time {
-    int _hour = 0, _minute = 0, _second = 0;
-    int hour()   const { return _hour;   }
-    int minute() const { return _minute; }
-    int second() const { return _second; }
-  } time;
-
-  struct Speed {
-    double _kmph = 0.0;
-    double kmph() const { return _kmph; }
-  } speed;
-
-  struct Altitude {
-    double _meters = 0.0;
-    double meters() const { return _meters; }
-  } altitude;
-
-  struct Satellites {
-    int _value = 0;
-    int value() const { return _value; }
-  } satellites;
-
-  bool encode(char c) {
-    if (c == '\r') return false;
-
-    if (c == '$') {
-      _idx = 0;
-      _buf[_idx++] = c;
-      _buf[_idx] = '\0';
-      return false;
-    }
-
-    if (_idx < (int)sizeof(_buf) - 1) {
-      _buf[_idx++] = c;
-      _buf[_idx] = '\0';
-    }
-
-    if (c == '\n') {
-      parseLine(_buf);
-      _idx = 0;
-      return true;
-    }
-    return false;
-  }
-
-  static double distanceBetween(double lat1, double lon1, double lat2, double lon2) {
-    // ハバースイン（m）
-    const double R = 6371000.0;
-    const double d2r = 0.017453292519943295; // pi/180
-
-    double p1 = lat1 * d2r;
-    double p2 = lat2 * d2r;
-    double dp = (lat2 - lat1) * d2r;
-    double dl = (lon2 - lon1) * d2r;
-
-    double a = sin(dp * 0.5) * sin(dp * 0.5) +
-               cos(p1) * cos(p2) * sin(dl * 0.5) * sin(dl * 0.5);
-    double c = 2.0 * atan2(sqrt(a), sqrt(1.0 - a));
-    return R * c;
-  }
-
-private:
-  char _buf[160];
-  int  _idx = 0;
-
-  static uint8_t hex2byte(const char* p) {
-    auto h = [](char ch) -> uint8_t {
-      if (ch >= '0' && ch <= '9') return ch - '0';
-      if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
-      if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
-      return 0;
-    };
-    return (uint8_t)((h(p[0]) << 4) | h(p[1]));
-  }
-
-  static double nmeaToDeg(const char* s) {
-    // ddmm.mmmm or dddmm.mmmm → deg
-    if (!s || !*s) return 0.0;
-    double v = atof(s);
-    int deg = (int)(v / 100.0);
-    double minutes = v - (deg * 100.0);
-    return (double)deg + minutes / 60.0;
-  }
-
-  void parseTime_hhmmss(const char* s) {
-    if (!s || strlen(s) < 6) return;
-    // hhmmss( .sss は無視)
-    char hh[3] = { s[0], s[1], 0 };
-    char mm[3] = { s[2], s[3], 0 };
-    char ss[3] = { s[4], s[5], 0 };
-    time._hour   = atoi(hh);
-    time._minute = atoi(mm);
-    time._second = atoi(ss);
-  }
-
-  void parseDate_ddmmyy(const char* s) {
-    if (!s || strlen(s) < 6) return;
-    char dd[3] = { s[0], s[1], 0 };
-    char mm[3] = { s[2], s[3], 0 };
-    char yy[3] = { s[4], s[5], 0 };
-    int d = atoi(dd);
-    int m = atoi(mm);
-    int y = atoi(yy);
-    // 80-99 は 1900台、それ以外は 2000台に寄せる
-    int full = (y >= 80) ? (1900 + y) : (2000 + y);
-    date._day = d;
-    date._month = m;
-    date._year = full;
-  }
-
-  void setLatLon(const char* lat, const char* ns, const char* lon, const char* ew) {
-    if (!lat || !*lat || !lon || !*lon) return;
-
-    double la = nmeaToDeg(lat);
-    double lo = nmeaToDeg(lon);
-
-    if (ns && *ns == 'S') la = -la;
-    if (ew && *ew == 'W') lo = -lo;
-
-    location._lat = la;
-    location._lng = lo;
-  }
-
-  void parseRMC(char** f, int n) {
-    // $..RMC, time, status, lat, N/S, lon, E/W, speed(knots), course, date, ...
-    if (n < 10) return;
-    if (!f[2] || f[2][0] != 'A') return; // A=valid
-    parseTime_hhmmss(f[1]);
-    setLatLon(f[3], f[4], f[5], f[6]);
-
-    double knots = (f[7] && *f[7]) ? atof(f[7]) : 0.0;
-    speed._kmph = knots * 1.852;
-
-    parseDate_ddmmyy(f[9]);
-  }
-
-  void parseGGA(char** f, int n) {
-    // $..GGA, time, lat, N/S, lon, E/W, fixq, sats, hdop, alt(m), ...
-    if (n < 10) return;
-    parseTime_hhmmss(f[1]);
-    setLatLon(f[2], f[3], f[4], f[5]);
-
-    satellites._value = (f[7] && *f[7]) ? atoi(f[7]) : satellites._value;
-    altitude._meters  = (f[9] && *f[9]) ? atof(f[9]) : altitude._meters;
-  }
-
-  void parseLine(char* line) {
-    if (!line || line[0] != '$') return;
-
-    // チェックサム検証
-    char* body = line + 1;                 // '$'の次
-    char* ast  = strchr(body, '*');
-    if (!ast || (ast - body) <= 0) return;
-
-    uint8_t cs = 0;
-    for (char* p = body; p < ast; ++p) cs ^= (uint8_t)(*p);
-
-    if (strlen(ast) < 3) return;           // "*hh"
-    uint8_t sent = hex2byte(ast + 1);
-    if (cs != sent) return;
-
-    *ast = '\0'; // ここで文末を切る（チェックサム以降無視）
-
-    // CSV分割
-    char* fields[24];
-    int nf = 0;
-    char* save = nullptr;
-    for (char* tok = strtok_r(body, ",", &save); tok && nf < 24; tok = strtok_r(nullptr, ",", &save)) {
-      fields[nf++] = tok;
-    }
-    if (nf <= 0) return;
-
-    // type末尾3文字で判定（GPRMC/GNRMC/GLRMC等をまとめて拾う）
-    const char* type = fields[0];
-    size_t len = strlen(type);
-    if (len < 3) return;
-    const char* suf = type + (len - 3);
-
-    if (strcmp(suf, "RMC") == 0) {
-      parseRMC(fields, nf);
-    } else if (strcmp(suf, "GGA") == 0) {
-      parseGGA(fields, nf);
-    }
-  }
-};
+#include <esp_timer.h>
+
+#include "AsyncLog.h"
+#include "BlackBox.h"
+#include "Degradation.h"
+#include "GGCloud.h"
+#include "GnssAid.h"
+#include "GnssLatency.h"
+#include "Journal.h"
+#include "LapEngine.h"
+#include "LapPredict.h"
+#include "PbRegistry.h"
+#include "RefLap.h"
+#include "SessionSummary.h"
+#include "Storage.h"
+#include "Telemetry.h"
+#include "TraceSummary.h"
+
+// 入力ジャーナル（0 で無効）。PPS を使うなら PPS_PIN も指定
+#ifndef JOURNAL_ENABLE
+#define JOURNAL_ENABLE 1
+#endif
+
+// 1 で起動時に SD / 内蔵フラッシュの書込み速度を Serial に出す
+#ifndef STORAGE_BENCH
+#define STORAGE_BENCH 0
+#endif
+
+// 画面キャンバスの色深度（4 / 8 = パレット, 16 = RGB565）
+#ifndef UI_COLOR_DEPTH
+#define UI_COLOR_DEPTH 4
+#endif
+// 1 で起動時に 4/8/16bpp のメモリと転送時間を Serial に出す
+#ifndef UI_BENCH
+#define UI_BENCH 0
+#endif
+// 1 で起動時にコルーチン切替と FreeRTOS タスク切替のコストを Serial に出す
+// （C++20 のコルーチンが必要：GCC 10 以降のツールチェーンと -std=gnu++20）
+#ifndef CO_BENCH
+#define CO_BENCH 0
+#endif
+#if CO_BENCH
+#include "CoTask.h"
+#ifndef CO_TASK_AVAILABLE
+#error "CO_BENCH needs C++20 coroutines"
+#endif
+#endif
+
+// RAM に持つ直近のフィックス（秒数 × フィックス周期）。起動時に使用量を Serial に出す
+// 基準ラップはここから作るので、1周がこれより長いコースでは増やす（10 Hz で 1 秒 140 B）
+#ifndef TELEM_SECONDS
+#define TELEM_SECONDS 120
+#endif
+#ifndef TELEM_HZ
+#define TELEM_HZ 10
+#endif
+
+// GNSS の遅延・間隔ゆらぎの集計を Serial と LATENCY_log.csv に出す周期（秒。0 で出さない）
+#ifndef LAT_REPORT_S
+#define LAT_REPORT_S 60
+#endif
+
+// 走行中の track.bin / 自己ベスト / 基準ラップの保存は止まるまで待つ（この周回数ごとには書く）
+#ifndef SAVE_EVERY_LAPS
+#define SAVE_EVERY_LAPS 10
+#endif
+
+// GNSS の UART 受信バッファ（既定の 256 B は 115200 bps で約 22 ms 分しかない）
+#ifndef GPS_RX_BUFFER
+#define GPS_RX_BUFFER 4096
+#endif
 
 /* =========================================================
    元コードのグローバル
    ========================================================= */
-TinyGPSPlus gps;
+// 計測状態はすべてエンジンが持つ（ホスト再生と共有）
+LapEngine eng;
+
+// SD が無い間は内蔵フラッシュへ（戻ったら移行）
+Storage storage;
 
 File file;
 String fname = "/LAP_log.csv";
+String routeFname = "/route.csv";
+String rallyFname = "/RALLY_log.csv";
+String trackFname = "/track.bin";
+String aidFname = "/aid.bin";
+String aidDbdFname = "/aid_dbd.bin";
+String ttffFname = "/TTFF_log.csv";
+String bbFname = "/BLACKBOX.bin";
+String pbFname = "/pb.bin";
+String latFname = "/LATENCY_log.csv";
+String sessionFname = "/SESSION_log.csv";
 
-int YEAR, MONTH, DAY, HOUR, MINUTE, SECOND, LapCount, SatVal, BestLapNum;
-
-float LAT0 = 35.3698692322f, LONG0 = 138.9336547852f;
-float LAT, LONG, KMPH, TopSpeed, ALTITUDE, distanceToMeter0, BeforeTime;
-float LAP, LAP1, LAP2, LAP3, LAP4, LAP5, BestLap = 99999.0f, AverageLap, Sprit;
-
-bool LAPCOUNTNOW, LAPRADchange;
-float LAPRAD = 5.0f;  // ラップ計測トリガー半径(m)
 long lastdulation;
 
+// 入力ジャーナル：メインループは非同期リングに積むだけ
+AsyncLog<16384> journalLog;
+journal::Writer<AsyncLog<16384>> jrnl(journalLog);
+bool journalOn;
+bool btnPrev[3];
+
+// ブラックボックス：前後の記録を RAM に回し、事故のきっかけで凍結して専用ファイルへ
+blackbox::Recorder<> bb;
+AsyncLog<4096> bbLog;
+bool bbOn;
+uint32_t bbFixCount;
+uint32_t bbImuMs;
+
+// コースごとの自己ベストと基準ラップ（計測原点が変わったら1回引き直す）
+PbRegistry pbReg;
+RefLap refLap;
+int pbIdx = -1;
+float pbLat0 = NAN, pbLon0 = NAN;
+
+// 書き待ち（フラッシュへの書込みは数十 ms 止まるので走行中はまとめて後で）
+bool trackDirty, pbDirty, refDirty;
+int dirtyLaps;
+
+// 走行中ラップの予想（基準ラップの残り）。確定直後の LAP_HOLD_MS は前ラップを出す
+LapPredictor predict;
+uint32_t lapEndMs;
+static constexpr uint32_t LAP_HOLD_MS = 5000;
+
+// セッションのまとめ（ラップ・フィックスごとに足し込む。終わったら1行記録）
+SessionSummary session;
+
+// スティント内のたれ（有効周のラップタイムの傾き。ラップごとに足し込む）
+DegradeTrend degrade;
+
+// セッション全体の速度（画面幅の列に最小・最大で縮めて持つ。0.1 km/h 単位）
+TraceSummary<320, int16_t> speedTrace;
+
+// 直近のフィックス（ラップ比較・グラフ用。SD を読まずに時刻・周回で引ける）
+TelemetryRing<TELEM_SECONDS * TELEM_HZ> telem;
+uint32_t telemFixCount;
+
+// GNSS 補助：起動時の補助と TTFF、停車中の保存（手順は GnssAid.h の Assist。tools/fake_gnss と共通）
+struct AidClock {
+  uint32_t millis() const { return ::millis(); }
+  void delayMs(uint32_t ms) const { delay(ms); }
+  // RTC は UTC で持つ（無い機種・未設定なら false）
+  bool rtcGet(gnssaid::DateTime& t) const {
+    if (!M5.Rtc.isEnabled()) return false;
+    auto dt = M5.Rtc.getDateTime();
+    if (dt.date.year < 2020) return false;
+    t = { (uint16_t)dt.date.year, (uint8_t)dt.date.month, (uint8_t)dt.date.date,
+          (uint8_t)dt.time.hours, (uint8_t)dt.time.minutes, (uint8_t)dt.time.seconds };
+    return true;
+  }
+  void rtcSet(const gnssaid::DateTime& t) const {
+    if (!M5.Rtc.isEnabled()) return;
+    m5::rtc_datetime_t dt;
+    dt.date = { (int16_t)t.year, (int8_t)t.month, (int8_t)t.day, 0 };
+    dt.time = { (int8_t)t.hour, (int8_t)t.minute, (int8_t)t.second };
+    M5.Rtc.setDateTime(dt);
+  }
+};
+AidClock aidClock;
+gnssaid::Assist<HardwareSerial, Storage, AidClock> aid((gnssaid::Proto)GNSS_AID, Serial2, storage, aidClock,
+                                                       aidFname.c_str(), aidDbdFname.c_str());
+
+// GNSS の遅延：エポックごとに 先頭バイト → 確定 → step を計る（ジャーナルとは別）
+gnsslat::Meter latm;
+uint32_t latFixCount;
+uint32_t latReportMs;
+
+// 大きな静的領域（.bss）の合計。ESP32 の .data/.bss は dram0 の約 176 KB に収まる必要があり、
+// コアとライブラリがそのうち 25 KB ほど使う。残りの DRAM がヒープ（キャンバス 38.4 KB・UART 受信・
+// SD/FS のバッファ・書込みタスクのスタック）。起動時に空きヒープを Serial に出す
+static constexpr size_t BIG_STATIC_BYTES =
+  sizeof(eng) + sizeof(telem) + sizeof(bb) + sizeof(journalLog) + sizeof(bbLog) +
+  sizeof(pbReg) + sizeof(refLap) + sizeof(latm) + sizeof(speedTrace);
+static_assert(BIG_STATIC_BYTES <= 120 * 1024, "static RAM over budget: lower TELEM_SECONDS, BB_PRE_S or TRACK_MAX_BINS");
+
+#ifdef PPS_PIN
+volatile uint64_t ppsUs[4];
+volatile uint32_t ppsHead;
+uint32_t ppsTail;
+void IRAM_ATTR onPps() { ppsUs[ppsHead++ & 3] = esp_timer_get_time(); }
+#endif
+
 /* =========================================================
    差分描画用キャッシュ＆ヘルパ
    ========================================================= */
@@ -241,16 +198,177 @@ struct UiCache {
   char delta[16]       = "";
   uint16_t deltaBg     = 0xFFFF;
   char elapsed[8]      = "";
-  char bestKey[24]     = "";
+  char bestKey[48]     = "";
   char avgKey[24]      = "";
   char speed[16]       = "";
   char dist[16]        = "";
   char lapRad[8]       = "";
+  char storage[4]      = "";
+  char ggLon[12]       = "";
+  char ggLat[12]       = "";
+  char ggMax[12]       = "";
+  char summaryKey[24]  = "";
+  char traceKey[24]    = "";
+  char lineKey[24]     = "";
+  uint32_t traceFix    = 0xFFFFFFFF;
+  uint32_t traceGen    = 0xFFFFFFFF;
+  int traceTop         = -1;
+  int traceCol         = 0;
   int barAvgW          = -1;
   int barBestW         = -1;
 };
 static UiCache ui;
 
+/* =========================================================
+   画面キャンバス（パレット）
+   - UI は全画面キャンバスに描き、変わった範囲だけ LCD へ転送
+   - 4bpp なら 320x240 で 38.4KB（RGB565 は 150KB で PSRAM 無しでは確保できない）
+   - 色はパレット番号で描き、転送時に LUT で RGB565 へ展開される
+   - キャンバスが取れなかったら LCD へ直接描く（色は RGB565 のまま）
+   ========================================================= */
+enum UiColor : uint8_t {
+  C_BLACK, C_WHITE, C_YELLOW, C_CYAN, C_PINK, C_BLUE, C_RED, C_ORANGE, C_GREEN, C_RAD,
+  C_GRID, C_DIM,
+  C_COUNT
+};
+static const uint16_t kPalette[C_COUNT] = {
+  BLACK, WHITE, YELLOW, CYAN, PINK, BLUE, RED, ORANGE, GREEN, 47072,
+  DARKGREY, 0x7800
+};
+static_assert(C_COUNT <= 16, "palette must fit 4bpp");
+
+static M5Canvas canvas(&M5.Display);
+static lgfx::LovyanGFX* gfx = &M5.Display;
+static bool uiPaletted = false;
+
+// 転送待ちの範囲（外接矩形）
+static int dirtyX0 = 0, dirtyY0 = 0, dirtyX1 = -1, dirtyY1 = -1;
+
+static inline uint16_t col(UiColor c) {
+  return uiPaletted ? (uint16_t)c : kPalette[c];
+}
+
+static void markDirty(int x, int y, int w, int h) {
+  if (gfx == &M5.Display) return;
+  if (dirtyX1 < dirtyX0) {
+    dirtyX0 = x; dirtyY0 = y; dirtyX1 = x + w - 1; dirtyY1 = y + h - 1;
+    return;
+  }
+  if (x < dirtyX0) dirtyX0 = x;
+  if (y < dirtyY0) dirtyY0 = y;
+  if (x + w - 1 > dirtyX1) dirtyX1 = x + w - 1;
+  if (y + h - 1 > dirtyY1) dirtyY1 = y + h - 1;
+}
+
+static void setupPalette(M5Canvas& c) {
+  c.createPalette();
+  for (int i = 0; i < C_COUNT; ++i) {
+    uint16_t v = kPalette[i];
+    c.setPaletteColor(i, (uint8_t)((v >> 8) & 0xF8), (uint8_t)((v >> 3) & 0xFC), (uint8_t)(v << 3));
+  }
+}
+
+static void uiBegin() {
+  canvas.setPsram(false);
+  canvas.setColorDepth(UI_COLOR_DEPTH);
+  if (!canvas.createSprite(M5.Display.width(), M5.Display.height())) return;
+  uiPaletted = UI_COLOR_DEPTH <= 8;
+  if (uiPaletted) setupPalette(canvas);
+  gfx = &canvas;
+}
+
+// 変わった範囲だけ転送（クリップ内だけ LUT 展開して送られる）
+static void uiPush() {
+  if (gfx == &M5.Display || dirtyX1 < dirtyX0) return;
+  M5.Display.setClipRect(dirtyX0, dirtyY0, dirtyX1 - dirtyX0 + 1, dirtyY1 - dirtyY0 + 1);
+  canvas.pushSprite(0, 0);
+  M5.Display.clearClipRect();
+  dirtyX1 = dirtyX0 - 1;
+}
+
+#if UI_BENCH
+// 全画面キャンバスの確保量と 1フレーム転送時間を色深度ごとに比べる
+static void uiBench(Print& out) {
+  const int depths[] = { 4, 8, 16 };
+  for (int d : depths) {
+    M5Canvas c(&M5.Display);
+    c.setPsram(false);
+    c.setColorDepth(d);
+    uint32_t heap0 = ESP.getFreeHeap();
+    if (!c.createSprite(M5.Display.width(), M5.Display.height())) {
+      out.printf("[%2dbpp] cannot allocate\n", d);
+      continue;
+    }
+    uint32_t heapUsed = heap0 - ESP.getFreeHeap();
+    if (d <= 8) setupPalette(c);
+    c.fillScreen(d <= 8 ? C_YELLOW : YELLOW);
+
+    const int N = 10;
+    uint32_t t0 = micros();
+    for (int i = 0; i < N; ++i) c.pushSprite(0, 0);
+    uint32_t us = (micros() - t0) / N;
+
+    out.printf("[%2dbpp] buffer %u B, heap %u B, push %lu us/frame\n",
+               d, (unsigned)c.bufferLength(), (unsigned)heapUsed, (unsigned long)us);
+    c.deleteSprite();
+  }
+}
+#endif
+
+#if CO_BENCH
+// 2つのコルーチンが Signal で起こし合う（1往復 = 切替2回）
+static co::Task coPing(co::Signal& out, co::Signal& in, long n) {
+  for (long i = 0; i < n; ++i) {
+    out.notify();
+    co_await in;
+  }
+}
+
+static co::Task coPong(co::Signal& in, co::Signal& out, long n) {
+  for (long i = 0; i < n; ++i) {
+    co_await in;
+    out.notify();
+  }
+}
+
+static TaskHandle_t coBenchMain;
+
+static void coBenchPeer(void*) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    xTaskNotifyGive(coBenchMain);
+  }
+}
+
+// 同じコアの同じ優先度で比べる（FreeRTOS はタスク通知での起こし合い）
+static void coBench(Print& out) {
+  const long N = 20000;
+
+  co::Executor ex;
+  co::Signal a(ex), b(ex);
+  uint32_t t0 = micros();
+  ex.spawn(coPong(a, b, N));
+  ex.spawn(coPing(a, b, N));
+  ex.run();
+  uint32_t coUs = micros() - t0;
+
+  coBenchMain = xTaskGetCurrentTaskHandle();
+  TaskHandle_t peer = nullptr;
+  xTaskCreatePinnedToCore(coBenchPeer, "cobench", 2048, nullptr, uxTaskPriorityGet(nullptr), &peer, xPortGetCoreID());
+  t0 = micros();
+  for (long i = 0; i < N; ++i) {
+    xTaskNotifyGive(peer);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+  uint32_t rtosUs = micros() - t0;
+  vTaskDelete(peer);
+
+  out.printf("[co] coroutine %.2f us/switch, FreeRTOS task %.2f us/switch, frame pool %u x %u B\n",
+             coUs / (2.0 * N), rtosUs / (2.0 * N),
+             (unsigned)co::Pool::SLOTS, (unsigned)co::Pool::SLOT_SIZE);
+}
+#endif
+
 static void cacheCopy(char* dst, size_t n, const char* src) {
   if (!dst || n == 0) return;
   snprintf(dst, n, "%s", src ? src : "");
@@ -263,11 +381,12 @@ static bool drawTextIfChanged(int x, int y, int w, int h,
 {
   if (!force && text && cache && strcmp(text, cache) == 0) return false;
 
-  M5.Display.fillRect(x, y, w, h, bg);
-  M5.Display.setTextColor(fg);
-  M5.Display.setTextSize(size);
-  M5.Display.setCursor(x, y);
-  M5.Display.print(text ? text : "");
+  gfx->fillRect(x, y, w, h, bg);
+  gfx->setTextColor(fg);
+  gfx->setTextSize(size);
+  gfx->setCursor(x, y);
+  gfx->print(text ? text : "");
+  markDirty(x, y, w, h);
   cacheCopy(cache, cacheN, text);
   return true;
 }
@@ -279,65 +398,323 @@ static int clampi(int v, int lo, int hi) {
 }
 
 static void drawStaticUI() {
-  M5.Display.fillScreen(BLACK);
+  gfx->fillScreen(col(C_BLACK));
+  markDirty(0, 0, gfx->width(), gfx->height());
 
   // 下段の固定ラベル
-  M5.Display.setTextSize(1);
+  gfx->setTextSize(1);
 
-  M5.Display.setCursor(15, 228);
-  M5.Display.setTextColor(ORANGE);
-  M5.Display.print("SET ");
-  M5.Display.setTextColor(CYAN);
-  M5.Display.print("Zero");
-  M5.Display.setTextColor(ORANGE);
-  M5.Display.print("-Point");
+  gfx->setCursor(15, 228);
+  gfx->setTextColor(col(C_ORANGE));
+  gfx->print("SET ");
+  gfx->setTextColor(col(C_CYAN));
+  gfx->print("Zero");
+  gfx->setTextColor(col(C_ORANGE));
+  gfx->print("-Point");
 
-  M5.Display.setTextColor(ORANGE);
-  M5.Display.setCursor(120, 228);
-  M5.Display.print("Rad= ");
+  gfx->setTextColor(col(C_ORANGE));
+  gfx->setCursor(120, 228);
+  gfx->print("Rad= ");
 
-  M5.Display.setTextColor(ORANGE);
-  M5.Display.setCursor(230, 228);
-  M5.Display.print("Lap Count");
+  gfx->setTextColor(col(C_ORANGE));
+  gfx->setCursor(230, 228);
+  gfx->print("Lap Count");
 
   // GPSラベル
-  M5.Display.setTextColor(CYAN);
-  M5.Display.setTextSize(1);
-  M5.Display.setCursor(245, 5);
-  M5.Display.print("G P S:");
+  gfx->setTextColor(col(C_CYAN));
+  gfx->setTextSize(1);
+  gfx->setCursor(245, 5);
+  gfx->print("G P S:");
 
   // 前ラップ背景（黄色帯）
-  M5.Display.fillRect(0, 20, 320, 59, YELLOW);
+  gfx->fillRect(0, 20, 320, 59, col(C_YELLOW));
 
   // 経過時間枠
-  M5.Display.drawRoundRect(180, 80, 140, 50, 10, WHITE);
-  M5.Display.setTextColor(WHITE);
-  M5.Display.setTextSize(2);
-  M5.Display.setCursor(300, 110);
-  M5.Display.print("s");
+  gfx->drawRoundRect(180, 80, 140, 50, 10, col(C_WHITE));
+  gfx->setTextColor(col(C_WHITE));
+  gfx->setTextSize(2);
+  gfx->setCursor(300, 110);
+  gfx->print("s");
 
   // バー枠
-  M5.Display.drawRect(10, 200, 300, 25, WHITE);
+  gfx->drawRect(10, 200, 300, 25, col(C_WHITE));
 
   // Best/Average ラベル（値は差分描画）
-  M5.Display.setTextColor(CYAN);
-  M5.Display.setTextSize(2);
-  M5.Display.setCursor(20, 145);
-  M5.Display.print("Best");
+  gfx->setTextColor(col(C_CYAN));
+  gfx->setTextSize(2);
+  gfx->setCursor(20, 145);
+  gfx->print("Best");
+
+  gfx->setTextColor(col(C_PINK));
+  gfx->setTextSize(2);
+  gfx->setCursor(20, 175);
+  gfx->print("Average");
+}
+
+/* =========================================================
+   G-G 図（摩擦円）ページ
+   - BtnB 長押しでメイン画面と切替。見えていない間は何も描かない
+   - 新しいフィックスごとに GGCloud が変わった点（3×3 px）だけ描き、その場で転送
+     → 1フィックスの描画・転送量は点の数によらず一定
+   - 縦 = 前後G（上が加速）、横 = 横G（右旋回が右）。1.5g で頭打ち
+   ========================================================= */
+enum Page : uint8_t { PAGE_MAIN, PAGE_GG, PAGE_SUMMARY, PAGE_TRACE };
+static Page page = PAGE_MAIN;
+
+static constexpr int GG_CX = 160, GG_CY = 120;
+static constexpr int GG_PX_PER_G = 70;
+static constexpr int GG_R = 105;            // 1.5g
+
+static GGCloud<64> ggCloud;
+static uint32_t ggLastCount;
+static float ggMaxG;
+
+// 背景（格子）の色：0.5g ごとの円と軸。点を消す時はこれで塗り戻す
+static uint16_t ggBg(int x, int y) {
+  const int dx = x - GG_CX, dy = y - GG_CY;
+  const int r2 = dx * dx + dy * dy;
+  if (r2 > (GG_R + 1) * (GG_R + 1)) return col(C_BLACK);
+  if (dx == 0 || dy == 0) return col(C_GRID);
+  const float r = sqrtf((float)r2);
+  for (int k = 1; k <= 3; ++k) {
+    if (fabsf(r - k * GG_PX_PER_G * 0.5f) < 0.5f) return col(C_GRID);
+  }
+  return col(C_BLACK);
+}
+
+// 小さな範囲をすぐ転送（外接矩形にまとめると離れた2点で広がるため）
+static void ggFlush(int x, int y) {
+  if (gfx == &M5.Display) return;
+  M5.Display.setClipRect(x, y, 3, 3);
+  canvas.pushSprite(0, 0);
+  M5.Display.clearClipRect();
+}
+
+struct GGDraw {
+  void dot(int x, int y, int level) {
+    static const UiColor kShade[] = { C_YELLOW, C_ORANGE, C_RED, C_DIM };
+    gfx->fillRect(x - 1, y - 1, 3, 3, col(kShade[level]));
+    ggFlush(x - 1, y - 1);
+  }
+  void erase(int x, int y) {
+    for (int j = -1; j <= 1; ++j)
+      for (int i = -1; i <= 1; ++i) gfx->drawPixel(x + i, y + j, ggBg(x + i, y + j));
+    ggFlush(x - 1, y - 1);
+  }
+};
+
+static void drawGGStatic() {
+  gfx->fillScreen(col(C_BLACK));
+  markDirty(0, 0, gfx->width(), gfx->height());
 
-  M5.Display.setTextColor(PINK);
-  M5.Display.setTextSize(2);
-  M5.Display.setCursor(20, 175);
-  M5.Display.print("Average");
+  for (int y = GG_CY - GG_R - 1; y <= GG_CY + GG_R + 1; ++y)
+    for (int x = GG_CX - GG_R - 1; x <= GG_CX + GG_R + 1; ++x) {
+      uint16_t c = ggBg(x, y);
+      if (c != col(C_BLACK)) gfx->drawPixel(x, y, c);
+    }
+
+  gfx->setTextColor(col(C_CYAN));
+  gfx->setTextSize(2);
+  gfx->setCursor(2, 2);
+  gfx->print("G-G");
+
+  gfx->setTextColor(col(C_ORANGE));
+  gfx->setTextSize(1);
+  gfx->setCursor(270, 2);
+  gfx->print("Max");
+  gfx->setCursor(2, 200);
+  gfx->print("Lon");
+  gfx->setCursor(270, 200);
+  gfx->print("Lat");
+
+  ggCloud.reset();
+  ggLastCount = eng.GgCount;
+  ggMaxG = 0;
+}
+
+// 数値は隅に離れて3つあるので1つずつ転送（まとめると画面ほぼ全体の外接矩形になる）
+static void ggText(int x, int y, const char* text, char* cache, size_t cacheN) {
+  if (drawTextIfChanged(x, y, 48, 10, col(C_BLACK), col(C_WHITE), 1, text, cache, cacheN)) uiPush();
+}
+
+// 新しいフィックスが来た時だけ1点足す
+static void ggUpdate() {
+  if (eng.GgCount == ggLastCount) return;
+  ggLastCount = eng.GgCount;
+
+  const float gx = eng.AccLat, gy = eng.AccLong;
+  const float m = sqrtf(gx * gx + gy * gy);
+  if (m > ggMaxG) ggMaxG = m;
+
+  float px = gx * GG_PX_PER_G, py = -gy * GG_PX_PER_G;
+  const float r = m * GG_PX_PER_G;
+  if (r > GG_R - 1) {
+    px *= (GG_R - 1) / r;
+    py *= (GG_R - 1) / r;
+  }
+  GGDraw d;
+  ggCloud.push((int16_t)(GG_CX + lroundf(px)), (int16_t)(GG_CY + lroundf(py)), d);
+
+  char buf[12];
+  snprintf(buf, sizeof(buf), "%+.2fg", gy);
+  ggText(2, 212, buf, ui.ggLon, sizeof(ui.ggLon));
+  snprintf(buf, sizeof(buf), "%+.2fg", gx);
+  ggText(270, 212, buf, ui.ggLat, sizeof(ui.ggLat));
+  snprintf(buf, sizeof(buf), "%.2fg", ggMaxG);
+  ggText(270, 14, buf, ui.ggMax, sizeof(ui.ggMax));
+}
+
+/* =========================================================
+   セッションのまとめ画面（値はすべて SessionSummary が持つ。描くのは変わった時だけ）
+   ========================================================= */
+static void summaryRow(int y, const char* label, const char* value) {
+  gfx->setTextColor(col(C_ORANGE));
+  gfx->setCursor(10, y);
+  gfx->print(label);
+  gfx->setTextColor(col(C_WHITE));
+  gfx->setCursor(110, y);
+  gfx->print(value);
+}
+
+static void summaryUpdate() {
+  char key[24];
+  snprintf(key, sizeof(key), "%d/%d/%d/%ld", session.laps(), session.active(), session.closed(),
+           (long)(session.distanceM() / 100.0f));
+  if (strcmp(key, ui.summaryKey) == 0) return;
+  snprintf(ui.summaryKey, sizeof(ui.summaryKey), "%s", key);
+
+  gfx->fillScreen(col(C_BLACK));
+  markDirty(0, 0, gfx->width(), gfx->height());
+  gfx->setTextSize(2);
+  gfx->setTextColor(col(C_CYAN));
+  gfx->setCursor(10, 4);
+  gfx->print(session.closed() ? "SESSION END" : "SESSION");
+
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%d", session.laps());
+  summaryRow(32, "Laps", buf);
+  if (session.laps() > 0) snprintf(buf, sizeof(buf), "%.3f (L%d)", session.best(), session.bestNum());
+  else snprintf(buf, sizeof(buf), "-");
+  summaryRow(56, "Best", buf);
+  if (session.theoreticalBest() > 0) snprintf(buf, sizeof(buf), "%.3f", session.theoreticalBest());
+  else snprintf(buf, sizeof(buf), "-");
+  summaryRow(80, "Theo", buf);
+  snprintf(buf, sizeof(buf), "%.3f", session.average());
+  summaryRow(104, "Avg", buf);
+  snprintf(buf, sizeof(buf), "%.2f (%.1f%%)", session.sd(), session.cvPct());
+  summaryRow(128, "SD", buf);
+  snprintf(buf, sizeof(buf), "%.1f/%.1f", session.topKmph(), session.bestLapTopKmph());
+  summaryRow(152, "Top", buf);
+  snprintf(buf, sizeof(buf), "%.1f km", session.distanceM() / 1000.0f);
+  summaryRow(176, "Dist", buf);
+  const uint32_t t = session.durationS();
+  snprintf(buf, sizeof(buf), "%lu:%02lu:%02lu", (unsigned long)(t / 3600), (unsigned long)(t / 60 % 60), (unsigned long)(t % 60));
+  summaryRow(200, "Time", buf);
+  char label[12];
+  snprintf(label, sizeof(label), degrade.stint() > 1 ? "Deg S%d" : "Deg", degrade.stint());
+  if (degrade.valid()) snprintf(buf, sizeof(buf), "%+.2f  L+%d %.1f", degrade.slope(), DEGRADE_AHEAD, degrade.ahead());
+  else snprintf(buf, sizeof(buf), "-");
+  summaryRow(224, label, buf);
+  uiPush();
+}
+
+/* =========================================================
+   セッションの速度グラフ（横 = セッションの時間、縦 = 速度）
+   - 値は speedTrace の列を読むだけ（1列 = 1px）。フィックスごとに描くのは最後の列だけ
+   - 列がまとめ直された時・縦の目盛りが変わった時だけ全体を描き直す
+   - 暗い縦線はラップの区切り。横線は 20 km/h ごと
+   - 右下は今いるビンの横ずれ（中心線から、左+）と走行ライン幅（TrackModel::widthM）
+   ========================================================= */
+static constexpr int TRACE_Y0 = 24, TRACE_H = 192;   // グラフの上端と高さ
+
+static int traceY(int v10, int top) {
+  const int y = TRACE_Y0 + TRACE_H - 1 - v10 * (TRACE_H - 1) / (top * 10);
+  return y < TRACE_Y0 ? TRACE_Y0 : y;
+}
+
+static void traceColumn(int x, int top) {
+  gfx->drawFastVLine(x, TRACE_Y0, TRACE_H, col(speedTrace.col(x).mark ? C_DIM : C_BLACK));
+  for (int v = 20; v < top; v += 20) gfx->drawPixel(x, traceY(v * 10, top), col(C_GRID));
+  int16_t lo, hi;
+  if (speedTrace.range(x, lo, hi)) {
+    const int y1 = traceY(hi, top), y0 = traceY(lo, top);
+    gfx->drawFastVLine(x, y1, y0 - y1 + 1, col(C_CYAN));
+  }
+}
+
+// 描き直すのは新しいフィックスが来た時だけ（speedTrace に足すのはフィックスごと。周の区切りも次のフィックスで出る）
+static void traceUpdate() {
+  if (telemFixCount == ui.traceFix) return;
+  ui.traceFix = telemFixCount;
+  const int top = speedTrace.hasMax() ? (speedTrace.maxValue() / 200 + 1) * 20 : 40;
+  const int used = speedTrace.used();
+  if (speedTrace.generation() != ui.traceGen || top != ui.traceTop || used < ui.traceCol) {
+    ui.traceGen = speedTrace.generation();
+    ui.traceTop = top;
+    ui.traceCol = 0;
+    gfx->fillScreen(col(C_BLACK));
+    markDirty(0, 0, gfx->width(), gfx->height());
+    gfx->setTextSize(2);
+    gfx->setTextColor(col(C_CYAN));
+    gfx->setCursor(2, 2);
+    gfx->print("SPEED");
+    gfx->setTextSize(1);
+    gfx->setTextColor(col(C_ORANGE));
+    gfx->setCursor(2, TRACE_Y0 + TRACE_H + 8);
+    gfx->printf("0-%d km/h  grid 20", top);
+    ui.traceKey[0] = '\0';
+    ui.lineKey[0] = '\0';
+  }
+  // 前回の最後の列（伸びているかもしれない）から今の最後まで
+  const int from = ui.traceCol > 0 ? ui.traceCol - 1 : 0;
+  for (int x = from; x < used; ++x) traceColumn(x, top);
+  if (used > from) markDirty(from, TRACE_Y0, used - from, TRACE_H);
+  ui.traceCol = used;
+
+  char buf[24];
+  const uint32_t t = (uint32_t)((uint64_t)used * speedTrace.spanMs() / 1000);
+  snprintf(buf, sizeof(buf), "%lu:%02lu  %.1fkm/h", (unsigned long)(t / 60), (unsigned long)(t % 60),
+           speedTrace.hasMax() ? speedTrace.maxValue() / 10.0f : 0.0f);
+  drawTextIfChanged(150, 4, 170, 10, col(C_BLACK), col(C_WHITE), 1, buf, ui.traceKey, sizeof(ui.traceKey));
+
+  const TrackModel& tm = eng.track;
+  if (tm.state() != TrackModel::READY || !tm.matched()) snprintf(buf, sizeof(buf), "line -");
+  else if (tm.bin[tm.index()].n < 2) snprintf(buf, sizeof(buf), "line %+.1f", tm.lateralM());
+  else snprintf(buf, sizeof(buf), "line %+.1f  w %.1fm", tm.lateralM(), tm.widthM(tm.index()));
+  drawTextIfChanged(150, TRACE_Y0 + TRACE_H + 8, 170, 10, col(C_BLACK), col(C_WHITE), 1, buf, ui.lineKey, sizeof(ui.lineKey));
+  uiPush();
+}
+
+static void setPage(Page p) {
+  page = p;
+  ui = UiCache{};   // 戻った時は全部描き直す
+  if (p == PAGE_GG) drawGGStatic();
+  else if (p == PAGE_SUMMARY) summaryUpdate();
+  else if (p == PAGE_TRACE) traceUpdate();
+  else drawStaticUI();
+  uiPush();
 }
 
 /* =========================================================
    既存関数プロトタイプ
    ========================================================= */
-void ReadGPS();
-void CountLAP();
-void showvalue(int dulation);
+void ReadGPS(uint64_t us);
+void ReadButtons(uint64_t us, LoopInput& in);
+void showvalue(int dulation, uint32_t nowMs);
 void writeData();
+bool loadRoute();
+bool loadTrack();
+void saveTrack();
+void beginJournal();
+void writeRally(const RallyCrossing& ev);
+void aidPoll();
+void blackBox(uint32_t nowMs);
+void loadPb();
+void pbPoll(uint32_t ev);
+void savePoll(uint32_t ev, bool idle);
+void latencyReport(uint32_t nowMs, bool idle);
+void closeSession();
+void degradePoll(const LapRecord& r);
 
 /* =========================================================
    setup / loop（loopは使わない）
@@ -345,12 +722,25 @@ void writeData();
 void setup()
 {
   Serial.begin(115200);
+  Serial2.setRxBufferSize(GPS_RX_BUFFER);  // begin より前
   Serial2.begin(115200);
 
+#ifdef PPS_PIN
+  pinMode(PPS_PIN, INPUT);
+  attachInterrupt(digitalPinToInterrupt(PPS_PIN), onPps, RISING);
+#endif
+
   auto cfg = M5.config();
   M5.begin(cfg);
 
-  SD.begin();
+  const char* logs[] = { fname.c_str(), rallyFname.c_str(), ttffFname.c_str(), latFname.c_str(), sessionFname.c_str() };
+  for (const char* p : logs) {
+    if (!storage.addLog(p)) Serial.printf("[storage] too many logs, %s is not migrated\n", p);
+  }
+  storage.begin();
+
+  // 受信機が NMEA を出し始める前に前回の位置・時刻を渡す
+  aid.boot();
 
   M5.Speaker.end();
 
@@ -360,24 +750,104 @@ void setup()
   M5.Display.setCursor(10, 10);
   M5.Display.print("Start");
 
-  LapCount = 0;
-
-  file = SD.open(fname, FILE_APPEND);
+#if STORAGE_BENCH
+  storage.bench(Serial);
+#endif
+  Serial.printf("[telem] %u samples (%d s @ %d Hz), %u B\n",
+                (unsigned)telem.capacity(), TELEM_SECONDS, TELEM_HZ, (unsigned)telem.BYTES);
+  Serial.printf("[bb] %d s + %d s, %u B\n", BB_PRE_S, BB_POST_S, (unsigned)bb.BYTES);
+#if CO_BENCH
+  coBench(Serial);
+#endif
+
+  file = storage.openLog(fname.c_str());
   if (file) {
-    file.println("LAPCount,LapTime,TopSpeed,YYYY/MM/DD/Hour:Minute:Second");
+    file.println("LAPCount,LapTime,TopSpeed,YYYY/MM/DD/Hour:Minute:Second,LapSigma,Sectors");
     file.close();
   }
 
+  // 起動時の設定もジャーナルへ（再生側で同じ初期状態を作る）
+  beginJournal();
+  loadTrack();
+  loadPb();
+
+  if (loadRoute()) {
+    file = storage.openLog(rallyFname.c_str());
+    if (file) {
+      file.println("CP,Actual,Target,Diff,YYYY/MM/DD/Hour:Minute:Second");
+      file.close();
+    }
+  }
+  journalLog.blocking(false);  // ここから先は溜まりすぎたら捨てる（ループを止めない）
+
+  // ブラックボックスは SD のみ（内蔵フラッシュには入りきらない）
+  if (storage.sd()) bbOn = bbLog.begin(SD, bbFname.c_str());
+  if (bbOn && !storage.addWriter(bbLog)) Serial.println("[storage] too many SD writers (blackbox)");
+
   // 固定UIは1回だけ描画
+#if UI_BENCH
+  uiBench(Serial);
+#endif
+  uiBegin();
   drawStaticUI();
+  uiPush();
+  Serial.printf("[mem] static %u B, heap free %u B (largest block %u B, min %u B)\n", (unsigned)BIG_STATIC_BYTES,
+                (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMaxAllocHeap(), (unsigned)ESP.getMinFreeHeap());
 
   // ===== loop() を使わず setup内で回す =====
   for (;;) {
     M5.update();   // 入力更新（レスポンス改善）
 
-    ReadGPS();
-    CountLAP();
-    showvalue(100);
+    // このループの入力（時刻は1回だけ取る：再生と同じ値で計算するため）
+    uint64_t us = esp_timer_get_time();
+    LoopInput in;
+    in.nowMs = (uint32_t)(us / 1000);
+
+    ReadGPS(us);
+    ReadButtons(us, in);
+    if (journalOn) jrnl.loop(us);
+
+    latm.onConsume(esp_timer_get_time());
+    uint32_t ev = eng.step(in);
+    if (ev & EV_LAP) {
+      const LapRecord& r = eng.lastLap;
+      session.onLap(r.num, r.time, r.topSpeed, r.sectors, r.sector);
+      degradePoll(r);
+      predict.reset();
+      lapEndMs = in.nowMs;
+      if (session.active()) speedTrace.mark(in.nowMs);
+      writeData();
+      if (journalOn) jrnl.state(us, eng.stateHash());
+    }
+    if (ev & EV_TRACK) trackDirty = true;
+    if (ev & EV_RALLY) writeRally(eng.RallyLast);
+    aidPoll();
+    pbPoll(ev);
+    savePoll(ev, eng.KMPH < 3.0f);
+    if (ev & EV_MARK) bb.trigger(blackbox::R_MARK, in.nowMs);
+    blackBox(in.nowMs);
+    latencyReport(in.nowMs, eng.KMPH < 3.0f);  // SD・Serial への書出しは停車中だけ（受信を止めない）
+
+    if (eng.gps.fixCount() != telemFixCount) {
+      telemFixCount = eng.gps.fixCount();
+      geo::Vec2 p = eng.track.frame.toXY(eng.gps.location.lat(), eng.gps.location.lng());
+      telem.push(LapEngine::fixTime(in.nowMs), p.x, p.y, eng.KMPH, eng.TrackDist, eng.track.matched(), (uint16_t)eng.LapCount);
+      const bool wasActive = session.active();
+      if (session.onFix(in.nowMs, p.x, p.y, eng.KMPH)) closeSession();
+      if (session.active()) {
+        if (!wasActive) {
+          speedTrace.reset(in.nowMs);
+          degrade.reset();
+        }
+        speedTrace.push(in.nowMs, (int16_t)lroundf(eng.KMPH * 10.0f));
+      }
+      if (eng.LapCount >= 1 && eng.track.matched()) {
+        predict.onFix(LapEngine::fixTime(in.nowMs) - (uint32_t)eng.BeforeTime, eng.TrackDist, refLap);
+      }
+    }
+
+    showvalue(100, in.nowMs);
+    storage.poll(millis(), eng.KMPH < 3.0f);  // SD の抜き差しは停車中に見る
 
     delay(1);      // ESP32系の詰まり/WDT対策（yieldでも可）
   }
@@ -389,148 +859,134 @@ void loop()
 }
 
 /* =========================================================
-   GPS読み取り＆状態更新
+   GPS読み取り（UART → ジャーナル → エンジン）
    ========================================================= */
-void ReadGPS()
+void ReadGPS(uint64_t us)
 {
-  // GPSデコード
-  while (Serial2.available()) {
-    char c = (char)Serial2.read();
-    gps.encode(c);
-    Serial.print(c);
-  }
-
-  // GPSデータ展開
-  LAT = (float)gps.location.lat();
-  LONG = (float)gps.location.lng();
-  YEAR = gps.date.year();
-  MONTH = gps.date.month();
-  DAY = gps.date.day();
-  HOUR = gps.time.hour();
-  MINUTE = gps.time.minute();
-  SECOND = gps.time.second();
-  KMPH = (float)gps.speed.kmph();
-  ALTITUDE = (float)gps.altitude.meters();
-  distanceToMeter0 = (float)TinyGPSPlus::distanceBetween(gps.location.lat(), gps.location.lng(), LAT0, LONG0);
-  SatVal = gps.satellites.value();
-
-  // ラップ計測中の最高速度
-  if (TopSpeed < KMPH) {
-    TopSpeed = KMPH;
-  }
-
-  // JST変換（簡易：日付繰り上げのみ。月末処理などは元コード同様未対応）
-  HOUR += 9;
-  if (HOUR >= 24) {
-    DAY += HOUR / 24;
-    HOUR = HOUR % 24;
-  }
-
-  // 相対距離原点設定（BtnA）
-  if (M5.BtnA.isPressed()) {
-    LAT0 = LAT;
-    LONG0 = LONG;
-    distanceToMeter0 = (float)TinyGPSPlus::distanceBetween(gps.location.lat(), gps.location.lng(), LAT0, LONG0);
-  }
-
-  // LAPRAD変更（BtnB）
-  if (!M5.BtnB.isPressed() && LAPRADchange == true) {
-    LAPRADchange = false;
-  }
-
-  if (M5.BtnB.isPressed() && LAPRADchange == false) {
-    if (LAPRAD == 50) {
-      LAPRAD = 0;
+#ifdef PPS_PIN
+  // PPS は割込みで取った時刻のまま（UART より先に出して時刻順を保つ）
+  while (ppsTail != ppsHead) {
+    uint64_t t = ppsUs[ppsTail++ & 3];
+    if (journalOn) jrnl.pps(t);
+    latm.onPps(t);
+  }
+#endif
+
+  uint8_t buf[journal::MAX_CHUNK];
+  int n;
+  while ((n = Serial2.available()) > 0) {
+    if (n > (int)sizeof(buf)) n = sizeof(buf);
+    n = Serial2.read(buf, n);
+    if (n <= 0) break;
+
+    if (journalOn) jrnl.uart(us, buf, n);
+    aid.onRx(buf, n);
+    latm.onBytes(esp_timer_get_time(), buf, n);
+    eng.feed(buf, n);
+    if (eng.gps.fixCount() != latFixCount) {
+      latFixCount = eng.gps.fixCount();
+      latm.onCommit(esp_timer_get_time());
     }
-    LAPRAD += 5;
-    LAPRADchange = true;
+    Serial.write(buf, n);
   }
 }
 
 /* =========================================================
-   ラップ計測
+   ボタン（エッジだけジャーナルへ）
    ========================================================= */
-void CountLAP()
+void ReadButtons(uint64_t us, LoopInput& in)
 {
-  if (distanceToMeter0 >= LAPRAD && !M5.BtnC.isPressed() && LAPCOUNTNOW == true) {
-    LAPCOUNTNOW = false;
-  }
-
-  // 4ラップ計測（元コードそのまま）
-  if (((distanceToMeter0 != 0 && distanceToMeter0 <= LAPRAD) || M5.BtnC.isPressed())
-      && LAPCOUNTNOW == false
-      && ((millis() - BeforeTime) / 1000) > 10)
-  {
-    if (LapCount > 0) {
-      LAP5 = LAP4;
-      LAP4 = LAP3;
-      LAP3 = LAP2;
-      LAP2 = LAP1;
-      LAP1 = LAP;
-
-      LAP = (millis() - BeforeTime) / 1000;
-      BeforeTime = millis();
-
-      if (LAP < BestLap) {
-        BestLap = LAP;
-        BestLapNum = LapCount;
-      }
-      writeData();
+  in.btnA = M5.BtnA.isPressed();
+  in.btnB = M5.BtnB.isPressed();
+  in.btnC = M5.BtnC.isPressed();
+
+  // BtnB 長押しで画面切替（短押しの LAPRAD 変更はエンジンが離した時に判定）
+  static uint32_t btnBDownMs;
+  static bool pageHeld;
+  if (in.btnB && !btnPrev[1]) btnBDownMs = in.nowMs;
+  if (!in.btnB) pageHeld = false;
+  else if (!pageHeld && in.nowMs - btnBDownMs >= LapEngine::LONG_PRESS_MS) {
+    pageHeld = true;
+    setPage(page == PAGE_MAIN ? PAGE_GG : page == PAGE_GG ? PAGE_SUMMARY : page == PAGE_SUMMARY ? PAGE_TRACE : PAGE_MAIN);
+  }
 
-      Sprit += LAP;
-      if (LapCount > 1) {
-        AverageLap = Sprit / LapCount;
-      }
-    } else {
-      BeforeTime = millis();
+  const bool now[3] = { in.btnA, in.btnB, in.btnC };
+  for (int i = 0; i < 3; ++i) {
+    if (now[i] != btnPrev[i]) {
+      btnPrev[i] = now[i];
+      if (journalOn) jrnl.button(us, i, now[i]);
     }
-
-    LapCount++;
-    LAPCOUNTNOW = true;
   }
 }
 
 /* =========================================================
    差分描画（変更があった場所だけ更新）
    ========================================================= */
-void showvalue(int dulation) {
-  if (millis() <= lastdulation + dulation) return;
-  lastdulation = millis();
+// nowMs はこのループの時刻（in.nowMs）。ラップ・ラリーの経過は計測と同じ fixTime で数える
+void showvalue(int dulation, uint32_t nowMs) {
+  if (page == PAGE_GG) {
+    ggUpdate();
+    return;
+  }
+  if (page == PAGE_SUMMARY) {
+    summaryUpdate();
+    return;
+  }
+  if (page == PAGE_TRACE) {
+    traceUpdate();
+    return;
+  }
+  if (nowMs <= lastdulation + dulation) return;
+  lastdulation = nowMs;
+  const uint32_t fixNow = LapEngine::fixTime(nowMs);
 
   char buf[64];
 
   // ===== 時刻表示 =====
   snprintf(buf, sizeof(buf), "%04d/%02d/%02d %02d:%02d:%02d",
-           YEAR, MONTH, DAY, HOUR, MINUTE, SECOND);
+           eng.YEAR, eng.MONTH, eng.DAY, eng.HOUR, eng.MINUTE, eng.SECOND);
 
   drawTextIfChanged(
     0, 0, 320, 18,
-    BLACK, WHITE, 2,
+    col(C_BLACK), col(C_WHITE), 2,
     buf, ui.timeLine, sizeof(ui.timeLine)
   );
 
   // ===== 衛星数 =====
-  snprintf(buf, sizeof(buf), "%d", SatVal);
+  snprintf(buf, sizeof(buf), "%d", eng.SatVal);
   drawTextIfChanged(
     285, 1, 35, 18,
-    BLACK, CYAN, 2,
+    col(C_BLACK), col(C_CYAN), 2,
     buf, ui.sat, sizeof(ui.sat)
   );
 
-  // ===== LAPRAD 数字部分 =====
-  snprintf(buf, sizeof(buf), "%.0f", LAPRAD);
+  // ===== eng.LAPRAD 数字部分 =====
+  snprintf(buf, sizeof(buf), "%.0f", eng.LAPRAD);
   drawTextIfChanged(
     165, 228, 40, 12,
-    BLACK, 47072, 1,
+    col(C_BLACK), col(C_RAD), 1,
     buf, ui.lapRad, sizeof(ui.lapRad)
   );
 
-  // ===== 前ラップ表示（黄色帯：キーが変わった時だけ更新）=====
+  // ===== ログの保存先（SD / FL=内蔵フラッシュ / --=なし）=====
+  drawTextIfChanged(
+    206, 228, 20, 12,
+    col(C_BLACK), storage.sd() ? col(C_GREEN) : col(C_RED), 1,
+    storage.label(), ui.storage, sizeof(ui.storage)
+  );
+
+  // ===== 前ラップ / 予想タイム表示（黄色帯：キーが変わった時だけ更新）=====
+  const bool showPred = !eng.rally.active() && predict.valid()
+                        && (eng.LapCount == 1 || nowMs - lapEndMs >= LAP_HOLD_MS);
   char key[32];
-  if (LapCount > 1) {
-    snprintf(key, sizeof(key), "L%d:%.3f", LapCount - 1, LAP);
-  } else if (LapCount == 1) {
-    float t = (millis() - BeforeTime) / 1000.0f;
+  if (eng.rally.active()) {
+    snprintf(key, sizeof(key), "CP%d/%d:%d", eng.rally.next(), eng.rally.count, (int)(eng.RallyLast.diffMs() / 100));
+  } else if (showPred) {
+    snprintf(key, sizeof(key), "P%d:%lu", eng.LapCount, (unsigned long)(predict.predictedMs() / 10));
+  } else if (eng.LapCount > 1) {
+    snprintf(key, sizeof(key), "L%d:%.3f:%.2f", eng.LapCount - 1, eng.LAP, eng.LapSigma);
+  } else if (eng.LapCount == 1) {
+    float t = (fixNow - eng.BeforeTime) / 1000.0f;
     snprintf(key, sizeof(key), "L1:%.3f", t);
   } else {
     snprintf(key, sizeof(key), "L0");
@@ -539,126 +995,215 @@ void showvalue(int dulation) {
   if (strcmp(key, ui.lapPanelKey) != 0) {
     cacheCopy(ui.lapPanelKey, sizeof(ui.lapPanelKey), key);
 
-    M5.Display.fillRect(0, 20, 320, 59, YELLOW);
-    M5.Display.setTextColor(BLACK);
-
-    if (LapCount > 1) {
-      M5.Display.setTextSize(3);
-      M5.Display.setCursor(15, 30);
-      M5.Display.print(LapCount - 1);
-      M5.Display.print(">");
-
-      M5.Display.setTextSize(6);
-      M5.Display.print(LAP, 3);
-    } else if (LapCount == 1) {
-      M5.Display.setTextSize(3);
-      M5.Display.setCursor(15, 30);
-      M5.Display.print(LapCount);
-      M5.Display.print(">");
-
-      M5.Display.setTextSize(6);
-      M5.Display.print((millis() - BeforeTime) / 1000.0f, 3);
+    gfx->fillRect(0, 20, 320, 59, col(C_YELLOW));
+    markDirty(0, 20, 320, 59);
+    gfx->setTextColor(col(C_BLACK));
+
+    if (eng.rally.active()) {
+      // 次の CP と 直前 CP の誤差
+      gfx->setTextSize(3);
+      gfx->setCursor(15, 30);
+      gfx->print("CP");
+      gfx->print(eng.rally.next());
+      gfx->print("/");
+      gfx->print(eng.rally.count - 1);
+
+      if (eng.RallyLast.index > 0) {
+        gfx->setTextSize(4);
+        gfx->setCursor(170, 34);
+        if (eng.RallyLast.diffMs() > 0) gfx->print("+");
+        gfx->print(eng.RallyLast.diffMs() / 1000.0f, 1);
+      }
+    } else if (showPred) {
+      // 予想タイム（周回番号の代わりに P、右上に前ラップ）
+      gfx->setTextSize(3);
+      gfx->setCursor(15, 30);
+      gfx->print("P>");
+
+      gfx->setTextSize(6);
+      gfx->print(predict.predictedMs() / 1000.0f, 2);
+
+      if (eng.LapCount > 1) {
+        gfx->setTextSize(1);
+        gfx->setCursor(240, 22);
+        gfx->print("last ");
+        gfx->print(eng.LAP, 3);
+      }
+    } else if (eng.LapCount > 1) {
+      gfx->setTextSize(3);
+      gfx->setCursor(15, 30);
+      gfx->print(eng.LapCount - 1);
+      gfx->print(">");
+
+      gfx->setTextSize(6);
+      gfx->print(eng.LAP, 3);
+
+      // 不確かさ（右上に小さく）
+      gfx->setTextSize(1);
+      gfx->setCursor(240, 22);
+      gfx->print("+/-");
+      gfx->print(eng.LapSigma, 2);
+      gfx->print("s");
+
+      // 区間タイムと不確かさ（左上に小さく。入りきらない分は切る）
+      const LapRecord& r = eng.lastLap;
+      if (r.sectors > 0) {
+        char sec[37];   // 36文字 = 216px（右上の不確かさの手前まで）
+        int k = 0;
+        for (int i = 0; i < r.sectors && k < (int)sizeof(sec) - 1; ++i) {
+          k += snprintf(sec + k, sizeof(sec) - k, "%s%.2f(%.2f)", i ? " " : "", r.sector[i], r.sectorSigma[i]);
+        }
+        gfx->setCursor(15, 22);
+        gfx->print(sec);
+      }
+    } else if (eng.LapCount == 1) {
+      gfx->setTextSize(3);
+      gfx->setCursor(15, 30);
+      gfx->print(eng.LapCount);
+      gfx->print(">");
+
+      gfx->setTextSize(6);
+      gfx->print((fixNow - eng.BeforeTime) / 1000.0f, 3);
     }
   }
 
   // ===== タイム差（色と値が変わった時だけ）=====
-  float d = (LapCount > 1) ? (LAP - LAP1) : 0.0f;
+  float d = (eng.LapCount > 1) ? (eng.LAP - eng.LAP1) : 0.0f;
+  if (eng.rally.active()) d = eng.rally.aheadBehindMs(fixNow) / 1000.0f; // 理想スケジュールとの差
   char dstr[16];
   if (d > 0) snprintf(dstr, sizeof(dstr), "+%.1f", d);
   else       snprintf(dstr, sizeof(dstr), "%.1f", d);
 
-  uint16_t bg = (d <= 0) ? BLUE : RED;
+  uint16_t bg = (d <= 0) ? col(C_BLUE) : col(C_RED);
 
   if (bg != ui.deltaBg || strcmp(dstr, ui.delta) != 0) {
     ui.deltaBg = bg;
     cacheCopy(ui.delta, sizeof(ui.delta), dstr);
 
-    M5.Display.fillRect(1, 80, 178, 50, bg);
+    gfx->fillRect(1, 80, 178, 50, bg);
+    markDirty(1, 80, 178, 50);
 
-    M5.Display.setTextSize(4);
-    M5.Display.setTextColor(BLACK);
-    M5.Display.setCursor(10, 92);
-    M5.Display.print(dstr);
+    gfx->setTextSize(4);
+    gfx->setTextColor(col(C_BLACK));
+    gfx->setCursor(10, 92);
+    gfx->print(dstr);
 
-    M5.Display.setTextColor(WHITE);
-    M5.Display.setCursor(8, 90);
-    M5.Display.print(dstr);
+    gfx->setTextColor(col(C_WHITE));
+    gfx->setCursor(8, 90);
+    gfx->print(dstr);
   }
 
   // ===== 経過時間 =====
-  int elapsed = (int)((millis() - BeforeTime) / 1000.0f);
+  int elapsed = eng.rally.active() ? (int)(eng.rally.elapsedMs(fixNow) / 1000)
+                               : (int)((fixNow - eng.BeforeTime) / 1000.0f);
   snprintf(buf, sizeof(buf), "%d", elapsed);
   drawTextIfChanged(
     190, 90, 105, 30,
-    BLACK, WHITE, 4,
+    col(C_BLACK), col(C_WHITE), 4,
     buf, ui.elapsed, sizeof(ui.elapsed)
   );
 
   // ===== Best =====
-  char bestKey[24];
-  if (BestLap != 99999) snprintf(bestKey, sizeof(bestKey), "(%d)%.3f", BestLapNum, BestLap);
+  char bestKey[48];
+  if (eng.BestLap != 99999) snprintf(bestKey, sizeof(bestKey), "(%d)%.3f", eng.BestLapNum, eng.BestLap);
   else                  snprintf(bestKey, sizeof(bestKey), "NONE");
+  if (eng.rolling.valid()) {
+    size_t k = strlen(bestKey);
+    snprintf(bestKey + k, sizeof(bestKey) - k, "/R%.2f@%.0f", eng.rolling.bestS(), eng.rolling.bestStartM());
+  }
+  if (pbIdx >= 0) {
+    size_t k = strlen(bestKey);
+    snprintf(bestKey + k, sizeof(bestKey) - k, "/P%.3f:%.3f", pbReg.at(pbIdx).bestLap, eng.LapCount > 1 ? eng.LAP : 0.0f);
+  }
 
   if (strcmp(bestKey, ui.bestKey) != 0) {
     cacheCopy(ui.bestKey, sizeof(ui.bestKey), bestKey);
 
-    M5.Display.fillRect(0, 135, 320, 35, BLACK);
-
-    if (BestLap != 99999) {
-      M5.Display.setTextColor(CYAN);
-      M5.Display.setTextSize(2);
-      M5.Display.setCursor(20, 145);
-      M5.Display.print("Best(");
-      M5.Display.print(BestLapNum);
-      M5.Display.print(")");
-
-      M5.Display.setCursor(120, 140);
-      M5.Display.setTextSize(3);
-      M5.Display.print("> ");
-      M5.Display.print(BestLap);
+    gfx->fillRect(0, 135, 320, 35, col(C_BLACK));
+    markDirty(0, 135, 320, 35);
+
+    if (eng.BestLap != 99999) {
+      gfx->setTextColor(col(C_CYAN));
+      gfx->setTextSize(2);
+      gfx->setCursor(20, 145);
+      gfx->print("Best(");
+      gfx->print(eng.BestLapNum);
+      gfx->print(")");
+
+      gfx->setCursor(120, 140);
+      gfx->setTextSize(3);
+      gfx->print("> ");
+      gfx->print(eng.BestLap);
+
+      // 任意スタートのベスト（計測ラインをまたいだ最速1周）と その起点
+      if (eng.rolling.valid()) {
+        gfx->setTextSize(1);
+        gfx->setCursor(20, 162);
+        gfx->print("Roll ");
+        gfx->print(eng.rolling.bestS(), 2);
+        gfx->print(" @");
+        gfx->print((int)eng.rolling.bestStartM());
+        gfx->print("m");
+      }
     } else {
-      M5.Display.setTextColor(CYAN);
-      M5.Display.setTextSize(2);
-      M5.Display.setCursor(20, 145);
-      M5.Display.print("Best");
+      gfx->setTextColor(col(C_CYAN));
+      gfx->setTextSize(2);
+      gfx->setCursor(20, 145);
+      gfx->print("Best");
+    }
+
+    // このコースの歴代ベストと、直前ラップとの差
+    if (pbIdx >= 0) {
+      const PbEntry& pb = pbReg.at(pbIdx);
+      gfx->setTextColor(col(C_CYAN));
+      gfx->setTextSize(1);
+      gfx->setCursor(150, 162);
+      gfx->print("PB ");
+      gfx->print(pb.bestLap, 3);
+      if (eng.LapCount > 1) {
+        float dd = eng.LAP - pb.bestLap;
+        gfx->print(dd > 0 ? " +" : " ");
+        gfx->print(dd, 2);
+      }
     }
   }
 
   // ===== Average =====
   char avgKey[24];
-  if (AverageLap != 0) snprintf(avgKey, sizeof(avgKey), "%.3f", AverageLap);
+  if (eng.AverageLap != 0) snprintf(avgKey, sizeof(avgKey), "%.3f", eng.AverageLap);
   else                snprintf(avgKey, sizeof(avgKey), "NONE");
 
   if (strcmp(avgKey, ui.avgKey) != 0) {
     cacheCopy(ui.avgKey, sizeof(ui.avgKey), avgKey);
 
-    M5.Display.fillRect(0, 170, 320, 28, BLACK);
+    gfx->fillRect(0, 170, 320, 28, col(C_BLACK));
+    markDirty(0, 170, 320, 28);
 
-    M5.Display.setTextColor(PINK);
-    M5.Display.setTextSize(2);
-    M5.Display.setCursor(20, 175);
-    M5.Display.print("Average");
+    gfx->setTextColor(col(C_PINK));
+    gfx->setTextSize(2);
+    gfx->setCursor(20, 175);
+    gfx->print("Average");
 
-    if (AverageLap != 0) {
-      M5.Display.setCursor(120, 170);
-      M5.Display.setTextSize(3);
-      M5.Display.print("> ");
-      M5.Display.print(AverageLap);
+    if (eng.AverageLap != 0) {
+      gfx->setCursor(120, 170);
+      gfx->setTextSize(3);
+      gfx->print("> ");
+      gfx->print(eng.AverageLap);
     }
   }
 
   // ===== バー（毎秒変化しやすい）=====
-  float tsec = (millis() - BeforeTime) / 1000.0f;
+  float tsec = (fixNow - eng.BeforeTime) / 1000.0f;
 
   int wAvg = 0;
-  if (AverageLap > 0) {
-    float r = (AverageLap - tsec) / AverageLap;
+  if (eng.AverageLap > 0) {
+    float r = (eng.AverageLap - tsec) / eng.AverageLap;
     wAvg = clampi((int)(300.0f * r), 0, 300);
   }
 
   int wBest = 0;
-  if (BestLap != 99999) {
-    float r = (BestLap - tsec) / BestLap;
+  if (eng.BestLap != 99999) {
+    float r = (eng.BestLap - tsec) / eng.BestLap;
     wBest = clampi((int)(300.0f * r), 0, 300);
   }
 
@@ -667,42 +1212,382 @@ void showvalue(int dulation) {
     ui.barAvgW = wAvg;
     ui.barBestW = wBest;
 
-    M5.Display.fillRect(10, 200, 300, 25, BLACK);
-    if (wAvg > 0)  M5.Display.fillRect(10, 200, wAvg, 25, PINK);
-    if (wBest > 0) M5.Display.fillRect(10, 200, wBest, 25, CYAN);
-    M5.Display.drawRect(10, 200, 300, 25, WHITE);
+    gfx->fillRect(10, 200, 300, 25, col(C_BLACK));
+    markDirty(10, 200, 300, 25);
+    if (wAvg > 0)  gfx->fillRect(10, 200, wAvg, 25, col(C_PINK));
+    if (wBest > 0) gfx->fillRect(10, 200, wBest, 25, col(C_CYAN));
+    gfx->drawRect(10, 200, 300, 25, col(C_WHITE));
   }
 
   // ===== 時速・距離（バー更新で塗られるので必要なら強制再描画）=====
-  snprintf(buf, sizeof(buf), "%.1f km/h", KMPH);
+  snprintf(buf, sizeof(buf), "%.1f km/h", eng.KMPH);
   drawTextIfChanged(
     20, 205, 130, 18,
-    BLACK, WHITE, 2,
+    col(C_BLACK), col(C_WHITE), 2,
     buf, ui.speed, sizeof(ui.speed),
     barsChanged
   );
 
-  snprintf(buf, sizeof(buf), "%.1f m", distanceToMeter0);
+  snprintf(buf, sizeof(buf), "%.1f m", eng.distanceToMeter0);
   drawTextIfChanged(
     160, 205, 150, 18,
-    BLACK, WHITE, 2,
+    col(C_BLACK), col(C_WHITE), 2,
     buf, ui.dist, sizeof(ui.dist),
     barsChanged
   );
+
+  uiPush();
 }
 
 /* =========================================================
    SD書き込み（元コード準拠）
    ========================================================= */
 void writeData() {
-  file = SD.open(fname , FILE_APPEND);
+  file = storage.openLog(fname.c_str());
   if (!file) return;
 
-  file.print((String)LapCount + ",");
-  file.print((String)LAP + ",");
-  file.print((String)TopSpeed + ",");
-  file.println((String)YEAR + "/" + (String)MONTH + "/" + (String)DAY + "-" + (String)HOUR + ":" + (String)MINUTE + ":" + (String)SECOND + ",");
+  const LapRecord& r = eng.lastLap;
+  file.print((String)r.num + ",");
+  file.print((String)r.time + ",");
+  file.print((String)r.topSpeed + ",");
+  file.print((String)eng.YEAR + "/" + (String)eng.MONTH + "/" + (String)eng.DAY + "-" + (String)eng.HOUR + ":" + (String)eng.MINUTE + ":" + (String)eng.SECOND + "," + String(r.sigma, 3) + ",");
+  // 区間タイムは "/" 区切りで「タイム(不確かさ)」（区間なし・取りこぼしは空）
+  for (int i = 0; i < r.sectors; ++i) {
+    if (i > 0) file.print("/");
+    file.print(String(r.sector[i], 3) + "(" + String(r.sectorSigma[i], 3) + ")");
+  }
+  file.println();
   file.close();
+}
+
+/* =========================================================
+   ラリー：ルート読込み
+   /route.csv : 1行1CP「lat1,lon1,lat2,lon2,ルート距離m,目標秒」
+   1行目(CP0)がスタート線。'#' 行は無視
+   ========================================================= */
+bool loadRoute() {
+  file = storage.openConfig(routeFname.c_str());
+  if (!file) return false;
+
+  char line[128];
+  int n = 0;
+
+  for (;;) {
+    int c = file.read();
+    if (c >= 0 && c != '\n' && n < (int)sizeof(line) - 1) {
+      if (c != '\r') line[n++] = (char)c;
+      continue;
+    }
+    line[n] = '\0';
+    eng.addRouteLine(line);
+    if (journalOn && n > 0) {
+      line[n] = '\n';
+      jrnl.file(esp_timer_get_time(), journal::FILE_ROUTE, line, n + 1);
+    }
+
+    n = 0;
+    if (c < 0) break;
+  }
+  file.close();
+
+  return eng.finishRoute();
+}
+
+/* =========================================================
+   ラリー：CP 通過ログ
+   ========================================================= */
+void writeRally(const RallyCrossing& ev) {
+  file = storage.openLog(rallyFname.c_str());
+  if (!file) return;
+
+  file.print((String)ev.index + ",");
+  file.print(String(ev.actualMs / 1000.0f, 2) + ",");
+  file.print(String(ev.targetMs / 1000.0f, 2) + ",");
+  file.print(String(ev.diffMs() / 1000.0f, 2) + ",");
+  file.println((String)eng.YEAR + "/" + (String)eng.MONTH + "/" + (String)eng.DAY + "-" + (String)eng.HOUR + ":" + (String)eng.MINUTE + ":" + (String)eng.SECOND);
+  file.close();
+}
+
+/* =========================================================
+   コース中心線：保存／読込み（ヘッダ＋ビン配列のバイナリ）
+   ========================================================= */
+bool loadTrack() {
+  file = storage.openCache(trackFname.c_str());
+  if (!file) return false;
+
+  TrackFileHeader h;
+  bool ok = file.read((uint8_t*)&h, sizeof(h)) == sizeof(h) && eng.applyTrackHeader(h);
+  size_t n = sizeof(TrackBin) * eng.track.bins();
+  if (ok) ok = file.read((uint8_t*)eng.track.bin, n) == n;
+  if (ok && h.version >= 2) ok = file.read((uint8_t*)&eng.track.meta, sizeof(TrackFileMeta)) == sizeof(TrackFileMeta);
+  file.close();
+  if (ok && !eng.track.validateMeta()) Serial.println("[track] bad sector table, sectors ignored");
+
+  if (!ok) {
+    eng.begin(); // 読めなかったら既定の原点で学習し直す
+    return false;
+  }
+
+  if (journalOn) {
+    uint64_t us = esp_timer_get_time();
+    jrnl.file(us, journal::FILE_TRACK, &h, sizeof(h));
+    jrnl.file(us, journal::FILE_TRACK, eng.track.bin, n);
+    if (h.version >= 2) jrnl.file(us, journal::FILE_TRACK, &eng.track.meta, sizeof(TrackFileMeta));
+  }
+  return true;
+}
+
+void saveTrack() {
+  file = storage.createCache(trackFname.c_str());
+  if (!file) return;
 
-  TopSpeed = 0; // 最高速度をリセット
+  TrackFileHeader h;
+  eng.track.header(h);
+  eng.track.updateBounds();
+  file.write((const uint8_t*)&h, sizeof(h));
+  file.write((const uint8_t*)eng.track.bin, sizeof(TrackBin) * eng.track.bins());
+  file.write((const uint8_t*)&eng.track.meta, sizeof(TrackFileMeta));
+  file.close();
+  storage.mirror(trackFname.c_str());
+}
+
+/* =========================================================
+   コースごとの自己ベスト（/pb.bin）と基準ラップ（/ref_xxxxxxxx.bin）
+   - 内蔵フラッシュが正（SD には複製）。どちらも一時ファイル → 置換えで書く
+   - 計測原点が変わった時（起動時の track.bin・BtnA）に1回だけ引く
+   - 自己ベストが出たら、その周を RAM のテレメトリから基準ラップにする
+   ========================================================= */
+static bool replaceAndMirror(const char* tmp, const char* path) {
+  if (!storage.replaceCache(tmp, path)) return false;
+  storage.mirror(path);
+  return true;
+}
+
+void loadPb() {
+  pbReg.clear();
+  File f = storage.openCache(pbFname.c_str());
+  if (!f) return;
+  PbFileHeader h;
+  if (f.read((uint8_t*)&h, sizeof(h)) == sizeof(h) && pbReg.beginLoad(h)) {
+    if (f.read((uint8_t*)pbReg.entries(), pbReg.bytes()) != pbReg.bytes()) pbReg.clear();
+  }
+  f.close();
+}
+
+static void loadRef() {
+  refLap.clear();
+  if (pbIdx < 0 || !pbReg.at(pbIdx).ref[0]) return;
+  File f = storage.openCache(pbReg.at(pbIdx).ref);
+  if (!f) return;
+  RefLapHeader h;
+  uint32_t* t = nullptr;
+  if (f.read((uint8_t*)&h, sizeof(h)) == sizeof(h)) t = refLap.beginLoad(h);
+  if (t && f.read((uint8_t*)t, refLap.tableBytes()) != refLap.tableBytes()) refLap.clear();
+  f.close();
+}
+
+static void savePb() {
+  const char* tmp = "/pb.tmp";
+  File f = storage.createCache(tmp);
+  if (!f) return;
+  bool ok = f.write((const uint8_t*)&pbReg.header(), sizeof(PbFileHeader)) == sizeof(PbFileHeader)
+         && f.write((const uint8_t*)pbReg.entries(), pbReg.bytes()) == pbReg.bytes();
+  f.close();
+  if (ok) replaceAndMirror(tmp, pbFname.c_str());
+}
+
+// 直前のラップ（eng.lastLap）を基準ラップにする（RAM だけ。保存は saveRef）
+static bool buildRef() {
+  const LapRecord& r = eng.lastLap;
+  size_t from, to;
+  if (eng.track.state() != TrackModel::READY || !telem.lapRange((uint16_t)r.num, from, to)) return false;
+
+  const uint32_t lapMs = (uint32_t)(r.time * 1000.0f + 0.5f);
+  const uint32_t startMs = (uint32_t)eng.BeforeTime - lapMs;
+  const PbEntry& e = pbReg.at(pbIdx);
+  return refLap.build(telem, from, to, startMs, lapMs, eng.track.bins(), eng.track.binM(), e.trackId);
+}
+
+static void saveRef() {
+  const PbEntry& e = pbReg.at(pbIdx);
+  char path[20];
+  snprintf(path, sizeof(path), "/ref_%08lx.bin", (unsigned long)e.trackId);
+  const char* tmp = "/ref.tmp";
+  File f = storage.createCache(tmp);
+  if (!f) return;
+  bool ok = f.write((const uint8_t*)&refLap.header(), sizeof(RefLapHeader)) == sizeof(RefLapHeader)
+         && f.write((const uint8_t*)refLap.table(), refLap.tableBytes()) == refLap.tableBytes();
+  f.close();
+  if (ok && replaceAndMirror(tmp, path)) pbReg.setRef(pbIdx, path);
+}
+
+// 書き待ちを全部書く（基準ラップ → それを指す自己ベストの順）
+static void flushSaves() {
+  if (trackDirty) saveTrack();
+  if (refDirty && pbIdx >= 0) saveRef();
+  if (pbDirty) savePb();
+  trackDirty = pbDirty = refDirty = false;
+  dirtyLaps = 0;
+}
+
+void savePoll(uint32_t ev, bool idle) {
+  if (!trackDirty && !pbDirty && !refDirty) return;
+  if ((ev & EV_LAP) && ++dirtyLaps >= SAVE_EVERY_LAPS) idle = true;
+  if (idle) flushSaves();
+}
+
+void pbPoll(uint32_t ev) {
+  if (eng.LAT0 != pbLat0 || eng.LONG0 != pbLon0) {
+    flushSaves();   // 前のコースの分（pbIdx・refLap を引き直す前に）
+    pbLat0 = eng.LAT0;
+    pbLon0 = eng.LONG0;
+    pbIdx = pbReg.find(pbLat0, pbLon0, PB_PROFILE);
+    loadRef();
+    predict.reset();
+    ui.bestKey[0] = '\0';
+  }
+  if (!(ev & EV_LAP)) return;
+
+  const LapRecord& r = eng.lastLap;
+  uint8_t ch = pbReg.onLap(pbIdx, pbLat0, pbLon0, PB_PROFILE, r.time, r.sectors, r.sector,
+                           eng.YEAR, eng.MONTH, eng.DAY);
+  if ((ch & PbRegistry::NEW_LAP) && buildRef()) refDirty = true;
+  if (ch) pbDirty = true;
+}
+
+/* =========================================================
+   GNSS ウォームスタート補助と TTFF
+   - 起動時 : aid.bin の位置（＋RTC があれば時刻）と aid_dbd.bin の航法データを送る
+   - 走行中 : 最初のフィックスで TTFF を /TTFF_log.csv へ
+   - 停車中 : AID_SAVE_MS ごとに位置・時刻を保存し、RTC を UTC に合わせ、
+              u-blox なら航法データを吐き出させて保存（一時ファイル → 置換え）
+   - 手順は gnssaid::Assist（上の aid）。ここは TTFF の記録だけ
+   ========================================================= */
+static void logTtff() {
+  const gnssaid::Ttff& ttff = aid.ttff();
+  Serial.printf("[aid] TTFF %.1f s (aid: %s)\n", ttff.ms() / 1000.0f, aid.what());
+  file = storage.openLog(ttffFname.c_str());
+  if (!file) return;
+  if (file.size() == 0) file.println("YYYY/MM/DD-Hour:Minute:Second,Aid,TTFF");
+  file.printf("%04d/%02d/%02d-%02d:%02d:%02d,%s,%.1f\n",
+              eng.YEAR, eng.MONTH, eng.DAY, eng.HOUR, eng.MINUTE, eng.SECOND, aid.what(), ttff.ms() / 1000.0f);
+  file.close();
+}
+
+void aidPoll() {
+  if (aid.poll(eng.gps, eng.KMPH < 3.0f)) logTtff();
+}
+
+/* =========================================================
+   ブラックボックス（フィックス・IMU を積み、凍結したら空きぶんずつ書き出す）
+   ========================================================= */
+void blackBox(uint32_t nowMs) {
+  if (eng.gps.fixCount() != bbFixCount) {
+    bbFixCount = eng.gps.fixCount();
+    const GpsData& g = eng.gps;
+    bb.clock(g.date.year(), g.date.month(), g.date.day(), g.time.hour(), g.time.minute(), g.time.second());
+    bb.onFix(nowMs, g.location.lat(), g.location.lng(), eng.KMPH, (float)g.course.deg(), eng.AccLong, eng.AccLat);
+  }
+
+  if (M5.Imu.isEnabled() && nowMs - bbImuMs >= 1000 / BB_IMU_HZ) {
+    bbImuMs = nowMs;
+    float ax, ay, az, gx, gy, gz;
+    M5.Imu.getAccel(&ax, &ay, &az);
+    M5.Imu.getGyro(&gx, &gy, &gz);
+    bb.onImu(nowMs, ax, ay, az, gx, gy, gz);
+  }
+
+  bb.tick(nowMs);
+  if (bb.state() != blackbox::Recorder<>::DUMP) return;
+  if (!bbOn) {
+    bb.discard();
+    return;
+  }
+  if (bb.pump(bbLog)) {
+    Serial.printf("[bb] incident %lu (%s) -> %s\n",
+                  (unsigned long)bb.incidents(), blackbox::reasonName(bb.reason()), bbFname.c_str());
+  }
+}
+
+/* =========================================================
+   セッション終了：まとめを1行記録して、まとめ画面を出す
+   ========================================================= */
+void closeSession() {
+  if (session.laps() > 0) {
+    file = storage.openLog(sessionFname.c_str());
+    if (file) {
+      if (file.size() == 0) file.println("YYYY/MM/DD-Hour:Minute:Second,Laps,Best,BestLap,Theoretical,Average,SD,TopSpeed,BestLapTopSpeed,Distance_km,Duration_s");
+      file.printf("%04d/%02d/%02d-%02d:%02d:%02d,%d,%.3f,%d,%.3f,%.3f,%.3f,%.1f,%.1f,%.2f,%lu\n",
+                  eng.YEAR, eng.MONTH, eng.DAY, eng.HOUR, eng.MINUTE, eng.SECOND,
+                  session.laps(), session.best(), session.bestNum(), session.theoreticalBest(),
+                  session.average(), session.sd(), session.topKmph(), session.bestLapTopKmph(),
+                  session.distanceM() / 1000.0f, (unsigned long)session.durationS());
+      file.close();
+    }
+  }
+  setPage(PAGE_SUMMARY);
+}
+
+/* =========================================================
+   タイヤのたれ：ラップごとに判定して足し込み、傾きと DEGRADE_AHEAD 周先の予想を出す
+   ========================================================= */
+void degradePoll(const LapRecord& r) {
+  static const char* const kVerdict[] = { "used", "pending", "outlier", "in-lap", "out-lap" };
+  const DegradeTrend::Verdict v = degrade.onLap(r.time, r.sigma);
+  if (degrade.valid()) {
+    Serial.printf("[deg] stint %d lap %d %s: %+.3f s/lap, +%d laps %.2f\n", degrade.stint(), degrade.lapInStint(),
+                  kVerdict[v], degrade.slope(), DEGRADE_AHEAD, degrade.ahead());
+  } else {
+    Serial.printf("[deg] stint %d lap %d %s\n", degrade.stint(), degrade.lapInStint(), kVerdict[v]);
+  }
+}
+
+/* =========================================================
+   GNSS の遅延と間隔のゆらぎ（起動からの累計を定期的に出す）
+   - PPS があれば UTC 起点の遅延も出る。その平均を GNSS_LATENCY_MS に入れると
+     GPS で決まる通過時刻がその分さかのぼる
+   ========================================================= */
+void latencyReport(uint32_t nowMs, bool idle) {
+#if LAT_REPORT_S
+  // 走行中に書くと測っている遅延そのものを足すので、間隔が来ても止まるまで待つ（値は起動からの累計）
+  if (!idle || nowMs - latReportMs < LAT_REPORT_S * 1000UL || latm.epochs() == 0) return;
+  latReportMs = nowMs;
+  latm.report(Serial);
+
+  file = storage.openLog(latFname.c_str());
+  if (!file) return;
+  if (file.size() == 0) file.println("YYYY/MM/DD-Hour:Minute:Second,Stage,N,Mean,SD,P50,P95,P99,Min,Max");
+  for (int s = 0; s < gnsslat::Meter::STAGES; ++s) {
+    const gnsslat::Dist& d = latm.dist(s);
+    if (d.count() == 0) continue;
+    file.printf("%04d/%02d/%02d-%02d:%02d:%02d,%s,%lu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+                eng.YEAR, eng.MONTH, eng.DAY, eng.HOUR, eng.MINUTE, eng.SECOND,
+                gnsslat::Meter::name(s), (unsigned long)d.count(), d.meanMs(), d.sdMs(),
+                d.pctMs(0.50f), d.pctMs(0.95f), d.pctMs(0.99f), d.minMs(), d.maxMs());
+  }
+  file.close();
+#else
+  (void)nowMs;
+  (void)idle;
+#endif
+}
+
+/* =========================================================
+   入力ジャーナル：起動ごとに /JRNLnnnn.bin を新規作成
+   ========================================================= */
+void beginJournal() {
+  journalOn = false;
+#if JOURNAL_ENABLE
+  if (!storage.sd()) return;   // 内蔵フラッシュには入りきらないので SD のみ
+  char path[20];
+  for (int i = 0; i < 10000; ++i) {
+    snprintf(path, sizeof(path), "/JRNL%04d.bin", i);
+    if (!SD.exists(path)) break;
+  }
+  if (!journalLog.begin(SD, path)) return;
+  if (!storage.addWriter(journalLog)) Serial.println("[storage] too many SD writers (journal)");
+  journalOn = true;
+  journalLog.blocking(true);   // 設定ファイルを書き終えるまでは落とさない
+  jrnl.header();
+#endif
 }
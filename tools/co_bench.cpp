@@ -0,0 +1,164 @@
+/* =========================================================
+   コルーチン実行器（CoTask.h）のホストベンチマーク
+   - 2つのコルーチンが Signal で交互に起こし合う切替コストを、
+     2本のスレッドが条件変数で起こし合う場合（タスク切替の相当）と比べる
+   - スレッドプールで複数組を同時に回した時のスループット
+   - フレームプールが尽きた時に spawn が失敗すること（ヒープに行かない）
+   - ビルド: g++ -std=c++20 -O2 -pthread -Iinclude tools/co_bench.cpp -o co_bench
+   - 実行  : ./co_bench [往復回数] [スレッド数]
+   ========================================================= */
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CoTask.h"
+
+#ifndef CO_TASK_AVAILABLE
+#error "C++20 coroutines are required (-std=c++20)"
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+static double nsSince(Clock::time_point t0, long n) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / n;
+}
+
+/* ---------- 起こし合い（コルーチン） ---------- */
+static co::Task ping(co::Signal& out, co::Signal& in, long n, std::atomic<int>& done) {
+  for (long i = 0; i < n; ++i) {
+    out.notify();
+    co_await in;
+  }
+  done.fetch_add(1);
+}
+
+static co::Task pong(co::Signal& in, co::Signal& out, long n, std::atomic<int>& done) {
+  for (long i = 0; i < n; ++i) {
+    co_await in;
+    out.notify();
+  }
+  done.fetch_add(1);
+}
+
+/* ---------- 起こし合い（スレッド＋条件変数） ---------- */
+static double threadPingPong(long n) {
+  std::mutex m;
+  std::condition_variable cv;
+  long turn = 0;   // 偶数 = ping の番, 奇数 = pong の番
+
+  auto t0 = Clock::now();
+  std::thread b([&] {
+    for (long i = 0; i < n; ++i) {
+      std::unique_lock<std::mutex> lk(m);
+      cv.wait(lk, [&] { return turn % 2 == 1; });
+      ++turn;
+      cv.notify_one();
+    }
+  });
+  for (long i = 0; i < n; ++i) {
+    std::unique_lock<std::mutex> lk(m);
+    cv.wait(lk, [&] { return turn % 2 == 0; });
+    ++turn;
+    cv.notify_one();
+  }
+  b.join();
+  return nsSince(t0, 2 * n);
+}
+
+/* ---------- スレッドプール（Executor の wake フックで起こす） ---------- */
+struct Pool {
+  co::Executor& ex;
+  std::mutex m;
+  std::condition_variable cv;
+  long posted = 0;
+  bool stop = false;
+  std::vector<std::thread> th;
+
+  Pool(co::Executor& e, int n) : ex(e) {
+    ex.onWake([](void* p) {
+      Pool* self = (Pool*)p;
+      { std::lock_guard<std::mutex> lk(self->m); ++self->posted; }
+      self->cv.notify_one();
+    }, this);
+    for (int i = 0; i < n; ++i) th.emplace_back([this] { work(); });
+  }
+
+  ~Pool() {
+    { std::lock_guard<std::mutex> lk(m); stop = true; }
+    cv.notify_all();
+    for (auto& t : th) t.join();
+    ex.onWake(nullptr, nullptr);
+  }
+
+  void work() {
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lk(m);
+        cv.wait(lk, [&] { return stop || posted > 0; });
+        if (stop) return;
+        --posted;
+      }
+      ex.runOne();
+    }
+  }
+};
+
+int main(int argc, char** argv) {
+  const long n = argc > 1 ? atol(argv[1]) : 1000000;
+  const int threads = argc > 2 ? atoi(argv[2]) : (int)std::max(1u, std::thread::hardware_concurrency());
+
+  printf("frame pool: %zu slots x %zu B (static, no heap)\n",
+         co::Pool::SLOTS, co::Pool::SLOT_SIZE);
+
+  // 1スレッドで起こし合い
+  {
+    co::Executor ex;
+    co::Signal a(ex), b(ex);
+    std::atomic<int> done{ 0 };
+    auto t0 = Clock::now();
+    ex.spawn(pong(a, b, n, done));
+    ex.spawn(ping(a, b, n, done));
+    ex.run();
+    printf("coroutine switch (1 thread)  : %7.1f ns  [done %d, frames in use %zu]\n",
+           nsSince(t0, 2 * n), done.load(), co::framePool().used());
+  }
+
+  printf("thread switch (condvar)      : %7.1f ns\n", threadPingPong(n / 10));
+
+  // プールで複数組
+  {
+    const int pairs = (int)co::Pool::SLOTS / 2;
+    co::Executor ex;
+    std::vector<co::Signal*> sig;
+    std::atomic<int> done{ 0 };
+    auto t0 = Clock::now();
+    {
+      Pool pool(ex, threads);
+      for (int i = 0; i < pairs; ++i) {
+        sig.push_back(new co::Signal(ex));
+        sig.push_back(new co::Signal(ex));
+        ex.spawn(pong(*sig[2 * i], *sig[2 * i + 1], n / 10, done));
+        ex.spawn(ping(*sig[2 * i], *sig[2 * i + 1], n / 10, done));
+      }
+      while (done.load() < 2 * pairs) std::this_thread::yield();
+    }
+    printf("thread pool (%d thr, %d pairs): %7.1f ns/switch aggregate\n",
+           threads, pairs, nsSince(t0, 2 * (n / 10) * pairs));
+    for (auto* s : sig) delete s;
+  }
+
+  // プールが尽きたら spawn 失敗
+  {
+    co::Executor ex;
+    co::Signal never(ex);
+    std::atomic<int> done{ 0 };
+    size_t ok = 0;
+    for (size_t i = 0; i < co::Pool::SLOTS + 2; ++i) ok += ex.spawn(pong(never, never, 1, done));
+    printf("spawn beyond pool            : %zu of %zu accepted\n", ok, co::Pool::SLOTS + 2);
+  }
+  return 0;
+}
@@ -0,0 +1,324 @@
+/* =========================================================
+   GNSS ウォームスタート補助（GnssAid.h）の流れをホストで通しで確かめる
+   - 台本どおりに振る舞う偽の受信機（UBX / PMTK）に、端末と同じ gnssaid::Assist をつなぐ
+     （起動時に補助を送る → NMEA を読んで TTFF を測る → 停車中の保存 → 航法データの吐き出し）。
+     端末の部品（UART・フラッシュ・時計/RTC）だけ偽物に差し替える
+   - 受信機モデル：受け取った補助の中身で TTFF が決まる
+       cold = 補助なし／位置が 100 km 以上ずれている／壊れている
+       warm = 位置＋時刻、hot = さらに 4時間以内の航法データ
+   - 台本の各場面を順に実行し、期待した TTFF 区分と比べる（不一致で終了コード 1）
+   - ビルド: g++ -std=c++17 -O2 -Iinclude tools/fake_gnss.cpp -o fake_gnss
+   - 実行  : ./fake_gnss [-v]
+   ========================================================= */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "GnssAid.h"
+#include "TinyGPSPlus.h"
+
+using namespace gnssaid;
+using Parser = TinyGPSPlusT<GpsData, nmea::RMC, nmea::GGA>;
+
+static constexpr uint32_t COLD_MS = 32000, POS_MS = 26000, WARM_MS = 14000, HOT_MS = 3000;
+static constexpr int      DBD_FRAMES = 12;
+static bool verbose;
+
+static DateTime toDateTime(time_t t) {
+  struct tm g;
+  gmtime_r(&t, &g);
+  return DateTime{ (uint16_t)(g.tm_year + 1900), (uint8_t)(g.tm_mon + 1), (uint8_t)g.tm_mday,
+                   (uint8_t)g.tm_hour, (uint8_t)g.tm_min, (uint8_t)g.tm_sec };
+}
+
+static time_t fromDateTime(const DateTime& d) {
+  struct tm g = {};
+  g.tm_year = d.year - 1900;
+  g.tm_mon = d.month - 1;
+  g.tm_mday = d.day;
+  g.tm_hour = d.hour;
+  g.tm_min = d.minute;
+  g.tm_sec = d.second;
+  return timegm(&g);
+}
+
+static double distM(double la1, double lo1, double la2, double lo2) {
+  const double R = 6371000.0, r = M_PI / 180.0;
+  double dla = (la2 - la1) * r, dlo = (lo2 - lo1) * r;
+  double a = sin(dla / 2) * sin(dla / 2) + cos(la1 * r) * cos(la2 * r) * sin(dlo / 2) * sin(dlo / 2);
+  return 2 * R * asin(sqrt(a));
+}
+
+static std::string nmeaLine(const char* body) {
+  uint8_t cs = 0;
+  for (const char* p = body; *p; ++p) cs ^= (uint8_t)*p;
+  char tail[8];
+  snprintf(tail, sizeof(tail), "*%02X\r\n", cs);
+  return std::string("$") + body + tail;
+}
+
+/* =========================================================
+   偽の受信機
+   ========================================================= */
+struct FakeReceiver {
+  Proto  proto;
+  double lat, lon;     // 本当の位置
+  time_t utc0;         // 電源投入時の本当の UTC
+  uint32_t ms = 0;     // 電源投入からの時刻
+
+  bool posOk = false, timeOk = false;
+  int  ephOk = 0, rejected = 0;
+  std::vector<uint8_t> out{};
+  UbxScanner scan{};
+  std::string line{};
+
+  // 端末の UART 送信（Assist の Serial）
+  size_t write(const uint8_t* p, size_t n) {
+    rx(p, n);
+    return n;
+  }
+
+  uint32_t ttffMs() const {
+    if (posOk && timeOk && ephOk >= DBD_FRAMES) return HOT_MS;
+    if (posOk && timeOk) return WARM_MS;
+    if (posOk) return POS_MS;
+    return COLD_MS;
+  }
+
+  void rx(const uint8_t* p, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      if (proto == PROTO_UBX && scan.feed(p[i])) onUbx();
+      if (proto == PROTO_PMTK) onChar((char)p[i]);
+    }
+  }
+
+  void onUbx() {
+    if (scan.cls() != UBX_MGA) return;
+    const uint8_t* q = scan.payload();
+    auto i32 = [&](int o) { return (int32_t)(q[o] | q[o + 1] << 8 | q[o + 2] << 16 | (uint32_t)q[o + 3] << 24); };
+
+    if (scan.id() == UBX_MGA_INI && q[0] == 0x01) {
+      double d = distM(i32(4) / 1e7, i32(8) / 1e7, lat, lon);
+      posOk = d < 100000.0;
+      if (!posOk) ++rejected;
+    } else if (scan.id() == UBX_MGA_INI && q[0] == 0x10) {
+      DateTime t{ (uint16_t)(q[4] | q[5] << 8), q[6], q[7], q[8], q[9], q[10] };
+      uint16_t acc = (uint16_t)(q[16] | q[17] << 8);
+      timeOk = std::labs((long)(fromDateTime(t) - (utc0 + ms / 1000))) <= acc + 1;
+      if (!timeOk) ++rejected;
+    } else if (scan.id() == UBX_MGA_DBD && scan.payloadLen() == 0) {
+      // 吐き出し要求：作成時刻入りの航法データを返す
+      for (int k = 0; k < DBD_FRAMES; ++k) {
+        uint8_t pl[64] = {};
+        uint32_t made = (uint32_t)(utc0 + ms / 1000);
+        pl[0] = (uint8_t)k;
+        memcpy(pl + 4, &made, 4);
+        uint8_t f[8 + sizeof(pl)];
+        size_t n = ubxFrame(f, UBX_MGA, UBX_MGA_DBD, pl, sizeof(pl));
+        out.insert(out.end(), f, f + n);
+      }
+    } else if (scan.id() == UBX_MGA_DBD) {
+      uint32_t made;
+      memcpy(&made, q + 4, 4);
+      if ((long)(utc0 + ms / 1000) - (long)made < 4 * 3600) ++ephOk;
+    }
+  }
+
+  void onChar(char c) {
+    if (c == '$') line.clear();
+    line += c;
+    if (c != '\n') return;
+    // $PMTK741,lat,lon,alt,YYYY,MM,DD,hh,mm,ss*CS
+    size_t star = line.find('*');
+    if (line.compare(0, 8, "$PMTK741") != 0 || star == std::string::npos) return;
+    uint8_t cs = 0;
+    for (size_t i = 1; i < star; ++i) cs ^= (uint8_t)line[i];
+    if (strtoul(line.c_str() + star + 1, nullptr, 16) != cs) {
+      ++rejected;
+      return;
+    }
+    double la, lo;
+    int alt, y, mo, d, h, mi, s;
+    if (sscanf(line.c_str(), "$PMTK741,%lf,%lf,%d,%d,%d,%d,%d,%d,%d", &la, &lo, &alt, &y, &mo, &d, &h, &mi, &s) != 9) return;
+    posOk = distM(la, lo, lat, lon) < 100000.0;
+    DateTime t{ (uint16_t)y, (uint8_t)mo, (uint8_t)d, (uint8_t)h, (uint8_t)mi, (uint8_t)s };
+    timeOk = posOk && std::labs((long)(fromDateTime(t) - (utc0 + ms / 1000))) <= 3;
+    if (!posOk) ++rejected;
+  }
+
+  // 100 ms ごとに RMC / GGA（フィックス前は無効）
+  void tick10ms() {
+    ms += 10;
+    if (ms % 100) return;
+    DateTime t = toDateTime(utc0 + ms / 1000);
+    const bool fix = ms >= ttffMs();
+    char body[160];
+    auto dm = [](double v, int degw, char* o, size_t n) {
+      double a = fabs(v);
+      int d = (int)a;
+      snprintf(o, n, "%0*d%08.5f", degw, d, (a - d) * 60.0);
+    };
+    char la[20], lo[20];
+    dm(lat, 2, la, sizeof(la));
+    dm(lon, 3, lo, sizeof(lo));
+    snprintf(body, sizeof(body), "GNRMC,%02u%02u%02u.%02u,%c,%s,%c,%s,%c,0.0,0.0,%02u%02u%02u,,,A",
+             t.hour, t.minute, t.second, (ms % 1000) / 10, fix ? 'A' : 'V',
+             fix ? la : "", lat >= 0 ? 'N' : 'S', fix ? lo : "", lon >= 0 ? 'E' : 'W',
+             t.day, t.month, t.year % 100);
+    std::string s = nmeaLine(body);
+    out.insert(out.end(), s.begin(), s.end());
+  }
+};
+
+/* =========================================================
+   端末側の部品（Assist の Store / Clock）と、main.cpp のループと同じ順の呼出し
+   ========================================================= */
+// 内蔵フラッシュ：パスごとのバイト列
+struct Flash {
+  struct File {
+    std::vector<uint8_t>* data = nullptr;
+    size_t pos = 0;
+
+    explicit operator bool() const { return data != nullptr; }
+    size_t read(uint8_t* p, size_t n) {
+      if (!data || pos >= data->size()) return 0;
+      if (n > data->size() - pos) n = data->size() - pos;
+      memcpy(p, data->data() + pos, n);
+      pos += n;
+      return n;
+    }
+    size_t write(const uint8_t* p, size_t n) {
+      if (!data) return 0;
+      data->insert(data->end(), p, p + n);
+      return n;
+    }
+    void close() { data = nullptr; }
+  };
+
+  std::map<std::string, std::vector<uint8_t>> files;
+
+  File openCache(const char* path) {
+    auto it = files.find(path);
+    return it == files.end() ? File() : File{ &it->second, 0 };
+  }
+  File createCache(const char* path) {
+    std::vector<uint8_t>& v = files[path];
+    v.clear();
+    return File{ &v, 0 };
+  }
+  bool replaceCache(const char* tmp, const char* path) {
+    auto it = files.find(tmp);
+    if (it == files.end()) return false;
+    files[path] = std::move(it->second);
+    files.erase(tmp);
+    return true;
+  }
+};
+
+// 時計は受信機の電源投入からの時刻。RTC は本当の UTC を返す（無い場面では false）
+struct FakeClock {
+  const FakeReceiver& rx;
+  bool rtc;
+
+  uint32_t millis() const { return rx.ms; }
+  void delayMs(uint32_t) const {}   // 受信機モデルは取込みの速さを見ない
+  bool rtcGet(DateTime& t) const {
+    if (rtc) t = toDateTime(rx.utc0 + rx.ms / 1000);
+    return rtc;
+  }
+  void rtcSet(const DateTime&) const {}
+};
+
+static const char* kAidPath = "/aid.bin";
+static const char* kDbdPath = "/aid_dbd.bin";
+
+struct Result {
+  uint32_t ttffMs;
+  std::string what;
+  int dbdSaved;
+};
+
+static Result bootDevice(Flash& fl, FakeReceiver& rx, bool rtc) {
+  FakeClock clock{ rx, rtc };
+  Assist<FakeReceiver, Flash, FakeClock> aid(rx.proto, rx, fl, clock, kAidPath, kDbdPath);
+  aid.boot();
+
+  // ループ：UART を読む（NMEA → パーサ、吐き出し中の MGA-DBD → Assist）→ aidPoll。停車中のまま
+  Parser gps;
+  Result r{ 0, "", 0 };
+  for (uint32_t t = 0; t < 60000; t += 10) {
+    rx.tick10ms();
+    std::vector<uint8_t> in;
+    in.swap(rx.out);   // poll() の送信で受信機が返す分は次の周回で読む
+    aid.onRx(in.data(), in.size());
+    for (uint8_t c : in) gps.encode((char)c);
+
+    if (aid.poll(gps, true)) r.ttffMs = aid.ttff().ms();
+    if (aid.ttff().done() && !aid.capturing()) break;
+  }
+  r.what = aid.what();
+  r.dbdSaved = aid.dbdFrames();
+  return r;
+}
+
+/* =========================================================
+   台本
+   ========================================================= */
+struct Scene {
+  const char* name;
+  Proto  proto;
+  long   offS;        // 前回の電源断からの経過
+  double movedKm;     // 電源断の間に動いた距離（トレーラー等）
+  bool   rtc;
+  bool   corrupt;     // aid.bin を壊す
+  bool   wipe;        // 保存を消す（初回起動）
+  uint32_t expectMs;
+};
+
+int main(int argc, char** argv) {
+  verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+
+  const Scene scenes[] = {
+    { "first boot (no aid)",          PROTO_UBX,  0,         0,   true,  false, true,  COLD_MS },
+    { "reboot, RTC, 1h parked",       PROTO_UBX,  3600,      0,   true,  false, false, HOT_MS  },
+    { "reboot, no RTC",               PROTO_UBX,  600,       0,   false, false, false, POS_MS  },
+    { "reboot, 6h parked (old eph)",  PROTO_UBX,  6 * 3600,  0,   true,  false, false, WARM_MS },
+    { "corrupted aid.bin",            PROTO_UBX,  600,       0,   true,  true,  false, COLD_MS },
+    { "moved 300 km while off",       PROTO_UBX,  3600,      300, true,  false, false, COLD_MS },
+    { "PMTK first boot",              PROTO_PMTK, 0,         0,   true,  false, true,  COLD_MS },
+    { "PMTK reboot, RTC",             PROTO_PMTK, 1800,      0,   true,  false, false, WARM_MS },
+    { "PMTK reboot, no RTC",          PROTO_PMTK, 1800,      0,   false, false, false, COLD_MS },
+  };
+
+  Flash fl;
+  double lat = 35.369869, lon = 138.933655;
+  time_t utc = 1792300000;   // 2026-10
+  int fail = 0;
+
+  printf("%-30s %-5s %-14s %8s %8s  %s\n", "scene", "proto", "aid", "ttff", "expect", "");
+  for (const Scene& sc : scenes) {
+    if (sc.wipe) fl = Flash();
+    if (sc.corrupt && fl.files.count(kAidPath)) fl.files[kAidPath][9] ^= 0x40;
+    utc += sc.offS;
+    lat += sc.movedKm / 111.0;
+
+    FakeReceiver rx{ sc.proto, lat, lon, utc };
+    Result r = bootDevice(fl, rx, sc.rtc);
+    utc += 60;   // 走行・保存のぶん進める
+
+    const bool ok = r.ttffMs == sc.expectMs;
+    fail += !ok;
+    printf("%-30s %-5s %-14s %7.1fs %7.1fs  %s\n", sc.name, sc.proto == PROTO_UBX ? "UBX" : "PMTK",
+           r.what.c_str(), r.ttffMs / 1000.0, sc.expectMs / 1000.0, ok ? "ok" : "FAIL");
+    if (verbose)
+      printf("    receiver: pos=%d time=%d eph=%d rejected=%d, saved dbd frames=%d\n",
+             rx.posOk, rx.timeOk, rx.ephOk, rx.rejected, r.dbdSaved);
+  }
+  printf("%s\n", fail ? "FAILED" : "all scenes as expected");
+  return fail ? 1 : 0;
+}
@@ -0,0 +1,66 @@
+/* =========================================================
+   NMEA パーサ ホストベンチマーク
+   - 最小構成（RMCのみ）と フル構成（ファームと同じ GpsParser：RMC+GGA+GST）で 1文あたりのコストを比較
+   - ビルド: g++ -std=c++17 -O2 -Iinclude tools/nmea_bench.cpp -o nmea_bench
+   - 実行  : ./nmea_bench [文数]
+   ========================================================= */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "LapEngine.h"
+
+// チェックサム付きの1文を作る
+static std::string sentence(const char* body) {
+  uint8_t cs = 0;
+  for (const char* p = body; *p; ++p) cs ^= (uint8_t)*p;
+  char tail[8];
+  snprintf(tail, sizeof(tail), "*%02X\r\n", cs);
+  return std::string("$") + body + tail;
+}
+
+// 10Hz 受信機の典型的な1エポック（RMC/GGA/GSA/GSV/VTG/GST）を n 文ぶん並べる
+static std::string makeCapture(int n) {
+  const std::string epoch[] = {
+    sentence("GNRMC,012345.00,A,3522.19215,N,13856.01928,E,54.321,123.45,181026,,,A"),
+    sentence("GNGGA,012345.00,3522.19215,N,13856.01928,E,1,12,0.80,612.3,M,40.1,M,,"),
+    sentence("GNGSA,A,3,05,12,15,18,20,24,25,29,,,,,1.40,0.80,1.10"),
+    sentence("GPGSV,3,1,11,05,45,120,42,12,30,300,38,15,60,045,45,18,20,210,33"),
+    sentence("GNVTG,123.45,T,,M,54.321,N,100.602,K,A"),
+    sentence("GNGST,012345.00,0.85,1.20,0.90,45.0,0.95,1.05,2.10"),
+  };
+  const int k = sizeof(epoch) / sizeof(epoch[0]);
+  std::string out;
+  for (int i = 0; i < n; ++i) out += epoch[i % k];
+  return out;
+}
+
+// label が nullptr なら出さない（暖機用）
+template <class Parser>
+static void run(const char* label, const std::string& cap, int sentences) {
+  Parser p;
+  auto t0 = std::chrono::steady_clock::now();
+  for (char c : cap) p.encode(c);
+  auto t1 = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  if (!label) return;
+  printf("%-12s sizeof=%4zu  %8.1f ns/sentence  %6.2f ns/byte  (lat=%.6f)\n",
+         label, sizeof(Parser), ns / sentences, ns / cap.size(), p.location.lat());
+}
+
+int main(int argc, char** argv) {
+  int n = (argc > 1) ? atoi(argv[1]) : 1000000;
+  std::string cap = makeCapture(n);
+
+  using Minimal = TinyGPSPlusT<GpsData, nmea::RMC>;
+  using Full    = GpsParser;
+
+  // 1回目はキャッシュ暖機
+  run<Minimal>(nullptr, cap, n);
+  run<Minimal>("minimal", cap, n);
+  run<Full>("full", cap, n);
+  return 0;
+}
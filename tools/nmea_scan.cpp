@@ -0,0 +1,230 @@
+/* =========================================================
+   NMEA 一括スキャン（SIMD）の速度と一致の確認
+   - 取込み対象をメモリマップし、次の4通りで GB/s を比べる
+       encode     : TinyGPSPlusT::encode() に1文字ずつ（端末と同じ経路。解釈込み）
+       scalar     : 1文字ずつのスキャン（チェックサムまで）
+       simd       : SSE2/AVX2 のスキャン（チェックサムまで）
+       simd+parse : simd で受理した文だけ decodeBody() で解釈
+   - 一致の確認：壊した文（ビット反転・行中の CR/NUL・長すぎる行・'$' 抜け・小文字16進 等）を
+     混ぜたデータで、scalar と simd の受理した文の並びが完全に同じこと、
+     encode と simd+parse の解釈結果（位置・時刻・フィックス数…）が同じことを確かめる
+   - ビルド: g++ -std=c++17 -O2 -mavx2 -Iinclude tools/nmea_scan.cpp -o nmea_scan
+             （-mavx2 を外すと SSE2 版）
+   - 実行  : ./nmea_scan [取込みファイル] [-m 合成する MB]
+             ファイル省略時は nmea_scan.tmp に合成してから読む（終わったら消す）
+   ========================================================= */
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "NmeaScan.h"
+#include "TinyGPSPlus.h"
+
+using Parser = TinyGPSPlusT<GpsData, nmea::RMC, nmea::GGA, nmea::GST>;
+
+static std::string sentence(const std::string& body) {
+  uint8_t cs = 0;
+  for (char c : body) cs ^= (uint8_t)c;
+  char tail[8];
+  snprintf(tail, sizeof(tail), "*%02X\r\n", cs);
+  return "$" + body + tail;
+}
+
+// 10Hz 受信機の1エポック（RMC/GGA/GSA/GSV/VTG/GST）。時刻と位置を進めてチェックサムを散らす
+static std::string epoch(int k) {
+  char t[16], la[16], lo[16], b[160];
+  snprintf(t, sizeof(t), "%02d%02d%02d.%02d", k / 360000 % 24, k / 6000 % 60, k / 100 % 60, k % 100);
+  snprintf(la, sizeof(la), "%010.5f", 3522.19215 + (k % 1000) * 0.00011);
+  snprintf(lo, sizeof(lo), "%011.5f", 13856.01928 + (k % 777) * 0.00013);
+  std::string s;
+  snprintf(b, sizeof(b), "GNRMC,%s,A,%s,N,%s,E,54.321,123.45,181026,,,A", t, la, lo);
+  s += sentence(b);
+  snprintf(b, sizeof(b), "GNGGA,%s,%s,N,%s,E,1,12,0.80,612.3,M,40.1,M,,", t, la, lo);
+  s += sentence(b);
+  s += sentence("GNGSA,A,3,05,12,15,18,20,24,25,29,,,,,1.40,0.80,1.10");
+  s += sentence("GPGSV,3,1,11,05,45,120,42,12,30,300,38,15,60,045,45,18,20,210,33");
+  s += sentence("GNVTG,123.45,T,,M,54.321,N,100.602,K,A");
+  snprintf(b, sizeof(b), "GNGST,%s,0.9,1.2,0.8,45.0,0.%d,0.%d,1.5", t, 3 + k % 5, 4 + k % 3);
+  s += sentence(b);
+  return s;
+}
+
+// 壊し方いろいろ（どちらの経路でも同じに扱われるべきもの）
+static std::string corrupt(std::string s, std::mt19937& rng) {
+  auto pos = [&]() { return s.empty() ? 0 : (size_t)(rng() % s.size()); };
+  switch (rng() % 12) {
+    case 0: if (!s.empty()) s[pos()] ^= (char)(1 << (rng() % 8)); break;     // ビット反転
+    case 1: s.insert(pos(), 1, '\r'); break;                                   // 行中の CR
+    case 2: s.insert(pos(), 1, '\0'); break;                                   // NUL
+    case 3: s.insert(pos(), std::string(100 + rng() % 120, 'A')); break;       // 長すぎる行
+    case 4: if (s.size() > 1) s.erase(0, 1); break;                            // '$' 抜け
+    case 5: { size_t a = s.find('*'); if (a != std::string::npos) for (size_t i = a; i < s.size(); ++i) s[i] = (char)tolower(s[i]); } break;
+    case 6: { size_t a = s.find('*'); if (a != std::string::npos) s.erase(a, 1); } break;    // '*' 抜け
+    case 7: { size_t a = s.find('*'); if (a != std::string::npos) s.erase(a + 2); s += "\n"; } break;  // 16進1桁
+    case 8: s.insert(pos(), 1, '$'); break;                                    // 途中の '$'
+    case 9: { size_t a = s.find('\n'); if (a != std::string::npos) s.erase(a, 1); } break;   // 改行抜け
+    case 10: s.insert(pos(), 1, '*'); break;
+    default: { size_t a = s.find('\r'); if (a != std::string::npos) s.erase(a, 1); } break; // CR 無し
+  }
+  return s;
+}
+
+static std::string makeCapture(size_t bytes, double badRate, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::string out;
+  out.reserve(bytes + 1024);
+  for (int k = 0; out.size() < bytes; ++k) {
+    std::string e = epoch(k);
+    size_t p = 0;
+    while (p < e.size()) {   // 1文ずつ壊すかどうか決める
+      size_t q = e.find('\n', p) + 1;
+      std::string one = e.substr(p, q - p);
+      out += (badRate > 0 && (rng() % 1000) < badRate * 1000) ? corrupt(one, rng) : one;
+      p = q;
+    }
+  }
+  return out;
+}
+
+/* ---------- メモリマップ ---------- */
+struct Mapped {
+  const char* p = nullptr;
+  size_t n = 0;
+  int fd = -1;
+  bool open(const char* path) {
+    fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) return false;
+    n = (size_t)st.st_size;
+    void* m = mmap(nullptr, n, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED) return false;
+    madvise(m, n, MADV_SEQUENTIAL);
+    p = (const char*)m;
+    return true;
+  }
+  ~Mapped() {
+    if (p) munmap((void*)p, n);
+    if (fd >= 0) close(fd);
+  }
+};
+
+/* ---------- 一致の確認 ---------- */
+static bool sameFix(const GpsData& a, const GpsData& b) {
+  return a.fixCount() == b.fixCount() && a.location.lat() == b.location.lat() && a.location.lng() == b.location.lng()
+      && a.time.hour() == b.time.hour() && a.time.minute() == b.time.minute() && a.time.second() == b.time.second()
+      && a.time.centisecond() == b.time.centisecond() && a.date.day() == b.date.day()
+      && a.speed.kmph() == b.speed.kmph() && a.course.deg() == b.course.deg() && a.altitude.meters() == b.altitude.meters()
+      && a.satellites.value() == b.satellites.value() && a.hdop.hdop() == b.hdop.hdop()
+      && a.accuracy.meters() == b.accuracy.meters();
+}
+
+static bool differential(const char* label, const char* p, size_t n) {
+  std::vector<std::string> a, b;
+  nmeascan::scanScalar(p, n, [&](const char* s, size_t k) { a.emplace_back(s, k); });
+  nmeascan::scanSimd(p, n, [&](const char* s, size_t k) { b.emplace_back(s, k); });
+
+  bool ok = a == b;
+  if (!ok) {
+    size_t i = 0;
+    while (i < a.size() && i < b.size() && a[i] == b[i]) ++i;
+    printf("  %s: MISMATCH at sentence %zu (scalar %zu, simd %zu)\n", label, i, a.size(), b.size());
+    if (i < a.size()) printf("    scalar: %s\n", a[i].c_str());
+    if (i < b.size()) printf("    simd  : %s\n", b[i].c_str());
+  }
+
+  static Parser ref, fast;
+  ref = Parser();
+  fast = Parser();
+  for (size_t i = 0; i < n; ++i) ref.encode(p[i]);
+  nmeascan::scanSimd(p, n, [&](const char* s, size_t k) { fast.decodeBody(s, k); });
+  const bool same = sameFix(ref.sink(), fast.sink());
+  if (!same) printf("  %s: decoded state differs (fixes %u vs %u)\n", label, ref.fixCount(), fast.fixCount());
+
+  printf("  %-8s %9zu B  %7zu accepted  %s\n", label, n, a.size(), ok && same ? "identical" : "DIFFERENT");
+  return ok && same;
+}
+
+/* ---------- 速度 ---------- */
+template <class Fn>
+static void bench(const char* label, size_t n, Fn fn) {
+  double best = 1e30;
+  size_t got = 0;
+  for (int r = 0; r < 3; ++r) {
+    auto t0 = std::chrono::steady_clock::now();
+    got = fn();
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (s < best) best = s;
+  }
+  printf("  %-11s %7.2f GB/s  %8.1f ms  (%zu)\n", label, n / best / 1e9, best * 1e3, got);
+}
+
+int main(int argc, char** argv) {
+  const char* path = nullptr;
+  size_t mb = 64;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) mb = (size_t)atoi(argv[++i]);
+    else path = argv[i];
+  }
+
+  printf("simd: %s\n", nmeascan::simdName());
+
+  // 一致の確認（壊した文を 30% 混ぜる。種を変えて数回）
+  printf("differential:\n");
+  bool ok = true;
+  for (uint32_t seed = 1; seed <= 4; ++seed) {
+    std::string fuzz = makeCapture(2u << 20, 0.3, seed);
+    char label[16];
+    snprintf(label, sizeof(label), "fuzz#%u", seed);
+    ok &= differential(label, fuzz.data(), fuzz.size());
+  }
+
+  // 取込み対象（無ければ合成してファイル経由で）
+  const char* tmp = "nmea_scan.tmp";
+  if (!path) {
+    std::string cap = makeCapture(mb << 20, 0.001, 99);
+    FILE* f = fopen(tmp, "wb");
+    if (!f || fwrite(cap.data(), 1, cap.size(), f) != cap.size()) {
+      fprintf(stderr, "cannot write %s\n", tmp);
+      return 2;
+    }
+    fclose(f);
+  }
+  {
+    Mapped m;
+    if (!m.open(path ? path : tmp)) {
+      fprintf(stderr, "cannot map %s\n", path ? path : tmp);
+      return 2;
+    }
+    ok &= differential(path ? "file" : "capture", m.p, m.n);
+
+    printf("throughput (%zu MB, best of 3):\n", m.n >> 20);
+    bench("encode", m.n, [&]() {
+      static Parser g;
+      g = Parser();
+      for (size_t i = 0; i < m.n; ++i) g.encode(m.p[i]);
+      return (size_t)g.fixCount();
+    });
+    bench("scalar", m.n, [&]() { return nmeascan::scanScalar(m.p, m.n, [](const char*, size_t) {}); });
+    bench("simd", m.n, [&]() { return nmeascan::scanSimd(m.p, m.n, [](const char*, size_t) {}); });
+    bench("simd+parse", m.n, [&]() {
+      static Parser g;
+      g = Parser();
+      nmeascan::scanSimd(m.p, m.n, [&](const char* s, size_t k) { g.decodeBody(s, k); });
+      return (size_t)g.fixCount();
+    });
+  }
+  if (!path) remove(tmp);
+
+  printf("%s\n", ok ? "all identical" : "DIFFERENCES FOUND");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,342 @@
+/* =========================================================
+   複数台のレース再構成
+   - 各車の入力ジャーナル（/JRNLnnnn.bin）から GNSS 時刻つきのフィックス列を取り出し、
+     共通のコース中心線（track.bin）へ投影して「レース距離」にする
+       レース距離 = 周回数 × コース長 + コース上の距離
+   - 車ごとの取り出し・投影は並列、その後 GNSS 時刻で k-way マージ
+   - マージ中に 1 秒ごとの順位・トップ差・前車差と、周回ごとの順位（ラップチャート）を作る
+   - 差は「前の車が同じレース距離を通過した時刻」との差（計時ループと同じ考え方）
+   - ビルド: g++ -std=c++17 -O2 -pthread -Iinclude tools/race.cpp -o race
+   - 実行  : ./race [-t track.bin] [-o 出力接頭辞] 車1.bin 車2.bin ...
+             -t 省略時は1台目のジャーナルに入っている track.bin を全車で使う
+   - 出力  : <接頭辞>gaps.csv     t,car,pos,lap,race_m,gap_leader,gap_ahead（1秒ごと）
+             <接頭辞>lapchart.csv lap,P1,P2,...（その周回を終えた順）
+   ========================================================= */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CivilTime.h"
+#include "Journal.h"
+#include "TinyGPSPlus.h"
+#include "TrackModel.h"
+
+// 必要なのは時刻と位置だけ
+using FixParser = TinyGPSPlusT<GpsData, nmea::RMC>;
+
+constexpr float PASS_BIN_M = 5.0f;   // 通過時刻表の刻み（間は線形補間）
+
+struct Sample {
+  int64_t ms;       // UTC エポック ms
+  float   raceM;    // レース距離（スタートライン通過前は負）
+  int     lap;      // ライン通過回数（-1 = スタート前）
+};
+
+struct Car {
+  std::string         name;
+  std::string         path;
+  std::vector<Sample> s;
+  std::string         err;
+};
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& out) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return false;
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+static std::string baseName(const std::string& path) {
+  size_t a = path.find_last_of("/\\");
+  a = (a == std::string::npos) ? 0 : a + 1;
+  size_t b = path.find_last_of('.');
+  if (b == std::string::npos || b < a) b = path.size();
+  return path.substr(a, b - a);
+}
+
+// ジャーナル中の track.bin（FILE_TRACK）を取り出す
+static std::vector<uint8_t> journalTrack(const std::vector<uint8_t>& buf) {
+  std::vector<uint8_t> out;
+  journal::Reader rd(buf.data(), buf.size());
+  journal::Event e;
+  while (rd.next(e)) {
+    if (e.type == journal::FILE && e.arg == journal::FILE_TRACK) out.insert(out.end(), e.data, e.data + e.len);
+    if (e.type == journal::LOOP) break;   // 設定ファイルは最初の LOOP より前にしかない
+  }
+  return out;
+}
+
+static bool loadTrack(TrackModel& t, const std::vector<uint8_t>& file) {
+  if (file.size() < sizeof(TrackFileHeader)) return false;
+  TrackFileHeader h;
+  memcpy(&h, file.data(), sizeof(h));
+  if (!t.load(h) || file.size() < sizeof(h) + sizeof(TrackBin) * h.bins) return false;
+  memcpy(t.bin, file.data() + sizeof(h), sizeof(TrackBin) * h.bins);
+  size_t m = sizeof(h) + sizeof(TrackBin) * h.bins;
+  if (h.version >= 2 && file.size() >= m + sizeof(TrackFileMeta)) memcpy(&t.meta, file.data() + m, sizeof(TrackFileMeta));
+  t.validateMeta();
+  return true;
+}
+
+/* ---------- 1台ぶん：ジャーナル → レース距離の時系列 ---------- */
+static void processCar(Car& car, const std::vector<uint8_t>& trackFile) {
+  std::vector<uint8_t> buf;
+  if (!readFile(car.path, buf)) { car.err = "cannot open"; return; }
+
+  journal::Reader rd(buf.data(), buf.size());
+  if (!rd.ok()) { car.err = "not a journal"; return; }
+
+  static thread_local FixParser gps;
+  static thread_local TrackModel track;  // 車ごとに中心線を複製（投影の追従状態を持つため）
+  gps = FixParser();
+  if (!loadTrack(track, trackFile)) { car.err = "bad track"; return; }
+
+  const float L = track.lengthM();
+  uint32_t fixes = 0;
+  int lap = 0;
+  float prevD = -1.0f;
+  journal::Event e;
+
+  while (rd.next(e)) {
+    if (e.type != journal::UART) continue;
+    for (uint32_t i = 0; i < e.len; ++i) {
+      gps.encode((char)e.data[i]);
+      if (gps.fixCount() == fixes) continue;
+      fixes = gps.fixCount();
+      if (gps.date.year() == 0) continue;
+
+      track.onFix(track.frame.toXY(gps.location.lat(), gps.location.lng()));
+      if (!track.matched()) continue;
+
+      float d = track.distanceM();
+      if (prevD < 0.0f) {
+        lap = (d > L * 0.5f) ? -1 : 0;   // ライン手前（グリッド）から始まったらスタート前
+      } else if (d - prevD < -L * 0.5f) {
+        ++lap;                           // ラインを前向きに通過
+      } else if (d - prevD > L * 0.5f) {
+        --lap;                           // ライン上のふらつきで戻った
+      }
+      prevD = d;
+
+      civil::DateTime t;
+      t.year   = gps.date.year();
+      t.month  = gps.date.month();
+      t.day    = gps.date.day();
+      t.hour   = gps.time.hour();
+      t.minute = gps.time.minute();
+      t.second = gps.time.second();
+      int64_t ms = (int64_t)civil::toEpoch(t) * 1000 + gps.time.centisecond() * 10;
+      if (!car.s.empty() && ms <= car.s.back().ms) continue;   // 同一エポックの重複
+
+      car.s.push_back({ ms, lap * L + d, lap });
+    }
+  }
+  if (car.s.empty()) car.err = "no matched fixes";
+}
+
+/* ---------- 通過時刻表（レース距離 → 初めて到達した時刻） ---------- */
+struct PassTable {
+  std::vector<float> t;   // 各ビン境界の到達時刻（レース開始からの秒）
+  float maxM = 0.0f;
+  float lastT = 0.0f;
+  bool  started = false;
+
+  void add(float raceM, float sec) {
+    if (raceM < 0.0f) return;
+    if (!started) {
+      started = true;
+      maxM = raceM;
+      lastT = sec;
+      size_t b = (size_t)(raceM / PASS_BIN_M);
+      t.assign(b + 1, sec);
+      return;
+    }
+    if (raceM > maxM) {
+      // 前回の最大位置から今回までのビン境界を線形補間で埋める
+      size_t b1 = (size_t)(raceM / PASS_BIN_M);
+      for (size_t b = t.size(); b <= b1; ++b) {
+        float m = b * PASS_BIN_M;
+        t.push_back(lastT + (sec - lastT) * (m - maxM) / (raceM - maxM));
+      }
+      maxM = raceM;
+    }
+    lastT = sec;
+  }
+
+  // raceM に到達した時刻（未到達・記録前なら負）
+  float at(float raceM) const {
+    if (raceM < 0.0f || !started || raceM > maxM) return -1.0f;
+    size_t b = (size_t)(raceM / PASS_BIN_M);
+    if (b + 1 >= t.size()) return t.back();
+    float f = (raceM - b * PASS_BIN_M) / PASS_BIN_M;
+    return t[b] + (t[b + 1] - t[b]) * f;
+  }
+};
+
+int main(int argc, char** argv) {
+  std::string trackPath, prefix = "race_";
+  std::vector<Car> cars;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-t") && i + 1 < argc) trackPath = argv[++i];
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc) prefix = argv[++i];
+    else cars.push_back({ baseName(argv[i]), argv[i], {}, {} });
+  }
+  if (cars.empty()) {
+    fprintf(stderr, "usage: %s [-t track.bin] [-o prefix] car1.bin car2.bin ...\n", argv[0]);
+    return 2;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+
+  // 共通の中心線
+  std::vector<uint8_t> trackFile;
+  if (!trackPath.empty()) {
+    if (!readFile(trackPath, trackFile)) { fprintf(stderr, "cannot open %s\n", trackPath.c_str()); return 2; }
+  } else {
+    std::vector<uint8_t> buf;
+    if (readFile(cars[0].path, buf)) trackFile = journalTrack(buf);
+  }
+  static TrackModel probe;
+  if (!loadTrack(probe, trackFile)) {
+    fprintf(stderr, "no usable track (give -t track.bin)\n");
+    return 2;
+  }
+  const float L = probe.lengthM();
+
+  // 車ごとに並列処理（スレッド数はコア数まで）
+  std::atomic<size_t> nextCar{ 0 };
+  unsigned nThreads = std::max(1u, std::min<unsigned>(std::thread::hardware_concurrency(), (unsigned)cars.size()));
+  std::vector<std::thread> pool;
+  for (unsigned k = 0; k < nThreads; ++k) {
+    pool.emplace_back([&] {
+      for (size_t i; (i = nextCar.fetch_add(1)) < cars.size();) processCar(cars[i], trackFile);
+    });
+  }
+  for (auto& th : pool) th.join();
+
+  size_t total = 0;
+  int64_t startMs = INT64_MAX;
+  for (auto& c : cars) {
+    if (!c.err.empty()) fprintf(stderr, "%s: %s\n", c.name.c_str(), c.err.c_str());
+    if (c.s.empty()) continue;
+    total += c.s.size();
+    startMs = std::min(startMs, c.s.front().ms);
+  }
+  if (total == 0) return 1;
+
+  auto t1 = std::chrono::steady_clock::now();
+
+  /* ---------- GNSS 時刻で k-way マージ ---------- */
+  struct Head {
+    int64_t ms;
+    int     car;
+    size_t  idx;
+    bool operator>(const Head& o) const { return ms != o.ms ? ms > o.ms : car > o.car; }
+  };
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heap;
+  for (size_t c = 0; c < cars.size(); ++c) {
+    if (!cars[c].s.empty()) heap.push({ cars[c].s[0].ms, (int)c, 0 });
+  }
+
+  const size_t N = cars.size();
+  std::vector<PassTable> pass(N);
+  std::vector<float> raceM(N, 0.0f);
+  std::vector<int> lap(N, -1);
+  std::vector<bool> seen(N, false);
+  std::vector<std::vector<int>> chart;   // chart[lap-1] = その周回を終えた順の車
+
+  std::string gapsPath = prefix + "gaps.csv";
+  FILE* gaps = fopen(gapsPath.c_str(), "w");
+  if (!gaps) { fprintf(stderr, "cannot write %s\n", gapsPath.c_str()); return 1; }
+  fprintf(gaps, "t,car,pos,lap,race_m,gap_leader,gap_ahead\n");
+
+  std::vector<int> order;
+  auto rank = [&] {
+    order.clear();
+    for (size_t c = 0; c < N; ++c) if (seen[c]) order.push_back((int)c);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return raceM[a] > raceM[b]; });
+  };
+
+  // 1 秒ごとの順位と差
+  auto snapshot = [&](float sec) {
+    rank();
+    for (size_t p = 0; p < order.size(); ++p) {
+      int c = order[p];
+      float gl = 0.0f, ga = 0.0f;
+      if (p > 0) {
+        float tl = pass[order[0]].at(raceM[c]);
+        float ta = pass[order[p - 1]].at(raceM[c]);
+        gl = (tl >= 0.0f) ? sec - tl : -1.0f;
+        ga = (ta >= 0.0f) ? sec - ta : -1.0f;
+      }
+      fprintf(gaps, "%.0f,%s,%zu,%d,%.1f,%.2f,%.2f\n",
+              sec, cars[c].name.c_str(), p + 1, std::max(lap[c], 0), raceM[c], gl, ga);
+    }
+  };
+
+  float nextTick = 0.0f;
+  while (!heap.empty()) {
+    Head h = heap.top();
+    heap.pop();
+    const Sample& s = cars[h.car].s[h.idx];
+    float sec = (s.ms - startMs) / 1000.0f;
+
+    while (sec > nextTick) {
+      snapshot(nextTick);
+      nextTick += 1.0f;
+    }
+
+    int c = h.car;
+    if (seen[c] && s.lap > lap[c] && s.lap >= 1) {
+      if ((int)chart.size() < s.lap) chart.resize(s.lap);
+      chart[s.lap - 1].push_back(c);
+    }
+    seen[c] = true;
+    lap[c] = std::max(lap[c], s.lap);
+    raceM[c] = s.raceM;
+    pass[c].add(s.raceM, sec);
+
+    if (h.idx + 1 < cars[c].s.size()) heap.push({ cars[c].s[h.idx + 1].ms, c, h.idx + 1 });
+  }
+  snapshot(nextTick);
+  fclose(gaps);
+
+  // ラップチャート
+  std::string chartPath = prefix + "lapchart.csv";
+  FILE* lc = fopen(chartPath.c_str(), "w");
+  if (lc) {
+    fprintf(lc, "lap");
+    for (size_t p = 0; p < N; ++p) fprintf(lc, ",P%zu", p + 1);
+    fprintf(lc, "\n");
+    for (size_t l = 0; l < chart.size(); ++l) {
+      fprintf(lc, "%zu", l + 1);
+      for (int c : chart[l]) fprintf(lc, ",%s", cars[c].name.c_str());
+      fprintf(lc, "\n");
+    }
+    fclose(lc);
+  }
+
+  auto t2 = std::chrono::steady_clock::now();
+
+  // 最終順位
+  rank();
+  printf("track %.0f m, %zu cars, %zu fixes, %.0f s of racing\n", L, N, total, nextTick);
+  for (size_t p = 0; p < order.size(); ++p) {
+    int c = order[p];
+    printf("P%-3zu %-16s lap %3d  %9.1f m\n", p + 1, cars[c].name.c_str(), std::max(lap[c], 0), raceM[c]);
+  }
+  printf("wrote %s, %s\n", gapsPath.c_str(), chartPath.c_str());
+  printf("time: extract %.2f s (%u threads), merge %.2f s\n",
+         std::chrono::duration<double>(t1 - t0).count(), nThreads,
+         std::chrono::duration<double>(t2 - t1).count());
+  return 0;
+}
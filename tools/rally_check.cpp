@@ -0,0 +1,81 @@
+/* =========================================================
+   ラリー判定（Rally.h）の台本チェック
+   - 直線ルート（CP 3本, 100 m 間隔）を台本どおりに走らせ、通過・オドメータ・理想時刻を確かめる
+       逆向きにスタート線を越える → 通過にしない
+       停車中のふらつき          → オドメータに足さない
+       位置の飛び（MAX_STEP_M 以上） → オドメータに足さない
+       順向きに CP を越える      → 通過、オドメータは CP の距離に合わせる
+   - 場面ごとに期待と比べる（不一致で終了コード 1）
+   - ビルド: g++ -std=c++17 -O2 -Iinclude tools/rally_check.cpp -o rally_check
+   - 実行  : ./rally_check
+   ========================================================= */
+#include <cmath>
+#include <cstdio>
+
+#include "Rally.h"
+
+static int fail;
+
+static void expect(const char* name, bool ok) {
+  printf("%-44s %s\n", name, ok ? "ok" : "FAIL");
+  fail += !ok;
+}
+
+static void makeRoute(Rally& r) {
+  r = Rally();
+  for (int i = 0; i < 3; ++i) {
+    RallyCheckpoint c;
+    c.a = { i * 100.0f, -10.0f };
+    c.b = { i * 100.0f, 10.0f };
+    c.distM = i * 100.0f;
+    c.targetMs = i * 10000;
+    r.add(c);
+  }
+}
+
+int main() {
+  Rally r;
+  RallyCrossing ev;
+  uint32_t t = 0;
+
+  makeRoute(r);
+  r.onFix({ 5, 0 }, t += 100, 30.0f, ev);
+  expect("backwards over the start line is ignored", !r.onFix({ -5, 0 }, t += 100, 30.0f, ev) && !r.started());
+
+  const bool crossed = r.onFix({ 5, 0 }, t += 100, 30.0f, ev);
+  expect("forwards over the start line starts the clock", crossed && ev.index == 0 && r.started());
+  expect("odometer syncs to the start line", fabsf(r.odometerM() - 5.0f) < 0.01f);
+
+  for (int i = 0; i < 100; ++i) r.onFix({ 5.0f + (i % 2) * 0.8f, (i % 3) * 0.5f }, t += 100, 0.5f, ev);
+  expect("jitter while stopped adds no distance", fabsf(r.odometerM() - 5.0f) < 0.01f);
+
+  r.onFix({ 10, 0 }, t += 100, 30.0f, ev);
+  const float before = r.odometerM();
+  r.onFix({ 10, 250 }, t += 100, 30.0f, ev);
+  r.onFix({ 10, 0 }, t += 100, 30.0f, ev);
+  expect("a jump of MAX_STEP_M or more adds no distance", fabsf(r.odometerM() - before) < 0.01f);
+
+  int cps = 0;
+  bool synced = true;
+  for (float x = 20; x <= 210; x += 10) {
+    if (r.onFix({ x, 0 }, t += 100, 36.0f, ev)) {
+      ++cps;
+      synced = synced && fabsf(r.odometerM() - (r.cp[ev.index].distM + (x - ev.index * 100.0f))) < 0.01f;
+    }
+  }
+  expect("CP1 and CP2 are crossed forwards", cps == 2 && r.finished());
+  expect("odometer syncs to each CP", synced);
+
+  // 最後の CP は前の CP からの向きで判定：線の端を回り込んで逆から越えても通過にしない
+  makeRoute(r);
+  t = 0;
+  for (float x = -5; x <= 115; x += 10) r.onFix({ x, 0 }, t += 100, 36.0f, ev);
+  const geo::Vec2 around[] = { { 115, 50 }, { 215, 50 }, { 215, 0 } };
+  for (const geo::Vec2& p : around) r.onFix(p, t += 100, 36.0f, ev);
+  const bool back = r.onFix({ 195, 0 }, t += 100, 36.0f, ev);
+  expect("backwards over the last CP is ignored", !back && r.next() == 2);
+  expect("forwards over the last CP finishes", r.onFix({ 205, 0 }, t += 100, 36.0f, ev) && r.finished());
+
+  printf("%s\n", fail ? "FAILED" : "all scenes as expected");
+  return fail ? 1 : 0;
+}
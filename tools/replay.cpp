@@ -0,0 +1,582 @@
+/* =========================================================
+   入力ジャーナル ホスト再生
+   - 端末が書いた /JRNLnnnn.bin を LapEngine に同じ順・同じ時刻で流し直す
+   - 起動時の設定（FILE: track.bin / route.csv）を先に適用してから LOOP を再生
+   - STATE レコードごとに状態ハッシュを照合（一致しなければ再現失敗）
+   - -l で GNSS の遅延・間隔ゆらぎも出す（時刻はループ単位なので 確定/step の段は 0 付近。
+     UTC 起点の段は PPS が記録されている時だけ）
+   - -p で段ごとにスレッドを分けて流す（長いジャーナル用。出力は 1スレッド版と同一）
+       読込み → ジャーナル分解 → NMEA 解釈 → エンジン → 書出し
+       段の間はバッチを渡す SPSC キュー。段ごとの処理量・待ち時間とキューの混み具合を stderr へ
+       NMEA 段は自前のパーサで解釈し、文が確定していたループにだけ GpsData を添える
+       （エンジンは gps の GpsData しか読まないので、ループ時点の値を写せば同じ計算になる）
+   - ビルド: g++ -std=c++17 -O2 -pthread -ffp-contract=off -Iinclude tools/replay.cpp -o replay
+   - 実行  : ./replay JRNL0000.bin [-v] [-l] [-p]
+   ========================================================= */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GnssLatency.h"
+#include "Journal.h"
+#include "LapEngine.h"
+#include "SpscQueue.h"
+
+static bool readFile(const char* path, std::vector<uint8_t>& out) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+// 出力先：1スレッド版は stdout、パイプライン版は文字列に溜めて書出し段へ
+struct Stdout {
+  void printf(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+  }
+};
+
+struct StrOut {
+  std::string s;
+  void printf(const char* fmt, ...) {
+    char tmp[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if (n > 0) s.append(tmp, std::min((size_t)n, sizeof(tmp) - 1));
+  }
+};
+
+// 端末の loadTrack() / loadRoute() と同じ手順で初期状態を作る
+template <class Out>
+static void applyFiles(LapEngine& eng, const std::vector<uint8_t>& track, const std::string& route, Out& out) {
+  if (track.size() >= sizeof(TrackFileHeader)) {
+    TrackFileHeader h;
+    memcpy(&h, track.data(), sizeof(h));
+    size_t n = 0;
+    if (eng.applyTrackHeader(h)) n = sizeof(TrackBin) * eng.track.bins();
+    size_t m = (h.version >= 2) ? sizeof(TrackFileMeta) : 0;
+    if (n > 0 && track.size() >= sizeof(h) + n + m) {
+      memcpy(eng.track.bin, track.data() + sizeof(h), n);
+      if (m) memcpy(&eng.track.meta, track.data() + sizeof(h) + n, m);
+      if (!eng.track.validateMeta()) out.printf("track: bad sector table, sectors ignored\n");
+      out.printf("track: %d bins, %d laps, %d sectors\n", eng.track.bins(), eng.track.laps(), eng.track.meta.sectors);
+    } else {
+      eng.begin();
+      out.printf("track: invalid, ignored\n");
+    }
+  }
+
+  size_t p = 0;
+  while (p < route.size()) {
+    size_t e = route.find('\n', p);
+    if (e == std::string::npos) e = route.size();
+    eng.addRouteLine(route.substr(p, e - p).c_str());
+    p = e + 1;
+  }
+  if (!route.empty()) out.printf("route: %s\n", eng.finishRoute() ? "rally mode" : "invalid, ignored");
+}
+
+// ループ1回ぶんの出力
+template <class Out>
+static void printEvents(const LapEngine& eng, uint32_t ev, bool verbose, Out& out) {
+  if (ev & EV_LAP) {
+    out.printf("lap %3d  %8.3f s  +/-%.2f  top %5.1f km/h",
+               eng.lastLap.num, eng.lastLap.time, eng.lastLap.sigma, eng.lastLap.topSpeed);
+    for (int i = 0; i < eng.lastLap.sectors; ++i)
+      out.printf("%s%.3f(%.3f)", i ? " / " : "  S: ", eng.lastLap.sector[i], eng.lastLap.sectorSigma[i]);
+    out.printf("\n");
+  }
+  if ((ev & EV_RALLY) && verbose) {
+    out.printf("cp  %3d  %+8.2f s\n", eng.RallyLast.index, eng.RallyLast.diffMs() / 1000.0f);
+  }
+}
+
+struct Totals {
+  unsigned long loops = 0, bytes = 0, pps = 0, match = 0, mismatch = 0;
+  uint64_t lastUs = 0;
+  size_t   used = 0, size = 0;
+  bool     truncated = false;
+};
+
+static int finish(const Totals& t, const gnsslat::Meter* lat) {
+  printf("\n%lu loops, %lu UART bytes, %lu PPS, %.1f s\n", t.loops, t.bytes, t.pps, t.lastUs / 1e6);
+  printf("state check: %lu match, %lu mismatch\n", t.match, t.mismatch);
+  if (lat) {
+    Stdout out;
+    lat->report(out);
+  }
+  if (t.truncated && t.used < t.size) {
+    printf("journal truncated at byte %zu of %zu\n", t.used, t.size);
+  }
+  return t.mismatch ? 1 : 0;
+}
+
+/* =========================================================
+   1スレッド版
+   ========================================================= */
+static int replaySerial(const char* path, bool verbose, bool latency) {
+  std::vector<uint8_t> buf;
+  if (!readFile(path, buf)) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return 2;
+  }
+
+  journal::Reader rd(buf.data(), buf.size());
+  if (!rd.ok()) {
+    fprintf(stderr, "not a journal (or version mismatch)\n");
+    return 2;
+  }
+
+  static LapEngine eng;   // TrackModel を抱えるのでスタックに置かない
+  static gnsslat::Meter lat;
+  uint32_t latFixCount = 0;
+  std::vector<uint8_t> trackFile;
+  std::string routeFile;
+  bool started = false;
+  bool btn[3] = { false, false, false };
+  Stdout out;
+  Totals t;
+  journal::Event e{};
+
+  while (rd.next(e)) {
+    switch (e.type) {
+      case journal::FILE:
+        if (e.arg == journal::FILE_TRACK) trackFile.insert(trackFile.end(), e.data, e.data + e.len);
+        if (e.arg == journal::FILE_ROUTE) routeFile.append((const char*)e.data, e.len);
+        break;
+
+      case journal::UART:
+        lat.onBytes(e.us, e.data, e.len);
+        eng.feed(e.data, e.len);
+        if (eng.gps.fixCount() != latFixCount) {
+          latFixCount = eng.gps.fixCount();
+          lat.onCommit(e.us);
+        }
+        t.bytes += e.len;
+        break;
+
+      case journal::BUTTON:
+        if ((e.arg >> 1) < 3) btn[e.arg >> 1] = e.arg & 1;
+        break;
+
+      case journal::PPS:
+        lat.onPps(e.us);
+        ++t.pps;
+        break;
+
+      case journal::LOOP: {
+        if (!started) {
+          applyFiles(eng, trackFile, routeFile, out);
+          started = true;
+        }
+        LoopInput in;
+        in.nowMs = (uint32_t)(e.us / 1000);
+        in.btnA = btn[0];
+        in.btnB = btn[1];
+        in.btnC = btn[2];
+        lat.onConsume(e.us);
+        uint32_t ev = eng.step(in);
+        ++t.loops;
+        printEvents(eng, ev, verbose, out);
+        break;
+      }
+
+      case journal::STATE: {
+        uint32_t h = eng.stateHash();
+        if (h == e.hash) {
+          ++t.match;
+        } else {
+          ++t.mismatch;
+          out.printf("STATE mismatch at %.3f s: journal %08x, replay %08x\n", e.us / 1e6, e.hash, h);
+        }
+        break;
+      }
+    }
+  }
+
+  t.lastUs = e.us;
+  t.used = rd.offset(buf.data());
+  t.size = buf.size();
+  t.truncated = !rd.ok();
+  return finish(t, latency ? &lat : nullptr);
+}
+
+/* =========================================================
+   パイプライン版
+   ========================================================= */
+using Clock = std::chrono::steady_clock;
+
+static int64_t nsSince(Clock::time_point t0) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count();
+}
+
+// 段ごとの計測（その段のスレッドだけが書く）
+struct StageStat {
+  const char* name;
+  uint64_t items = 0;        // 処理した単位（バイト / レコード / ループ / 出力バイト）
+  const char* unit;
+  int64_t totalNs = 0, waitInNs = 0, waitOutNs = 0;
+};
+
+// 段の間：バッチのポインタを渡す。満杯・空は yield で待ち、待った時間と混み具合を数える
+template <class B>
+class Pipe {
+public:
+  static constexpr size_t DEPTH = 8;
+
+  void push(B* b, StageStat& st) {
+    const size_t occ = _q.size();
+    _occSum += occ;
+    _occMax = std::max(_occMax, occ);
+    ++_pushes;
+    if (_q.tryPush(b)) return;
+    ++_fullWaits;
+    auto t0 = Clock::now();
+    while (!_q.tryPush(b)) std::this_thread::yield();
+    st.waitOutNs += nsSince(t0);
+  }
+
+  // 閉じられて空なら nullptr
+  B* pop(StageStat& st) {
+    B* b;
+    if (_q.tryPop(b)) return b;
+    auto t0 = Clock::now();
+    for (;;) {
+      if (_q.tryPop(b)) break;
+      if (_closed.load(std::memory_order_acquire)) {
+        if (!_q.tryPop(b)) b = nullptr;
+        break;
+      }
+      std::this_thread::yield();
+    }
+    st.waitInNs += nsSince(t0);
+    return b;
+  }
+
+  void close() { _closed.store(true, std::memory_order_release); }
+
+  void report(const char* name) const {
+    fprintf(stderr, "  %-14s %8lu batches  occupancy mean %.2f max %zu / %zu  full %lu\n", name,
+            (unsigned long)_pushes, _pushes ? (double)_occSum / _pushes : 0.0, _occMax, DEPTH,
+            (unsigned long)_fullWaits);
+  }
+
+private:
+  SpscQueue<B*, DEPTH> _q;
+  std::atomic<bool> _closed{ false };
+  uint64_t _pushes = 0, _occSum = 0, _fullWaits = 0;
+  size_t   _occMax = 0;
+};
+
+struct Block {
+  std::vector<uint8_t> d;
+};
+
+// ジャーナルのレコード（本体はバッチの data に詰める）
+struct Rec {
+  journal::Type type;
+  uint8_t  arg;
+  uint32_t hash;
+  uint64_t us;
+  uint32_t off, len;
+};
+struct RecBatch {
+  std::vector<Rec> rec;
+  std::vector<uint8_t> data;
+};
+
+// エンジンへの入力：LOOP / STATE / FILE だけ（UART・PPS・BUTTON は NMEA 段で畳む）
+struct Item {
+  journal::Type type;
+  uint8_t  arg;
+  uint8_t  btn;              // LOOP：ボタン状態（bit0..2）
+  int32_t  fix;              // LOOP：このループまでに確定した GpsData（-1 = 前のまま）
+  uint32_t hash;
+  uint64_t us;
+  uint32_t off, len;         // FILE：本体
+};
+struct ItemBatch {
+  std::vector<Item> item;
+  std::vector<GpsData> fix;
+  std::vector<uint8_t> data;
+};
+
+struct OutBatch {
+  std::string s;
+};
+
+static constexpr size_t BLOCK_BYTES = 1 << 20;
+static constexpr size_t BATCH_RECS = 8192;
+
+static int replayPipelined(const char* path, bool verbose, bool latency) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return 2;
+  }
+  uint8_t head[journal::HEADER_LEN];
+  size_t hn = fread(head, 1, sizeof(head), f);
+  if (!journal::Reader(head, hn).ok()) {
+    fprintf(stderr, "not a journal (or version mismatch)\n");
+    fclose(f);
+    return 2;
+  }
+  rewind(f);
+
+  Pipe<Block> q1;
+  Pipe<RecBatch> q2;
+  Pipe<ItemBatch> q3;
+  Pipe<OutBatch> q4;
+  StageStat s1{ "read", 0, "B" }, s2{ "journal", 0, "rec" }, s3{ "nmea", 0, "B" }, s4{ "engine", 0, "loop" },
+            s5{ "write", 0, "B" };
+  Totals t;
+  static gnsslat::Meter lat;
+
+  // 1. 読込み：固定長ブロック
+  std::thread th1([&] {
+    auto t0 = Clock::now();
+    for (;;) {
+      Block* b = new Block;
+      b->d.resize(BLOCK_BYTES);
+      size_t n = fread(b->d.data(), 1, BLOCK_BYTES, f);
+      b->d.resize(n);
+      s1.items += n;
+      if (n == 0) {
+        delete b;
+        break;
+      }
+      q1.push(b, s1);
+    }
+    q1.close();
+    s1.totalNs = nsSince(t0);
+  });
+
+  // 2. ジャーナル分解：ブロックの継ぎ目をまたぐレコードは残りを先頭に寄せて読み直す
+  std::thread th2([&] {
+    auto t0 = Clock::now();
+    std::vector<uint8_t> buf;
+    size_t base = 0;              // buf[0] のファイル上の位置
+    bool eof = false, first = true;
+    journal::Reader rd(nullptr, 0);
+    journal::Event e{};
+    RecBatch* out = new RecBatch;
+
+    auto refill = [&]() {
+      Block* b = q1.pop(s2);
+      if (!b) {
+        eof = true;
+        return;
+      }
+      size_t keep = first ? 0 : rd.remaining();
+      base += buf.size() - keep;
+      buf.erase(buf.begin(), buf.end() - keep);
+      buf.insert(buf.end(), b->d.begin(), b->d.end());
+      delete b;
+      if (first) {
+        rd = journal::Reader(buf.data(), buf.size());
+        first = false;
+      } else {
+        rd.rebase(buf.data(), buf.size());
+      }
+    };
+
+    refill();
+    while (!first) {
+      while (!eof && rd.remaining() < journal::MAX_RECORD) refill();
+      if (!rd.next(e)) break;
+      Rec r{ e.type, e.arg, e.hash, e.us, (uint32_t)out->data.size(), e.len };
+      if (e.len) out->data.insert(out->data.end(), e.data, e.data + e.len);
+      out->rec.push_back(r);
+      ++s2.items;
+      if (out->rec.size() >= BATCH_RECS) {
+        q2.push(out, s2);
+        out = new RecBatch;
+      }
+    }
+    q2.push(out, s2);
+    q2.close();
+
+    t.lastUs = e.us;
+    t.used = base + (first ? 0 : rd.offset(buf.data()));
+    t.size = base + buf.size();
+    t.truncated = !rd.ok();
+    while (Block* b = q1.pop(s2)) {   // 壊れたレコードで止まった時：読込み段を止めないよう残りを捨てる
+      t.size += b->d.size();
+      delete b;
+    }
+    s2.totalNs = nsSince(t0);
+  });
+
+  // 3. NMEA 解釈：UART を自前のパーサへ。ループごとに確定した GpsData を添える
+  std::thread th3([&] {
+    auto t0 = Clock::now();
+    static GpsParser gps;
+    uint32_t latFixCount = 0;
+    bool changed = false;
+    uint8_t btn = 0;
+    while (RecBatch* in = q2.pop(s3)) {
+      ItemBatch* out = new ItemBatch;
+      out->item.reserve(in->rec.size());
+      for (const Rec& r : in->rec) {
+        const uint8_t* d = in->data.data() + r.off;
+        switch (r.type) {
+          case journal::UART:
+            if (latency) lat.onBytes(r.us, d, r.len);
+            for (uint32_t i = 0; i < r.len; ++i) changed |= gps.encode((char)d[i]);
+            if (latency && gps.fixCount() != latFixCount) {
+              latFixCount = gps.fixCount();
+              lat.onCommit(r.us);
+            }
+            s3.items += r.len;
+            t.bytes += r.len;
+            break;
+          case journal::BUTTON:
+            if ((r.arg >> 1) < 3) btn = (uint8_t)((btn & ~(1u << (r.arg >> 1))) | ((r.arg & 1u) << (r.arg >> 1)));
+            break;
+          case journal::PPS:
+            if (latency) lat.onPps(r.us);
+            ++t.pps;
+            break;
+          case journal::LOOP: {
+            if (latency) lat.onConsume(r.us);
+            int32_t fix = -1;
+            if (changed) {
+              fix = (int32_t)out->fix.size();
+              out->fix.push_back(gps.sink());
+              changed = false;
+            }
+            out->item.push_back({ r.type, r.arg, btn, fix, 0, r.us, 0, 0 });
+            break;
+          }
+          case journal::STATE:
+            out->item.push_back({ r.type, r.arg, 0, -1, r.hash, r.us, 0, 0 });
+            break;
+          case journal::FILE:
+            out->item.push_back({ r.type, r.arg, 0, -1, 0, r.us, (uint32_t)out->data.size(), r.len });
+            out->data.insert(out->data.end(), d, d + r.len);
+            break;
+        }
+      }
+      delete in;
+      q3.push(out, s3);
+    }
+    q3.close();
+    s3.totalNs = nsSince(t0);
+  });
+
+  // 4. エンジン
+  std::thread th4([&] {
+    auto t0 = Clock::now();
+    static LapEngine eng;
+    std::vector<uint8_t> trackFile;
+    std::string routeFile;
+    bool started = false;
+    while (ItemBatch* in = q3.pop(s4)) {
+      StrOut out;
+      for (const Item& it : in->item) {
+        switch (it.type) {
+          case journal::FILE: {
+            const uint8_t* d = in->data.data() + it.off;
+            if (it.arg == journal::FILE_TRACK) trackFile.insert(trackFile.end(), d, d + it.len);
+            if (it.arg == journal::FILE_ROUTE) routeFile.append((const char*)d, it.len);
+            break;
+          }
+          case journal::LOOP: {
+            if (!started) {
+              applyFiles(eng, trackFile, routeFile, out);
+              started = true;
+            }
+            if (it.fix >= 0) eng.gps.sink() = in->fix[it.fix];
+            LoopInput li;
+            li.nowMs = (uint32_t)(it.us / 1000);
+            li.btnA = it.btn & 1;
+            li.btnB = it.btn & 2;
+            li.btnC = it.btn & 4;
+            uint32_t ev = eng.step(li);
+            ++t.loops;
+            ++s4.items;
+            printEvents(eng, ev, verbose, out);
+            break;
+          }
+          case journal::STATE: {
+            uint32_t h = eng.stateHash();
+            if (h == it.hash) {
+              ++t.match;
+            } else {
+              ++t.mismatch;
+              out.printf("STATE mismatch at %.3f s: journal %08x, replay %08x\n", it.us / 1e6, it.hash, h);
+            }
+            break;
+          }
+          default:
+            break;
+        }
+      }
+      delete in;
+      if (!out.s.empty()) q4.push(new OutBatch{ std::move(out.s) }, s4);
+    }
+    q4.close();
+    s4.totalNs = nsSince(t0);
+  });
+
+  // 5. 書出し
+  std::thread th5([&] {
+    auto t0 = Clock::now();
+    while (OutBatch* in = q4.pop(s5)) {
+      fwrite(in->s.data(), 1, in->s.size(), stdout);
+      s5.items += in->s.size();
+      delete in;
+    }
+    s5.totalNs = nsSince(t0);
+  });
+
+  th1.join();
+  th2.join();
+  th3.join();
+  th4.join();
+  th5.join();
+  fclose(f);
+  fflush(stdout);
+
+  fprintf(stderr, "pipeline:\n");
+  for (const StageStat* s : { &s1, &s2, &s3, &s4, &s5 }) {
+    const int64_t busy = s->totalNs - s->waitInNs - s->waitOutNs;
+    fprintf(stderr, "  %-8s %12llu %-4s  busy %7.1f ms (%.1f M/s)  wait in %7.1f ms  out %7.1f ms\n",
+            s->name, (unsigned long long)s->items, s->unit, busy / 1e6,
+            busy > 0 ? s->items * 1e3 / busy : 0.0, s->waitInNs / 1e6, s->waitOutNs / 1e6);
+  }
+  q1.report("read>journal");
+  q2.report("journal>nmea");
+  q3.report("nmea>engine");
+  q4.report("engine>write");
+
+  return finish(t, latency ? &lat : nullptr);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s JRNLnnnn.bin [-v] [-l] [-p]\n", argv[0]);
+    return 2;
+  }
+  bool verbose = false, latency = false, pipelined = false;
+  for (int i = 2; i < argc; ++i) {
+    if (strcmp(argv[i], "-v") == 0) verbose = true;
+    if (strcmp(argv[i], "-l") == 0) latency = true;
+    if (strcmp(argv[i], "-p") == 0) pipelined = true;
+  }
+  return pipelined ? replayPipelined(argv[1], verbose, latency) : replaySerial(argv[1], verbose, latency);
+}
@@ -0,0 +1,379 @@
+/* =========================================================
+   再起動で分かれたセッションのつなぎ直し
+   - /LAP_log.csv は起動ごとに見出し行が入り、ラップ番号が 1 から振り直される。
+     見出し〜次の見出しを「断片」（1回の起動）として扱い、
+     GNSS 時刻が続いていてコースが同じ断片を1つのセッションにまとめる
+       続いている : 前の断片の最後のラップ終了 → 次の断片の最初のラップ開始 の空きが
+                    SESSION_IDLE_S + 前の断片の平均ラップ×2 以内
+                    （リセットで失うのは走行中の周と、再起動後に最初に線を越えるまでの周。
+                     それより長く止まっていたら端末でもセッションは終わっている）
+       コース     : 区間数が同じで、最初のラップが前の断片の平均の 1/2〜2 倍
+   - まとめたセッションでは時刻順に並べてラップを振り直し、空きは「無効ラップ」1行にする。
+     SD と内蔵フラッシュの両方に残った重複行（終了時刻が前の行以前）は捨てる
+   - ジャーナル（/JRNLnnnn.bin）も渡すと、最初と最後の GNSS 時刻からどのセッションの
+     ものかを出す（テレメトリが起動ごとのファイルに分かれていても集められる）
+   - 1パス目は断片ごとの要約（位置・件数・最初と最後の時刻）だけ、2パス目で行を流す。
+     メモリは断片・ファイルの数だけで、行数・ジャーナルの長さにはよらない
+   - ビルド: g++ -std=c++17 -O2 -Iinclude tools/stitch.cpp -o stitch
+   - 実行  : ./stitch [-o 出力接頭辞] [-g 秒] [-z 分] LAP_log.csv ... [JRNLnnnn.bin ...]
+             -g : 空きの上限の固定部（既定 SESSION_IDLE_S）
+             -z : ラップログの時刻の UTC オフセット（既定 TZ_OFFSET_MIN。夏時間は TZ_DST_RULE）
+   - 出力  : <接頭辞>laps.csv     Session,LAPCount,LapTime,TopSpeed,時刻,LapSigma,Sectors,Valid,Boot
+             <接頭辞>sessions.csv Session,Start,End,Laps,Boots,Gaps,Duplicates,Journals
+   ========================================================= */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "CivilTime.h"
+#include "Journal.h"
+#include "LapEngine.h"
+#include "SessionSummary.h"
+#include "TinyGPSPlus.h"
+
+using FixParser = TinyGPSPlusT<GpsData, nmea::RMC>;
+
+constexpr int64_t NO_TIME = INT64_MIN;
+
+// 1回の起動ぶんのラップ行
+struct Frag {
+  int     file = 0;
+  long    off = 0;          // 最初の行のファイル位置
+  int     rows = 0;
+  int     sectors = -1;     // 区間数（最初の行）
+  int64_t start = NO_TIME;  // 最初のラップの開始（現地時刻の通算秒）
+  int64_t end = NO_TIME;    // 最後のラップの終了
+  double  firstLap = 0, sumLap = 0;
+  int     timed = 0;        // 時刻のある行の数
+  int     session = -1;
+  int     boot = 0;         // 入力全体での通し番号
+
+  double meanLap() const { return timed ? sumLap / timed : 0; }
+};
+
+struct Journal {
+  std::string name;
+  int64_t     first = NO_TIME, last = NO_TIME;   // 現地時刻の通算秒
+};
+
+struct Session {
+  int64_t     start = NO_TIME, end = NO_TIME;
+  int         laps = 0, boots = 0, gaps = 0, dups = 0;
+  std::string journals;
+};
+
+/* ---------- ラップログの1行 ---------- */
+struct Row {
+  char*   f[6];   // LAPCount, LapTime, TopSpeed, 時刻, LapSigma, Sectors（行バッファを切ったもの）
+  int     nf = 0;
+  int64_t end = NO_TIME;
+  double  lap = 0;
+  int     sectors = 0;
+};
+
+static void chomp(char* s) {
+  size_t n = strlen(s);
+  while (n && (s[n - 1] == '\n' || s[n - 1] == '\r')) s[--n] = '\0';
+}
+
+// 空行は false。時刻が無い（YEAR=0）行は end = NO_TIME
+static bool parseRow(char* line, Row& r) {
+  chomp(line);
+  if (!*line) return false;
+  r.nf = 0;
+  char* p = line;
+  while (r.nf < 6) {
+    r.f[r.nf++] = p;
+    char* c = strchr(p, ',');
+    if (!c) break;
+    *c = '\0';
+    p = c + 1;
+  }
+  for (int i = r.nf; i < 6; ++i) r.f[i] = (char*)"";
+  r.lap = atof(r.f[1]);
+  r.sectors = *r.f[5] ? 1 : 0;
+  for (const char* q = r.f[5]; *q; ++q) r.sectors += *q == '/';
+
+  civil::DateTime t;
+  r.end = NO_TIME;
+  if (sscanf(r.f[3], "%d/%d/%d-%d:%d:%d", &t.year, &t.month, &t.day, &t.hour, &t.minute, &t.second) == 6 && t.year > 0)
+    r.end = civil::toEpoch(t);
+  return true;
+}
+
+static bool isHeader(const char* line) { return strncmp(line, "LAPCount", 8) == 0; }
+
+// 長すぎる行の残りを読み捨てる
+static bool readLine(FILE* f, char* buf, int n) {
+  if (!fgets(buf, n, f)) return false;
+  if (!strchr(buf, '\n')) {
+    int c;
+    while ((c = fgetc(f)) != EOF && c != '\n') {}
+  }
+  return true;
+}
+
+/* ---------- 1パス目：断片の要約 ---------- */
+static void scanLog(FILE* f, int file, std::vector<Frag>& frags) {
+  char line[512];
+  Frag cur;
+  bool open = false;
+  long off = ftell(f);
+  while (readLine(f, line, sizeof(line))) {
+    const long next = ftell(f);
+    if (isHeader(line) || !open) {
+      if (open && cur.rows) frags.push_back(cur);
+      cur = Frag();
+      cur.file = file;
+      cur.off = isHeader(line) ? next : off;
+      open = true;
+      if (isHeader(line)) {
+        off = next;
+        continue;
+      }
+    }
+    Row r;
+    if (parseRow(line, r)) {
+      if (cur.rows == 0) cur.sectors = r.sectors;
+      ++cur.rows;
+      if (r.end != NO_TIME) {
+        if (cur.timed == 0) {
+          cur.start = r.end - (int64_t)(r.lap + 0.5);
+          cur.firstLap = r.lap;
+        }
+        cur.end = r.end;
+        cur.sumLap += r.lap;
+        ++cur.timed;
+      }
+    }
+    off = next;
+  }
+  if (open && cur.rows) frags.push_back(cur);
+}
+
+/* ---------- ジャーナルの最初と最後の GNSS 時刻（分割読み） ---------- */
+static bool scanJournal(const char* path, Journal& j, const civil::Zone& zone) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  static FixParser gps;
+  gps = FixParser();
+  uint32_t fixes = 0;
+
+  std::vector<uint8_t> buf;
+  buf.reserve(65536 + journal::MAX_RECORD);
+  uint8_t blk[65536];
+  bool eof = false, first = true;
+  journal::Reader rd(nullptr, 0);
+
+  auto refill = [&]() {
+    const size_t n = fread(blk, 1, sizeof(blk), f);
+    if (n == 0) {
+      eof = true;
+      return;
+    }
+    const size_t keep = first ? buf.size() : rd.remaining();
+    buf.erase(buf.begin(), buf.end() - keep);
+    buf.insert(buf.end(), blk, blk + n);
+    if (first) {
+      if (buf.size() < journal::HEADER_LEN) return;   // 見出しがそろうまで読む
+      rd = journal::Reader(buf.data(), buf.size());
+      first = false;
+    } else {
+      rd.rebase(buf.data(), buf.size());
+    }
+  };
+
+  while (first && !eof) refill();
+  journal::Event e;
+  while (!first && rd.ok()) {
+    while (!eof && rd.remaining() < journal::MAX_RECORD) refill();
+    if (!rd.next(e)) break;
+    if (e.type != journal::UART) continue;
+    for (uint32_t i = 0; i < e.len; ++i) {
+      gps.encode((char)e.data[i]);
+      if (gps.fixCount() == fixes) continue;
+      fixes = gps.fixCount();
+      if (gps.date.year() == 0) continue;
+      civil::DateTime t;
+      t.year   = gps.date.year();
+      t.month  = gps.date.month();
+      t.day    = gps.date.day();
+      t.hour   = gps.time.hour();
+      t.minute = gps.time.minute();
+      t.second = gps.time.second();
+      const int64_t s = civil::toEpoch(zone.toLocal(civil::toEpoch(t)));
+      if (j.first == NO_TIME) j.first = s;
+      j.last = s;
+    }
+  }
+  fclose(f);
+  return !first;
+}
+
+static bool isJournal(const char* path) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  char m[4] = {};
+  const bool ok = fread(m, 1, 4, f) == 4 && memcmp(m, "JRNL", 4) == 0;
+  fclose(f);
+  return ok;
+}
+
+static std::string stamp(int64_t s) {
+  if (s == NO_TIME) return "";
+  const civil::DateTime t = civil::fromEpoch(s);
+  char b[48];
+  snprintf(b, sizeof(b), "%d/%d/%d-%d:%d:%d", t.year, t.month, t.day, t.hour, t.minute, t.second);   // 端末と同じ（0 埋めなし）
+  return b;
+}
+
+static std::string baseName(const std::string& path) {
+  size_t a = path.find_last_of("/\\");
+  return a == std::string::npos ? path : path.substr(a + 1);
+}
+
+int main(int argc, char** argv) {
+  std::string prefix = "stitched_";
+  double gapS = SESSION_IDLE_S;
+  int tzMin = TZ_OFFSET_MIN;
+  std::vector<std::string> logs, jrnls;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) prefix = argv[++i];
+    else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) gapS = atof(argv[++i]);
+    else if (strcmp(argv[i], "-z") == 0 && i + 1 < argc) tzMin = atoi(argv[++i]);
+    else if (isJournal(argv[i])) jrnls.push_back(argv[i]);
+    else logs.push_back(argv[i]);
+  }
+  if (logs.empty()) {
+    fprintf(stderr, "usage: stitch [-o prefix] [-g sec] [-z min] LAP_log.csv ... [JRNLnnnn.bin ...]\n");
+    return 2;
+  }
+  const civil::Zone zone{ (int16_t)tzMin, TZ_DST_RULE };
+
+  // 1パス目
+  std::vector<FILE*> files;
+  std::vector<Frag> frags;
+  for (size_t i = 0; i < logs.size(); ++i) {
+    FILE* f = fopen(logs[i].c_str(), "rb");
+    if (!f) {
+      fprintf(stderr, "cannot open %s\n", logs[i].c_str());
+      return 2;
+    }
+    files.push_back(f);
+    scanLog(f, (int)i, frags);
+  }
+  for (size_t i = 0; i < frags.size(); ++i) frags[i].boot = (int)i + 1;
+
+  std::vector<Journal> js;
+  for (const std::string& p : jrnls) {
+    Journal j;
+    j.name = baseName(p);
+    if (!scanJournal(p.c_str(), j, zone)) fprintf(stderr, "%s: not a readable journal\n", p.c_str());
+    else if (j.first == NO_TIME) fprintf(stderr, "%s: no GNSS time\n", p.c_str());
+    else js.push_back(j);
+  }
+
+  // 時刻順に並べてセッションに分ける（時刻の無い断片は単独で最後に）
+  std::vector<int> order(frags.size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = (int)i;
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    const Frag &x = frags[a], &y = frags[b];
+    if ((x.start == NO_TIME) != (y.start == NO_TIME)) return y.start == NO_TIME;
+    return x.start < y.start;
+  });
+
+  std::vector<Session> sessions;
+  const Frag* prev = nullptr;
+  for (int k : order) {
+    Frag& f = frags[k];
+    bool cont = false;
+    if (prev && prev->end != NO_TIME && f.start != NO_TIME && f.sectors == prev->sectors) {
+      const double mean = prev->meanLap();
+      const double gap = (double)(f.start - sessions.back().end);
+      cont = gap <= gapS + 2 * mean && (mean <= 0 || (f.firstLap >= mean * 0.5 && f.firstLap <= mean * 2.0));
+    }
+    if (!cont) sessions.push_back(Session());
+    Session& s = sessions.back();
+    f.session = (int)sessions.size();
+    ++s.boots;
+    if (f.start != NO_TIME && s.start == NO_TIME) s.start = f.start;
+    if (f.end != NO_TIME && (s.end == NO_TIME || f.end > s.end)) s.end = f.end;
+    prev = &f;
+  }
+
+  // 2パス目：行を流す
+  const std::string lapsPath = prefix + "laps.csv", sessPath = prefix + "sessions.csv";
+  FILE* out = fopen(lapsPath.c_str(), "w");
+  if (!out) {
+    fprintf(stderr, "cannot write %s\n", lapsPath.c_str());
+    return 2;
+  }
+  fprintf(out, "Session,LAPCount,LapTime,TopSpeed,YYYY/MM/DD/Hour:Minute:Second,LapSigma,Sectors,Valid,Boot\n");
+
+  int curSession = -1, lapNum = 0;
+  int64_t lastEnd = NO_TIME;
+  char line[512];
+  for (int k : order) {
+    const Frag& f = frags[k];
+    Session& s = sessions[f.session - 1];
+    if (f.session != curSession) {
+      curSession = f.session;
+      lapNum = 0;
+      lastEnd = NO_TIME;
+    }
+
+    // 前の断片との空き（リセットで取りこぼした周）は無効ラップ1行
+    if (lastEnd != NO_TIME && f.start != NO_TIME && f.start > lastEnd) {
+      fprintf(out, "%d,%d,%.2f,,%s,,,0,\n", f.session, ++lapNum, (double)(f.start - lastEnd), stamp(f.start).c_str());
+      ++s.gaps;
+    }
+
+    FILE* in = files[f.file];
+    fseek(in, f.off, SEEK_SET);
+    for (int n = 0; n < f.rows && readLine(in, line, sizeof(line));) {
+      if (isHeader(line)) break;
+      Row r;
+      if (!parseRow(line, r)) continue;
+      ++n;
+      if (r.end != NO_TIME && lastEnd != NO_TIME && r.end <= lastEnd) {
+        ++s.dups;
+        continue;
+      }
+      fprintf(out, "%d,%d,%s,%s,%s,%s,%s,1,%d\n", f.session, ++lapNum, r.f[1], r.f[2], r.f[3], r.f[4], r.f[5], f.boot);
+      ++s.laps;
+      if (r.end != NO_TIME) lastEnd = r.end;
+    }
+  }
+  fclose(out);
+  for (FILE* f : files) fclose(f);
+
+  // ジャーナルは時刻の重なるセッションへ
+  for (const Journal& j : js) {
+    for (Session& s : sessions) {
+      if (s.start == NO_TIME || j.last < s.start || j.first > s.end) continue;
+      if (!s.journals.empty()) s.journals += ' ';
+      s.journals += j.name;
+    }
+  }
+
+  FILE* so = fopen(sessPath.c_str(), "w");
+  if (!so) {
+    fprintf(stderr, "cannot write %s\n", sessPath.c_str());
+    return 2;
+  }
+  fprintf(so, "Session,Start,End,Laps,Boots,Gaps,Duplicates,Journals\n");
+  printf("%zu boots -> %zu sessions\n", frags.size(), sessions.size());
+  for (size_t i = 0; i < sessions.size(); ++i) {
+    const Session& s = sessions[i];
+    fprintf(so, "%zu,%s,%s,%d,%d,%d,%d,%s\n", i + 1, stamp(s.start).c_str(), stamp(s.end).c_str(), s.laps, s.boots,
+            s.gaps, s.dups, s.journals.c_str());
+    printf("  #%zu %s .. %s  %d laps, %d boots, %d gap, %d dup%s%s\n", i + 1, stamp(s.start).c_str(),
+           stamp(s.end).c_str(), s.laps, s.boots, s.gaps, s.dups, s.journals.empty() ? "" : "  ", s.journals.c_str());
+  }
+  fclose(so);
+  printf("wrote %s, %s\n", lapsPath.c_str(), sessPath.c_str());
+  return 0;
+}
@@ -0,0 +1,463 @@
+/* =========================================================
+   track.bin ビルダー（ホスト）
+   - 走行ログ（入力ジャーナル /JRNLnnnn.bin か NMEA テキスト）を逐次デコード
+   - スタート/フィニッシュ線を決めて周回に分け、きれいな1周を選ぶ
+       線の位置: -s 指定 > ジャーナル内の端末原点 > 最高速地点
+       きれいな周: フィックス欠けが無く、走行距離が中央値に最も近い周
+   - その周を距離で等間隔に取り直して平滑化 → 中心線ビン
+   - 曲率の極値で区間分け（コーナー＝極大、区間境界＝ストレートの極小）
+   - ログの全周（走行中のフィックス）を中心線に当て、ビンごとの横ずれ分散を埋める
+       → 走行ライン幅（TrackModel::widthM）。区間ごとの要約を表示、-w でビンごとに CSV
+   - 端末と同じ track.bin（version 2：区間・外接矩形つき）を書く
+   - ビルド: g++ -std=c++17 -O2 -Iinclude tools/trackbuild.cpp -o trackbuild
+   - 実行  : ./trackbuild [-s lat,lon] [-n 区間数] [-b ビン幅m] [-o track.bin] [-w width.csv] ログ
+   ========================================================= */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "CivilTime.h"
+#include "Geo.h"
+#include "Journal.h"
+#include "TinyGPSPlus.h"
+#include "TrackModel.h"
+
+using FixParser = TinyGPSPlusT<GpsData, nmea::RMC>;
+
+constexpr float LINE_HALF_M = 25.0f;   // スタート線の半幅
+constexpr float MOVING_KMH  = 20.0f;   // これ未満はピット・停車とみなす
+constexpr float CORNER_R    = 200.0f;  // これより小さい半径をコーナーとみなす
+
+struct Fix {
+  double lat, lon;
+  double t;          // UTC 秒（小数つき）
+  float  kmh;
+  geo::Vec2 p;       // ローカル座標
+};
+
+/* ---------- 逐次デコード ---------- */
+struct Decoder {
+  FixParser gps;
+  uint32_t fixes = 0;
+  std::vector<Fix> out;
+
+  void feed(const uint8_t* d, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      gps.encode((char)d[i]);
+      if (gps.fixCount() == fixes) continue;
+      fixes = gps.fixCount();
+      if (gps.date.year() == 0) continue;
+
+      civil::DateTime t;
+      t.year   = gps.date.year();
+      t.month  = gps.date.month();
+      t.day    = gps.date.day();
+      t.hour   = gps.time.hour();
+      t.minute = gps.time.minute();
+      t.second = gps.time.second();
+      double sec = (double)civil::toEpoch(t) + gps.time.centisecond() / 100.0;
+      if (!out.empty() && sec <= out.back().t) continue;
+      out.push_back({ gps.location.lat(), gps.location.lng(), sec, (float)gps.speed.kmph(), {} });
+    }
+  }
+};
+
+// ジャーナルは固定長バッファで分割読み、それ以外は NMEA テキストとして流す
+static bool decode(const char* path, Decoder& dec, bool& hasOrigin, double& lat0, double& lon0) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+
+  static uint8_t buf[1 << 16];
+  size_t n = fread(buf, 1, sizeof(buf), f);
+  hasOrigin = false;
+
+  if (n >= journal::HEADER_LEN && memcmp(buf, "JRNL", 4) == 0) {
+    journal::Reader rd(buf, n);
+    if (!rd.ok()) { fclose(f); return false; }
+    bool eof = n < sizeof(buf);
+    std::vector<uint8_t> trackHead;
+    journal::Event e;
+
+    for (;;) {
+      if (!eof && rd.remaining() < journal::MAX_RECORD) {
+        size_t keep = rd.remaining();
+        memmove(buf, buf + (n - keep), keep);
+        n = keep + fread(buf + keep, 1, sizeof(buf) - keep, f);
+        eof = n < sizeof(buf);
+        rd.rebase(buf, n);
+      }
+      if (!rd.next(e)) break;
+      if (e.type == journal::UART) dec.feed(e.data, e.len);
+      if (e.type == journal::FILE && e.arg == journal::FILE_TRACK && trackHead.size() < sizeof(TrackFileHeader)) {
+        trackHead.insert(trackHead.end(), e.data, e.data + e.len);
+      }
+    }
+    if (trackHead.size() >= sizeof(TrackFileHeader)) {
+      TrackFileHeader h;
+      memcpy(&h, trackHead.data(), sizeof(h));
+      if (memcmp(h.magic, "TRK1", 4) == 0) {
+        hasOrigin = true;
+        lat0 = h.lat0;
+        lon0 = h.lon0;
+      }
+    }
+  } else {
+    do dec.feed(buf, n);
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0);
+  }
+  fclose(f);
+  return true;
+}
+
+/* ---------- 周回分け ---------- */
+struct Crossing {
+  size_t i;        // fix[i]→fix[i+1] の間
+  float  u;        // その区間内の位置
+  double t;
+};
+
+struct Lap {
+  size_t from, to;   // crossing の番号
+  double time;
+  float  lengthM;
+  double maxGap;
+};
+
+// 折れ線を距離で等間隔に取り直す（1周がちょうど閉じるビン幅 bm を返す）
+static bool resample(const std::vector<geo::Vec2>& path, float binM,
+                     std::vector<geo::Vec2>& c, float& len, float& bm) {
+  std::vector<float> acc(path.size(), 0.0f);
+  for (size_t i = 1; i < path.size(); ++i) acc[i] = acc[i - 1] + geo::length(path[i] - path[i - 1]);
+  len = acc.back();
+
+  int bins = (int)lroundf(len / binM);
+  if (bins < 20 || bins > TrackModel::MAX_BINS) return false;
+  bm = len / bins;
+
+  c.resize(bins);
+  for (int j = 0, i = 0; j < bins; ++j) {
+    float s = j * bm;
+    while (i + 2 < (int)acc.size() && acc[i + 1] < s) ++i;
+    float seg = acc[i + 1] - acc[i];
+    float u = seg > 0.0f ? (s - acc[i]) / seg : 0.0f;
+    c[j] = path[i] + (path[i + 1] - path[i]) * u;
+  }
+  return true;
+}
+
+// ±2 ビンの周回移動平均を2回
+static void smooth(std::vector<geo::Vec2>& c) {
+  const int bins = (int)c.size();
+  for (int pass = 0; pass < 2; ++pass) {
+    std::vector<geo::Vec2> s(bins);
+    for (int j = 0; j < bins; ++j) {
+      geo::Vec2 sum;
+      for (int k = -2; k <= 2; ++k) sum = sum + c[(j + k + bins) % bins];
+      s[j] = sum * 0.2f;
+    }
+    c.swap(s);
+  }
+}
+
+static float wrapPi(float a) {
+  while (a > (float)M_PI) a -= 2.0f * (float)M_PI;
+  while (a < -(float)M_PI) a += 2.0f * (float)M_PI;
+  return a;
+}
+
+int main(int argc, char** argv) {
+  const char* inPath = nullptr;
+  const char* outPath = "track.bin";
+  const char* widthPath = nullptr;
+  bool userStart = false;
+  double sLat = 0, sLon = 0;
+  int nSectors = 3;
+  float binM = TRACK_BIN_M;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      userStart = sscanf(argv[++i], "%lf,%lf", &sLat, &sLon) == 2;
+    } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      nSectors = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      binM = (float)atof(argv[++i]);
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      outPath = argv[++i];
+    } else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+      widthPath = argv[++i];
+    } else {
+      inPath = argv[i];
+    }
+  }
+  if (!inPath || nSectors < 1 || nSectors > TRACK_MAX_SECTORS || binM <= 0.0f) {
+    fprintf(stderr, "usage: %s [-s lat,lon] [-n sectors(1-%d)] [-b binM] [-o track.bin] [-w width.csv] log\n",
+            argv[0], TRACK_MAX_SECTORS);
+    return 2;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+
+  static Decoder dec;
+  bool devOrigin;
+  double dLat, dLon;
+  if (!decode(inPath, dec, devOrigin, dLat, dLon)) {
+    fprintf(stderr, "cannot read %s\n", inPath);
+    return 2;
+  }
+  std::vector<Fix>& fx = dec.out;
+  if (fx.size() < 100) {
+    fprintf(stderr, "too few fixes (%zu)\n", fx.size());
+    return 1;
+  }
+
+  auto t1 = std::chrono::steady_clock::now();
+
+  // スタート/フィニッシュ点
+  const char* how = "-s";
+  if (!userStart && devOrigin) {
+    sLat = dLat; sLon = dLon; how = "device origin";
+  } else if (!userStart) {
+    // 最高速地点（5フィックス平均）：たいていメインストレート
+    size_t best = 2;
+    float bestV = -1.0f;
+    for (size_t i = 2; i + 2 < fx.size(); ++i) {
+      float v = 0.0f;
+      for (size_t k = i - 2; k <= i + 2; ++k) v += fx[k].kmh;
+      if (v > bestV) { bestV = v; best = i; }
+    }
+    sLat = fx[best].lat; sLon = fx[best].lon; how = "top speed";
+  }
+
+  geo::LocalFrame frame;
+  frame.setOrigin(sLat, sLon);
+  for (auto& f : fx) f.p = frame.toXY(f.lat, f.lon);
+
+  // 線の向き：原点に一番近い走行中フィックスの進行方向に直交
+  size_t near = SIZE_MAX;
+  float nearD = 0.0f;
+  for (size_t i = 1; i + 1 < fx.size(); ++i) {
+    if (fx[i].kmh < MOVING_KMH) continue;
+    float d = geo::length(fx[i].p);
+    if (near == SIZE_MAX || d < nearD) { near = i; nearD = d; }
+  }
+  if (near == SIZE_MAX || nearD > LINE_HALF_M) {
+    fprintf(stderr, "start point is not on the driven line (nearest %.0f m)\n", nearD);
+    return 1;
+  }
+  geo::Vec2 dir = fx[near + 1].p - fx[near - 1].p;
+  dir = dir * (1.0f / geo::length(dir));
+  geo::Vec2 nrm = { -dir.y, dir.x };
+  geo::Vec2 A = nrm * LINE_HALF_M, B = nrm * -LINE_HALF_M;
+
+  // 線の通過（進行方向が同じ向きのものだけ）
+  std::vector<Crossing> cr;
+  for (size_t i = 0; i + 1 < fx.size(); ++i) {
+    float u;
+    if (fx[i].kmh < MOVING_KMH) continue;
+    if (!geo::segmentCross(fx[i].p, fx[i + 1].p, A, B, u)) continue;
+    if (geo::dot(fx[i + 1].p - fx[i].p, dir) <= 0.0f) continue;
+    cr.push_back({ i, u, fx[i].t + (fx[i + 1].t - fx[i].t) * u });
+  }
+  if (cr.size() < 2) {
+    fprintf(stderr, "no complete lap found (%zu line crossings)\n", cr.size());
+    return 1;
+  }
+
+  // 周回ごとの時間・距離・最大欠け
+  std::vector<Lap> laps;
+  std::vector<double> dts;
+  for (size_t i = 1; i < fx.size(); ++i) dts.push_back(fx[i].t - fx[i - 1].t);
+  std::nth_element(dts.begin(), dts.begin() + dts.size() / 2, dts.end());
+  const double medDt = dts[dts.size() / 2];
+
+  for (size_t k = 0; k + 1 < cr.size(); ++k) {
+    Lap l = { k, k + 1, cr[k + 1].t - cr[k].t, 0.0f, 0.0 };
+    for (size_t i = cr[k].i; i <= cr[k + 1].i; ++i) {
+      l.lengthM += geo::length(fx[i + 1].p - fx[i].p);
+      l.maxGap = std::max(l.maxGap, fx[i + 1].t - fx[i].t);
+    }
+    laps.push_back(l);
+  }
+
+  std::vector<float> lens;
+  for (auto& l : laps) lens.push_back(l.lengthM);
+  std::nth_element(lens.begin(), lens.begin() + lens.size() / 2, lens.end());
+  const float medLen = lens[lens.size() / 2];
+
+  int pick = -1;
+  for (size_t k = 0; k < laps.size(); ++k) {
+    const Lap& l = laps[k];
+    bool clean = l.maxGap <= std::max(3.0 * medDt, 0.3) && fabsf(l.lengthM - medLen) < medLen * 0.05f;
+    printf("lap %2zu  %8.3f s  %7.1f m  gap %.2f s%s\n", k + 1, l.time, l.lengthM, l.maxGap, clean ? "" : "  (rejected)");
+    if (!clean) continue;
+    if (pick < 0 || fabsf(l.lengthM - medLen) < fabsf(laps[pick].lengthM - medLen)) pick = (int)k;
+  }
+  if (pick < 0) {
+    fprintf(stderr, "no clean lap\n");
+    return 1;
+  }
+
+  // 選んだ周の軌跡（線の通過点で閉じる）
+  const Lap& L = laps[pick];
+  std::vector<geo::Vec2> path;
+  {
+    const Crossing& a = cr[L.from];
+    const Crossing& b = cr[L.to];
+    path.push_back(fx[a.i].p + (fx[a.i + 1].p - fx[a.i].p) * a.u);
+    for (size_t i = a.i + 1; i <= b.i; ++i) path.push_back(fx[i].p);
+    path.push_back(fx[b.i].p + (fx[b.i + 1].p - fx[b.i].p) * b.u);
+  }
+  // 距離で等間隔に取り直して平滑化。ノイズで伸びた距離を縮めるため、
+  // 平滑後の中心線をもう一度取り直す（2回目で長さがほぼ収束する）
+  std::vector<geo::Vec2> c;
+  float len = 0.0f, bm = binM;
+  int bins = 0;
+  for (int iter = 0; iter < 2; ++iter) {
+    if (!resample(path, binM, c, len, bm)) {
+      fprintf(stderr, "lap length %.0f m does not fit %d..%d bins of %.1f m\n", len, 20, TrackModel::MAX_BINS, binM);
+      return 1;
+    }
+    bins = (int)c.size();
+    smooth(c);
+    path = c;
+    path.push_back(c[0]);   // 閉じた折れ線として取り直す
+  }
+
+  // 曲率（±1 ビンの方位差）→ ±4 ビンで平滑
+  std::vector<float> kap(bins), ks(bins);
+  for (int j = 0; j < bins; ++j) {
+    geo::Vec2 a = c[j] - c[(j - 1 + bins) % bins];
+    geo::Vec2 b = c[(j + 1) % bins] - c[j];
+    kap[j] = fabsf(wrapPi(atan2f(b.y, b.x) - atan2f(a.y, a.x))) / bm;
+  }
+  for (int j = 0; j < bins; ++j) {
+    float s = 0.0f;
+    for (int k = -4; k <= 4; ++k) s += kap[(j + k + bins) % bins];
+    ks[j] = s / 9.0f;
+  }
+
+  // 極値：コーナー（半径 CORNER_R 未満の区間ごとの曲率極大）と ストレート上の曲率極小
+  const float KC = 1.0f / CORNER_R;
+  const int W = std::max(2, (int)(50.0f / bm));
+  std::vector<int> corners, straights;
+  for (int j = 0; j < bins; ++j) {
+    bool isMin = true;
+    for (int k = -W; k <= W && isMin; ++k) {
+      float v = ks[(j + k + bins) % bins];
+      if (k != 0 && (v < ks[j] || (v == ks[j] && k < 0))) isMin = false;
+    }
+    if (isMin && ks[j] < KC) straights.push_back(j);
+  }
+  for (int j = 0, peak = -1; j < bins + 1; ++j) {
+    bool in = ks[j % bins] >= KC;
+    if (in && (peak < 0 || ks[j % bins] > ks[peak])) peak = j % bins;
+    if (!in && peak >= 0) { corners.push_back(peak); peak = -1; }
+  }
+
+  // 区間境界：等分位置に一番近いストレート極小（なければ等分位置）
+  TrackFileMeta meta = {};
+  meta.sectors = (uint16_t)nSectors;
+  std::vector<int> cut;
+  for (int s = 1; s < nSectors; ++s) {
+    int target = bins * s / nSectors;
+    int best = target;
+    int bestD = bins / (2 * nSectors);   // 等分位置から区間長の半分まで
+    for (int j : straights) {
+      int d = abs(j - target);
+      if (d < bestD && (cut.empty() || j > cut.back() + bins / (4 * nSectors))) { bestD = d; best = j; }
+    }
+    cut.push_back(best);
+  }
+  for (int s = 0; s < nSectors - 1; ++s) meta.sectorEndM[s] = cut[s] * bm;
+  meta.sectorEndM[nSectors - 1] = bins * bm;
+
+  // 原点をビン0へ（端末はここでラップを切り、距離0とする）
+  double lat0, lon0;
+  frame.toLatLon(c[0], lat0, lon0);
+  geo::LocalFrame out;
+  out.setOrigin(lat0, lon0);
+
+  static TrackModel tm;
+  tm.reset(lat0, lon0);
+  TrackFileHeader h;
+  memcpy(h.magic, "TRK1", 4);
+  h.version = 2;
+  h.bins = (uint16_t)bins;
+  h.binM = bm;
+  h.laps = 1;
+  h.lat0 = lat0;
+  h.lon0 = lon0;
+  tm.load(h);
+  for (int j = 0; j < bins; ++j) {
+    double la, lo;
+    frame.toLatLon(c[j], la, lo);
+    geo::Vec2 p = out.toXY(la, lo);
+    tm.bin[j] = { p.x, p.y, 0.0f, 0.0f, 1, 0 };
+  }
+  tm.meta = meta;
+  tm.updateBounds();
+
+  // 走行ライン幅：全周の走行中フィックスを端末と同じ refine で中心線に当てる。
+  // refine は中心線も動かすので写しの上で回し、横ずれの統計だけ持ち帰る
+  static TrackModel wm;
+  wm = tm;
+  for (const Fix& x : fx) {
+    if (x.kmh >= MOVING_KMH) wm.onFix(out.toXY(x.lat, x.lon));
+  }
+  for (int j = 0; j < bins; ++j) {
+    tm.bin[j].latMean = wm.bin[j].latMean;
+    tm.bin[j].latM2 = wm.bin[j].latM2;
+    tm.bin[j].n = wm.bin[j].n;
+  }
+
+  FILE* f = fopen(outPath, "wb");
+  if (!f) {
+    fprintf(stderr, "cannot write %s\n", outPath);
+    return 1;
+  }
+  fwrite(&h, sizeof(h), 1, f);
+  fwrite(tm.bin, sizeof(TrackBin), bins, f);
+  fwrite(&tm.meta, sizeof(TrackFileMeta), 1, f);
+  fclose(f);
+
+  if (widthPath) {
+    FILE* wf = fopen(widthPath, "w");
+    if (!wf) {
+      fprintf(stderr, "cannot write %s\n", widthPath);
+      return 1;
+    }
+    fprintf(wf, "dist_m,width_m,lat_mean_m,n\n");
+    for (int j = 0; j < bins; ++j) {
+      fprintf(wf, "%.1f,%.2f,%.2f,%u\n", j * bm, tm.widthM(j), tm.bin[j].latMean, tm.bin[j].n);
+    }
+    fclose(wf);
+  }
+
+  auto t2 = std::chrono::steady_clock::now();
+
+  printf("\nstart/finish (%s): %.7f, %.7f\n", how, lat0, lon0);
+  printf("picked lap %d: %.3f s, centreline %.1f m = %d bins x %.3f m, %zu corners\n",
+         pick + 1, L.time, len, bins, bm, corners.size());
+  for (int s = 0, j = 0; s < nSectors; ++s) {
+    // 区間内の幅（サンプル 2 未満のビンは除く）：中央値と最大
+    std::vector<float> w;
+    for (; j < bins && j * bm < meta.sectorEndM[s]; ++j) {
+      if (tm.bin[j].n > 1) w.push_back(tm.widthM(j));
+    }
+    if (w.empty()) {
+      printf("  S%d ends at %7.1f m  width -\n", s + 1, meta.sectorEndM[s]);
+      continue;
+    }
+    std::sort(w.begin(), w.end());
+    printf("  S%d ends at %7.1f m  width %.1f m (max %.1f m)\n", s + 1, meta.sectorEndM[s], w[w.size() / 2], w.back());
+  }
+  printf("bbox: %.6f,%.6f - %.6f,%.6f\n", tm.meta.minLat, tm.meta.minLon, tm.meta.maxLat, tm.meta.maxLon);
+  printf("wrote %s (%zu fixes decoded in %.3f s, built in %.3f s)\n", outPath, fx.size(),
+         std::chrono::duration<double>(t1 - t0).count(),
+         std::chrono::duration<double>(t2 - t1).count());
+  return 0;
+}